@@ -1,9 +1,19 @@
 
 #include "llmclient.h"
+#include "agent_server.h"
+#include "agent_ws_server.h"
+#include "agent_runtime.h"
 #include "function_tools.h"
+#include "opencv/image_store.h"
+#include "opencv/background_render.h"
+#include "opencv/image_writer.h"
 #include "llm_tool.h"
+#include "tool_worker_pool.h"
+#include "warmup.h"
+#include "dns_resolver.hpp"
 #include "utils/url.h"
 #include "utils/logger.hpp"
+#include "utils/trace.hpp"
 
 #include <memory>
 #include <iostream>
@@ -11,15 +21,16 @@
 #include <thread>
 #include <opencv2/opencv.hpp>
 #include <iomanip>
+#include <algorithm>
 
 using namespace cv;
 
 using namespace cpp_streamer;
 
-void OnReceiveMessageFromLLM(std::shared_ptr<LLMClient> llm_client_ptr) {
+void OnReceiveMessageFromLLM(std::shared_ptr<AgentRuntime> runtime_ptr) {
 	while (true) {
 		ResponseTuple resp;
-		bool ret = llm_client_ptr->GetRespQueue(resp);
+		bool ret = runtime_ptr->GetRespQueue(resp);
 		if (!ret) {
 			//sleep 1sec			
 			std::this_thread::sleep_for(std::chrono::seconds(1));
@@ -62,22 +73,58 @@ void OnReceiveMessageFromLLM(std::shared_ptr<LLMClient> llm_client_ptr) {
 	std::cout << "end receiving message from llm\r\n";
 }
 
-void ToolsInit(std::shared_ptr<LLMClient> llm_client_ptr) {
+// AIAGENT_TOOL_WORKERS=<n>: worker processes for the image tools, 0 runs them in process.
+// Call before runtime_ptr->Start(), the workers are forked from a process without threads.
+void ToolWorkersInit(Logger* logger) {
+	size_t worker_count = std::max(2u, std::thread::hardware_concurrency() / 2);
+	char* workers_env = nullptr;
+	size_t workers_len = 0;
+	if (_dupenv_s(&workers_env, &workers_len, "AIAGENT_TOOL_WORKERS") == 0 && workers_env != nullptr) {
+		worker_count = (size_t)atoi(workers_env);
+		free(workers_env);
+	}
+	if (worker_count == 0) {
+		return;
+	}
+	ToolWorkerPool& pool = ToolWorkerPool::Instance();
+	pool.AddTool(ConvertColorImg2GrayImgFunctionDefinition().function.name, ConvertColorImg2GrayImgTool);
+	pool.AddTool(ApplyBeautyFilterFunctionDefinition().function.name, ApplyBeautyFilterTool);
+	pool.AddTool(ApplyCartoonFilterFunctionDefinition().function.name, ApplyCartoonFilterTool);
+	pool.AddTool(ApplySunGlassesFunctionDefinition().function.name, ApplySunGlassesTool);
+	pool.AddTool(ConvertImage2CyberPunkStyleFunctionDefinition().function.name, ConvertImage2CyberPunkStyleTool);
+	pool.AddTool(ApplyColorLutFunctionDefinition().function.name, ApplyColorLutTool);
+	// a killed batch or video job leaves partial outputs and an unfinished mp4, they run to the end
+	pool.AddTool(BatchApplyFunctionDefinition().function.name, BatchApplyTool, TOOL_WORKER_NO_TIMEOUT);
+	pool.AddTool(FilterVideoFunctionDefinition().function.name, FilterVideoTool, TOOL_WORKER_NO_TIMEOUT);
+	if (pool.Start(worker_count, logger)) {
+		std::cout << "Image tools run in " << worker_count << " worker processes" << std::endl;
+	}
+}
+
+void ToolsInit(std::shared_ptr<AgentRuntime> runtime_ptr) {
 	auto weather_def = CreateWeatherFunctionDefinition();
 	auto convert_colorimg_to_grayimg_def = ConvertColorImg2GrayImgFunctionDefinition();
 	auto makeup_def = ApplyBeautyFilterFunctionDefinition();
 	auto cartoon_def = ApplyCartoonFilterFunctionDefinition();
 	auto sun_glasses_def = ApplySunGlassesFunctionDefinition();
 	auto cyber_def = ConvertImage2CyberPunkStyleFunctionDefinition();
+	auto color_lut_def = ApplyColorLutFunctionDefinition();
+	auto save_image_def = SaveImageFunctionDefinition();
+	auto batch_apply_def = BatchApplyFunctionDefinition();
+	auto filter_video_def = FilterVideoFunctionDefinition();
 
-	llm_client_ptr->AddFunctionTool(weather_def.function.name, weather_def, GetWeather);
-	llm_client_ptr->AddFunctionTool(convert_colorimg_to_grayimg_def.function.name, convert_colorimg_to_grayimg_def, ConvertColorImg2GrayImgTool);
-	llm_client_ptr->AddFunctionTool(makeup_def.function.name, makeup_def, ApplyBeautyFilterTool);
-	llm_client_ptr->AddFunctionTool(cartoon_def.function.name, cartoon_def, ApplyCartoonFilterTool);
-	llm_client_ptr->AddFunctionTool(sun_glasses_def.function.name, sun_glasses_def, ApplySunGlassesTool);
-	llm_client_ptr->AddFunctionTool(cyber_def.function.name, cyber_def, ConvertImage2CyberPunkStyleTool);
+	runtime_ptr->AddFunctionTool(weather_def.function.name, weather_def, GetWeather);
+	runtime_ptr->AddFunctionTool(convert_colorimg_to_grayimg_def.function.name, convert_colorimg_to_grayimg_def, ConvertColorImg2GrayImgTool);
+	runtime_ptr->AddFunctionTool(makeup_def.function.name, makeup_def, ApplyBeautyFilterTool);
+	runtime_ptr->AddFunctionTool(cartoon_def.function.name, cartoon_def, ApplyCartoonFilterTool);
+	runtime_ptr->AddFunctionTool(sun_glasses_def.function.name, sun_glasses_def, ApplySunGlassesTool);
+	runtime_ptr->AddFunctionTool(cyber_def.function.name, cyber_def, ConvertImage2CyberPunkStyleTool);
+	runtime_ptr->AddFunctionTool(color_lut_def.function.name, color_lut_def, ApplyColorLutTool);
+	runtime_ptr->AddFunctionTool(save_image_def.function.name, save_image_def, SaveImageTool);
+	runtime_ptr->AddFunctionTool(batch_apply_def.function.name, batch_apply_def, BatchApplyTool);
+	runtime_ptr->AddFunctionTool(filter_video_def.function.name, filter_video_def, FilterVideoTool);
 
-	const auto& tool_defs = llm_client_ptr->GetToolDefinitions();
+	const auto& tool_defs = runtime_ptr->GetToolDefinitions();
 	std::cout << "Registered Tools:" << std::endl;
 	size_t max_name_len = 0;
 	for (const auto & def : tool_defs) {
@@ -96,6 +143,30 @@ void ToolsInit(std::shared_ptr<LLMClient> llm_client_ptr) {
 	std::cout << "\r\n";
 }
 
+void DumpTrace(const std::string& trace_file) {
+	if (!Tracer::IsEnabled() || trace_file.empty()) {
+		return;
+	}
+	int count = Tracer::DumpChromeTrace(trace_file);
+	if (count < 0) {
+		std::cout << "Failed to write trace file:" << trace_file << std::endl;
+		return;
+	}
+	std::cout << "Trace written to " << trace_file << ", events:" << count << std::endl;
+}
+
+void PrintWarmup() {
+	if (!Warmup::Instance().IsDone()) {
+		std::cout << "Warmup is still running" << std::endl;
+		return;
+	}
+	for (const auto& step : Warmup::Instance().GetSteps()) {
+		std::cout << "warmup:" << std::left << std::setw(16) << step.name
+			<< " code:" << step.code << " elapsed:" << step.elapsed_ms << "ms\r\n";
+	}
+	std::cout << "warmup total:" << Warmup::Instance().GetElapsedMs() << "ms" << std::endl;
+}
+
 // Configure terminal for UTF-8 output (cross-platform)
 void SetupTerminal() {
 #ifdef _WIN32
@@ -143,18 +214,75 @@ int main(int argc, char** argv) {
 		return -1;
 	}
 
+	// AIAGENT_TRACE=<file>: record spans and write chrome trace_event json on "trace" or exit
+	std::string trace_file;
+	char* trace_env = nullptr;
+	size_t trace_len = 0;
+	if (_dupenv_s(&trace_env, &trace_len, "AIAGENT_TRACE") == 0 && trace_env != nullptr) {
+		trace_file = trace_env;
+		free(trace_env);
+	}
+	if (!trace_file.empty()) {
+		Tracer::Enable(true);
+		std::cout << "Tracing enabled, output file:" << trace_file << std::endl;
+	}
+
 	std::shared_ptr<Logger> logger_ptr = std::make_shared<Logger>("aiagent.log", LOGGER_INFO_LEVEL);
 	logger_ptr->DisableConsole();
 	
 	LogInfof(logger_ptr.get(), "llm url:%s, host:%s, port:%d, subpath:%s, key:%s",
 		llmUrl.c_str(), host.c_str(), port, subpath.c_str(), api_key_env);
-	LLMClient::Init(uv_default_loop(), logger_ptr.get());
+	ImageStore::Instance().SetLogger(logger_ptr.get());
+	BackgroundRender::Instance().SetLogger(logger_ptr.get());
+	ImageWriter::Instance().SetLogger(logger_ptr.get());
+	DnsResolver::Instance().SetLogger(logger_ptr.get());
+
+	// sessions are spread over one loop thread per core
+	size_t shard_count = std::thread::hardware_concurrency();
+	if (shard_count == 0) {
+		shard_count = 1;
+	}
+
+	// server mode: aiagent --server [port] [ws_port], the http api and the websocket channel
+	// run on the loop of this thread, the llm requests on the shard loops
+	if (argc >= 2 && std::string(argv[1]) == "--server") {
+		AgentServerConfig server_config;
+		if (argc >= 3) {
+			server_config.port = (uint16_t)atoi(argv[2]);
+		}
+		uint16_t ws_port = server_config.port + 1;
+		if (argc >= 4) {
+			ws_port = (uint16_t)atoi(argv[3]);
+		}
+		std::shared_ptr<AgentRuntime> runtime_ptr = std::make_shared<AgentRuntime>(shard_count, uv_default_loop(),
+			model_name, host, port, api_key_env, subpath, logger_ptr.get());
+		ToolsInit(runtime_ptr);
+		ToolWorkersInit(logger_ptr.get());
+		// cascade, codecs, ssl context and llm host in the background, see "warmup"
+		Warmup::Instance().Start(host, logger_ptr.get());
+		runtime_ptr->Start();
 
-	std::shared_ptr<LLMClient> llm_client_ptr = std::make_shared<LLMClient>(uv_default_loop(), model_name, host, port, api_key_env, subpath, logger_ptr.get());
+		AgentServer agent_server(uv_default_loop(), runtime_ptr, server_config, logger_ptr.get());
+		agent_server.Start();
+		std::cout << "Agent server listening on " << server_config.host << ":" << server_config.port << std::endl;
 
-	ToolsInit(llm_client_ptr);
+		AgentWsServer agent_ws_server(uv_default_loop(), ws_port, runtime_ptr, logger_ptr.get());
+		agent_ws_server.Start();
+		std::cout << "Agent websocket listening on port " << ws_port << ", uri:" << AGENT_WS_URI << std::endl;
 
-	std::thread resp_thread(OnReceiveMessageFromLLM, llm_client_ptr);
+		uv_run(uv_default_loop(), UV_RUN_DEFAULT);
+		DumpTrace(trace_file);
+		return 0;
+	}
+	std::shared_ptr<AgentRuntime> runtime_ptr = std::make_shared<AgentRuntime>(shard_count, nullptr,
+		model_name, host, port, api_key_env, subpath, logger_ptr.get());
+
+	ToolsInit(runtime_ptr);
+	ToolWorkersInit(logger_ptr.get());
+	Warmup::Instance().Start(host, logger_ptr.get());
+	runtime_ptr->Start();
+
+	std::thread resp_thread(OnReceiveMessageFromLLM, runtime_ptr);
 	resp_thread.detach();
 
 	uint64_t index = 0;
@@ -176,15 +304,24 @@ int main(int argc, char** argv) {
 		// Check if user wants to quit
 		if (w_input == L"quit" || w_input == L"exit") {
 			std::cout << "Exiting program..." << std::endl;
+			DumpTrace(trace_file);
 			break;
 		}
+		if (w_input == L"trace") {
+			DumpTrace(trace_file);
+			continue;
+		}
+		if (w_input == L"warmup") {
+			PrintWarmup();
+			continue;
+		}
 
 		try {
 			// Convert wide string to UTF-8 encoded std::string
 			std::string u8_input = WStringToUtf8(w_input);
 
 			std::string id = "session_" + std::to_string(index++);
-			llm_client_ptr->SendPrompt(id, u8_input);
+			runtime_ptr->SendPrompt(id, u8_input);
 			std::this_thread::sleep_for(std::chrono::milliseconds(2000));
 		}
 		catch (const std::runtime_error& e) {
@@ -0,0 +1,318 @@
+// Microbenchmark of the image tools in src/opencv/image_process.cpp.
+//
+// Not part of CppAIAgent.vcxproj (it has its own main): build it as a console
+// project with the same include dirs and the sources of src/opencv, or e.g.
+//   g++ -O2 -std=c++20 -Isrc image_process_bench.cpp src/opencv/*.cpp `pkg-config --cflags --libs opencv4`
+//
+// Synthetic images are generated at each size, every filter is run on them and
+// one JSON document is printed (or written with --out) with per-stage timings
+// (decode, compute, encode), MP/s, the compute time at 1..N OpenCV threads and
+// the memory of one compute: peak_rss_delta_mb is the highest resident set size
+// sampled every millisecond during the run, minus the size before it. Memory the
+// allocator kept from earlier runs is not counted again. The process-wide high
+// water mark is reported once, as the top level peak_rss_mb.
+// Run it from the directory holding the face cascade xml.
+//
+// usage: image_process_bench [--sizes 0.3,2,12,48] [--filters gray,beauty,cartoon,sunglasses,cyberpunk]
+//                            [--repeat 3] [--threads N] [--quality fast|balanced|best] [--out result.json]
+
+#include "opencv/image_process.h"
+#include "utils/json.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+#endif
+
+using json = nlohmann::json;
+
+typedef std::function<int(const cv::Mat& src, cv::Mat& dst)> BenchFunc;
+
+typedef struct {
+    std::string name;
+    BenchFunc func;
+} BenchFilter;
+
+static double PeakRssMB() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+    }
+    return 0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0); // bytes
+#else
+    return usage.ru_maxrss / 1024.0;            // kilobytes
+#endif
+#endif
+}
+
+// resident set size now
+static double CurrentRssMB() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.WorkingSetSize / (1024.0 * 1024.0);
+    }
+    return 0;
+#elif defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS) {
+        return info.resident_size / (1024.0 * 1024.0);
+    }
+    return 0;
+#else
+    std::ifstream statm("/proc/self/statm");
+    long pages = 0;
+    long resident = 0;
+    if (statm >> pages >> resident) {
+        return resident * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+    }
+    return 0;
+#endif
+}
+
+static double NowMs() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// photo-like content: smooth gradients, skin toned and saturated shapes,
+// edges and sensor noise, the same for every run
+static cv::Mat MakeTestImage(double megapixels) {
+    int width = (int)std::sqrt(megapixels * 1e6 * 4 / 3);
+    int height = width * 3 / 4;
+    cv::Mat img(height, width, CV_8UC3);
+    for (int y = 0; y < height; y++) {
+        cv::Vec3b* row = img.ptr<cv::Vec3b>(y);
+        for (int x = 0; x < width; x++) {
+            row[x] = cv::Vec3b((uchar)(60 + 120 * x / width), (uchar)(40 + 150 * y / height), (uchar)(90 + 100 * (x + y) / (width + height)));
+        }
+    }
+    cv::RNG rng(12345);
+    int shapes = 40;
+    for (int i = 0; i < shapes; i++) {
+        cv::Point center(rng.uniform(0, width), rng.uniform(0, height));
+        int radius = rng.uniform(width / 40 + 1, width / 8 + 2);
+        // every other shape is a skin tone so the beauty mask has work
+        cv::Scalar color = (i % 2) ? cv::Scalar(rng.uniform(90, 140), rng.uniform(130, 170), rng.uniform(180, 230))
+            : cv::Scalar(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+        if (i % 3 == 0) {
+            cv::rectangle(img, cv::Rect(center.x, center.y, radius * 2, radius), color, cv::FILLED);
+        } else {
+            cv::circle(img, center, radius, color, cv::FILLED, cv::LINE_AA);
+        }
+    }
+    cv::Mat noise(img.size(), CV_8UC3);
+    rng.fill(noise, cv::RNG::NORMAL, cv::Scalar::all(0), cv::Scalar::all(6));
+    img += noise;
+    return img;
+}
+
+static std::vector<std::string> SplitList(const std::string& text) {
+    std::vector<std::string> items;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+static std::vector<int> ThreadCounts(int max_threads) {
+    std::vector<int> counts;
+    for (int n = 1; n < max_threads; n *= 2) {
+        counts.push_back(n);
+    }
+    counts.push_back(max_threads);
+    return counts;
+}
+
+// best of repeat runs, the first (cold) run is not counted when repeat > 1
+static double TimeCompute(const BenchFunc& func, const cv::Mat& src, cv::Mat& dst, int repeat, int& ret) {
+    double best = 0;
+    for (int i = 0; i < repeat + (repeat > 1 ? 1 : 0); i++) {
+        double start = NowMs();
+        ret = func(src, dst);
+        double elapsed = NowMs() - start;
+        if (repeat > 1 && i == 0) {
+            continue;
+        }
+        if (best == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+// peak RSS above the RSS before one compute, sampled on a second thread while it runs
+static double MeasurePeakRssDeltaMB(const BenchFunc& func, const cv::Mat& src) {
+    cv::Mat dst;
+    double base = CurrentRssMB();
+    double peak = base;
+    std::atomic<bool> done(false);
+    std::thread sampler([&done, &peak]() {
+        while (!done.load()) {
+            peak = std::max(peak, CurrentRssMB());
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    func(src, dst);
+    done = true;
+    sampler.join();
+    // the result is still held here
+    peak = std::max(peak, CurrentRssMB());
+    return std::max(0.0, peak - base);
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> sizes = { "0.3", "2", "12", "48" };
+    std::vector<std::string> filter_names = { "gray", "beauty", "cartoon", "sunglasses", "cyberpunk" };
+    int repeat = 3;
+    int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    SmoothQuality quality = SMOOTH_BALANCED;
+    std::string out_path;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        std::string value = argv[i + 1];
+        if (key == "--sizes") {
+            sizes = SplitList(value);
+        } else if (key == "--filters") {
+            filter_names = SplitList(value);
+        } else if (key == "--repeat") {
+            repeat = std::max(1, atoi(value.c_str()));
+        } else if (key == "--threads") {
+            max_threads = std::max(1, atoi(value.c_str()));
+        } else if (key == "--quality") {
+            quality = ParseSmoothQuality(value, SMOOTH_BALANCED);
+        } else if (key == "--out") {
+            out_path = value;
+        } else {
+            std::cerr << "unknown option: " << key << std::endl;
+            return -1;
+        }
+    }
+
+    std::vector<BenchFilter> all_filters = {
+        { "gray", [](const cv::Mat& src, cv::Mat& dst) { return ConvertColorImg2GrayImg(src, dst, nullptr); } },
+        { "beauty", [quality](const cv::Mat& src, cv::Mat& dst) { return ApplyBeautyFilter(src, dst, 0.4f, nullptr, quality); } },
+        { "cartoon", [quality](const cv::Mat& src, cv::Mat& dst) { return ApplyCartoonFilter(src, dst, nullptr, quality); } },
+        { "sunglasses", [](const cv::Mat& src, cv::Mat& dst) { return ApplySunGlasses(src, dst, nullptr); } },
+        { "cyberpunk", [](const cv::Mat& src, cv::Mat& dst) { return ConvertImage2CyberPunkStyle(src, dst, nullptr); } },
+    };
+    std::vector<BenchFilter> filters;
+    for (const auto& name : filter_names) {
+        auto it = std::find_if(all_filters.begin(), all_filters.end(), [&name](const BenchFilter& f) { return f.name == name; });
+        if (it == all_filters.end()) {
+            std::cerr << "unknown filter: " << name << std::endl;
+            return -1;
+        }
+        filters.push_back(*it);
+    }
+
+    json report;
+    report["opencv_version"] = CV_VERSION;
+    report["hardware_threads"] = std::thread::hardware_concurrency();
+    report["repeat"] = repeat;
+    report["quality"] = SmoothQualityName(quality);
+    report["results"] = json::array();
+
+    for (const auto& size : sizes) {
+        cv::Mat image = MakeTestImage(atof(size.c_str()));
+        double mp = image.total() / 1e6;
+
+        // decode and encode of the source, as the tools do around every filter
+        std::vector<uchar> encoded;
+        double start = NowMs();
+        cv::imencode(".jpg", image, encoded);
+        double source_encode_ms = NowMs() - start;
+        start = NowMs();
+        cv::Mat decoded = cv::imdecode(encoded, cv::IMREAD_COLOR);
+        double decode_ms = NowMs() - start;
+
+        for (const auto& filter : filters) {
+            json entry;
+            entry["filter"] = filter.name;
+            entry["width"] = decoded.cols;
+            entry["height"] = decoded.rows;
+            entry["megapixels"] = mp;
+            entry["decode_ms"] = decode_ms;
+            entry["source_encode_ms"] = source_encode_ms;
+
+            cv::setNumThreads(max_threads);
+            cv::Mat dst;
+            int ret = 0;
+            double compute_ms = TimeCompute(filter.func, decoded, dst, repeat, ret);
+            entry["ret"] = ret;
+            entry["compute_ms"] = compute_ms;
+            entry["compute_mp_per_sec"] = compute_ms > 0 ? mp / (compute_ms / 1000.0) : 0;
+
+            std::vector<uchar> output;
+            start = NowMs();
+            if (!dst.empty()) {
+                cv::imencode(".jpg", dst, output);
+            }
+            double encode_ms = NowMs() - start;
+            entry["encode_ms"] = encode_ms;
+            double total_ms = decode_ms + compute_ms + encode_ms;
+            entry["total_ms"] = total_ms;
+            entry["total_mp_per_sec"] = total_ms > 0 ? mp / (total_ms / 1000.0) : 0;
+
+            json scaling = json::array();
+            for (int threads : ThreadCounts(max_threads)) {
+                cv::setNumThreads(threads);
+                double ms = TimeCompute(filter.func, decoded, dst, repeat, ret);
+                json point;
+                point["threads"] = threads;
+                point["compute_ms"] = ms;
+                double single_ms = scaling.empty() ? ms : scaling[0]["compute_ms"].get<double>();
+                point["speedup"] = ms > 0 ? single_ms / ms : 0;
+                scaling.push_back(point);
+            }
+            entry["thread_scaling"] = scaling;
+            cv::setNumThreads(max_threads);
+            dst.release();
+            entry["peak_rss_delta_mb"] = MeasurePeakRssDeltaMB(filter.func, decoded);
+            report["results"].push_back(entry);
+
+            std::cerr << filter.name << " " << size << "MP: " << compute_ms << "ms, "
+                << entry["compute_mp_per_sec"].get<double>() << " MP/s" << std::endl;
+        }
+    }
+    cv::setNumThreads(max_threads);
+    report["peak_rss_mb"] = PeakRssMB();
+
+    std::string text = report.dump(2);
+    if (out_path.empty()) {
+        std::cout << text << std::endl;
+    } else {
+        std::ofstream out(out_path);
+        out << text << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,239 @@
+#include "agent_runtime.h"
+#include "opencv/background_render.h"
+
+AgentShard::AgentShard(size_t index, const std::string& model_name, const std::string& host, uint16_t port,
+	const std::string& api_key, const std::string& subpath, Logger* logger)
+	: index_(index)
+	, logger_(logger)
+{
+	uv_loop_init(&loop_);
+	uv_async_init(&loop_, &stop_async_, &AgentShard::OnStopAsync);
+	stop_async_.data = this;
+
+	llm_client_ = std::make_shared<LLMClient>(&loop_, model_name, host, port, api_key, subpath, logger_);
+}
+
+AgentShard::~AgentShard()
+{
+	Stop();
+	// the loop is not closed: the http clients of the shard may still own handles on it
+	llm_client_.reset();
+}
+
+void AgentShard::Start() {
+	if (running_) {
+		return;
+	}
+	running_ = true;
+	thread_ = std::thread([this]() {
+		LogInfof(logger_, "Agent shard %zu loop thread starting", index_);
+		uv_run(&loop_, UV_RUN_DEFAULT);
+		LogInfof(logger_, "Agent shard %zu loop thread exiting", index_);
+		});
+}
+
+void AgentShard::Stop() {
+	if (!running_) {
+		return;
+	}
+	running_ = false;
+	uv_async_send(&stop_async_);
+	if (thread_.joinable()) {
+		thread_.join();
+	}
+}
+
+void AgentShard::OnStopAsync(uv_async_t* handle) {
+	uv_stop(handle->loop);
+}
+
+AgentRuntime::AgentRuntime(size_t shard_count, uv_loop_t* home_loop,
+	const std::string& model_name, const std::string& host, uint16_t port,
+	const std::string& api_key, const std::string& subpath, Logger* logger)
+	: logger_(logger)
+	, home_loop_(home_loop)
+{
+	if (shard_count == 0) {
+		shard_count = 1;
+	}
+	if (home_loop_) {
+		home_async_ = (uv_async_t*)malloc(sizeof(uv_async_t));
+		uv_async_init(home_loop_, home_async_, &AgentRuntime::OnHomeAsync);
+		home_async_->data = this;
+	}
+	for (size_t index = 0; index < shard_count; index++) {
+		shards_.emplace_back(new AgentShard(index, model_name, host, port, api_key, subpath, logger));
+	}
+	LogInfof(logger_, "AgentRuntime initializing with %zu shards, home loop:%s", shard_count, home_loop_ ? "yes" : "no");
+}
+
+AgentRuntime::~AgentRuntime()
+{
+	Stop();
+	shards_.clear();
+}
+
+void AgentRuntime::AddFunctionTool(const std::string& name, const ToolDefinition& def, ToolFunction func) {
+	for (auto& shard : shards_) {
+		shard->GetLLMClient()->AddFunctionTool(name, def, func);
+	}
+}
+
+const std::vector<ToolDefinition>& AgentRuntime::GetToolDefinitions() const {
+	return shards_[0]->GetLLMClient()->GetToolDefinitions();
+}
+
+void AgentRuntime::Start() {
+	for (auto& shard : shards_) {
+		shard->Start();
+	}
+}
+
+void AgentRuntime::Stop() {
+	for (auto& shard : shards_) {
+		shard->Stop();
+	}
+	// render threads may still post, they find no handle and drop the task
+	uv_async_t* home_async = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(task_mutex_);
+		home_async = home_async_;
+		home_async_ = nullptr;
+		home_tasks_.clear();
+	}
+	if (home_async) {
+		home_async->data = nullptr;
+		uv_close((uv_handle_t*)home_async, &AgentRuntime::OnHomeAsyncClose);
+	}
+}
+
+size_t AgentRuntime::GetShardIndex(const std::string& session_id) const {
+	return std::hash<std::string>()(session_id) % shards_.size();
+}
+
+void AgentRuntime::SendPrompt(const std::string& id, const std::string& prompt, const std::string& session_id, LLMClientCallbackI* cb) {
+	if (cb) {
+		std::lock_guard<std::mutex> lock(cb_mutex_);
+		callbacks_[id] = cb;
+		session_callbacks_[session_id] = cb;
+	}
+	size_t index = GetShardIndex(session_id);
+	LogInfof(logger_, "Prompt id:%s session:%s goes to shard %zu", id.c_str(), session_id.c_str(), index);
+	shards_[index]->GetLLMClient()->SendPrompt(id, prompt, session_id, cb ? this : nullptr);
+}
+
+void AgentRuntime::CloseSession(const std::string& session_id) {
+	{
+		std::lock_guard<std::mutex> lock(cb_mutex_);
+		session_callbacks_.erase(session_id);
+	}
+	shards_[GetShardIndex(session_id)]->GetLLMClient()->CloseSession(session_id);
+}
+
+bool AgentRuntime::GetRespQueue(ResponseTuple& resp_tuple) {
+	// full resolution renders behind tool previews are reported like responses, id: the render job id
+	RenderResult render_result;
+	if (BackgroundRender::Instance().GetCompleted(render_result)) {
+		auto resp_ptr = std::make_shared<ChatCompletionsResponse>();
+		resp_ptr->id = render_result.job_id;
+		resp_ptr->object = "render.completion";
+		ChatCompletionsChoice choice;
+		choice.message.role = "assistant";
+		choice.message.content = render_result.desc + ": " + render_result.path;
+		choice.finish_reason = "stop";
+		resp_ptr->choices.push_back(choice);
+		resp_tuple = ResponseTuple(render_result.code, render_result.code == 0 ? "" : render_result.desc,
+			render_result.job_id, resp_ptr);
+		return true;
+	}
+	for (size_t count = 0; count < shards_.size(); count++) {
+		size_t index = poll_index_++ % shards_.size();
+		if (shards_[index]->GetLLMClient()->GetRespQueue(resp_tuple)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+LLMClientCallbackI* AgentRuntime::GetCallback(const std::string& request_id, bool remove) {
+	std::lock_guard<std::mutex> lock(cb_mutex_);
+	auto it = callbacks_.find(request_id);
+	if (it == callbacks_.end()) {
+		return nullptr;
+	}
+	LLMClientCallbackI* cb = it->second;
+	if (remove) {
+		callbacks_.erase(it);
+	}
+	return cb;
+}
+
+LLMClientCallbackI* AgentRuntime::GetSessionCallback(const std::string& session_id) {
+	std::lock_guard<std::mutex> lock(cb_mutex_);
+	auto it = session_callbacks_.find(session_id);
+	return it == session_callbacks_.end() ? nullptr : it->second;
+}
+
+void AgentRuntime::OnAgentEvent(const AgentEvent& event) {
+	LLMClientCallbackI* cb = GetCallback(event.request_id, false);
+	if (!cb && event.type == AGENT_EVENT_RENDER_DONE) {
+		cb = GetSessionCallback(event.session_id);
+	}
+	if (!cb) {
+		return;
+	}
+	if (!home_loop_) {
+		cb->OnAgentEvent(event);
+		return;
+	}
+	PostHome([cb, event]() {
+		cb->OnAgentEvent(event);
+		});
+}
+
+void AgentRuntime::OnAgentResponse(int code, const std::string& err_msg, const std::string& request_id, std::shared_ptr<ChatCompletionsResponse> resp_ptr) {
+	LLMClientCallbackI* cb = GetCallback(request_id, true);
+	if (!cb) {
+		LogErrorf(logger_, "No callback for request id:%s", request_id.c_str());
+		return;
+	}
+	if (!home_loop_) {
+		cb->OnAgentResponse(code, err_msg, request_id, resp_ptr);
+		return;
+	}
+	PostHome([cb, code, err_msg, request_id, resp_ptr]() {
+		cb->OnAgentResponse(code, err_msg, request_id, resp_ptr);
+		});
+}
+
+void AgentRuntime::PostHome(std::function<void()> task) {
+	std::lock_guard<std::mutex> lock(task_mutex_);
+	if (!home_async_) {
+		return;
+	}
+	home_tasks_.push_back(std::move(task));
+	uv_async_send(home_async_);
+}
+
+void AgentRuntime::OnHomeAsync(uv_async_t* handle) {
+	AgentRuntime* runtime = static_cast<AgentRuntime*>(handle->data);
+	if (runtime) {
+		runtime->RunHomeTasks();
+	}
+}
+
+void AgentRuntime::OnHomeAsyncClose(uv_handle_t* handle) {
+	free(handle);
+}
+
+void AgentRuntime::RunHomeTasks() {
+	// uv_async_send calls are coalesced, run everything queued so far
+	std::list<std::function<void()>> tasks;
+	{
+		std::lock_guard<std::mutex> lock(task_mutex_);
+		tasks.swap(home_tasks_);
+	}
+	for (auto& task : tasks) {
+		task();
+	}
+}
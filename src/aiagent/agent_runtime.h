@@ -0,0 +1,106 @@
+#ifndef AGENT_RUNTIME_H
+#define AGENT_RUNTIME_H
+#include "llmclient.h"
+#include "llm_info.h"
+#include "llm_tool.h"
+#include "utils/logger.hpp"
+
+#include "uv.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <functional>
+
+using namespace cpp_streamer;
+
+// One loop thread with its own LLMClient (http clients, timers and queues).
+class AgentShard
+{
+public:
+	AgentShard(size_t index, const std::string& model_name, const std::string& host, uint16_t port,
+		const std::string& api_key, const std::string& subpath, Logger* logger);
+	~AgentShard();
+
+public:
+	void Start();
+	void Stop();
+	std::shared_ptr<LLMClient> GetLLMClient() { return llm_client_; }
+
+private:
+	static void OnStopAsync(uv_async_t* handle);
+
+private:
+	size_t index_ = 0;
+	Logger* logger_ = nullptr;
+	uv_loop_t loop_;
+	uv_async_t stop_async_;
+	std::shared_ptr<LLMClient> llm_client_;
+	std::thread thread_;
+	bool running_ = false;
+};
+
+// N loop threads, sessions are sharded by the hash of the session id so the
+// history of one session always stays on one loop. SendPrompt and CloseSession
+// may be called from any thread. When a home loop is given, callbacks are
+// delivered on it, otherwise on the shard thread.
+class AgentRuntime : public LLMClientCallbackI
+{
+public:
+	AgentRuntime(size_t shard_count, uv_loop_t* home_loop,
+		const std::string& model_name, const std::string& host, uint16_t port,
+		const std::string& api_key, const std::string& subpath, Logger* logger);
+	virtual ~AgentRuntime();
+
+public:
+	// register tools before Start
+	void AddFunctionTool(const std::string& name, const ToolDefinition& def, ToolFunction func);
+	const std::vector<ToolDefinition>& GetToolDefinitions() const;
+	void Start();
+	// stops the shards; with a home loop call it on that loop's thread, it closes the async handle there
+	void Stop();
+
+public:
+	void SendPrompt(const std::string& id, const std::string& prompt, const std::string& session_id = "", LLMClientCallbackI* cb = nullptr);
+	void CloseSession(const std::string& session_id);
+	// responses of prompts sent without callback, and the full renders of their tool previews
+	bool GetRespQueue(ResponseTuple& resp_tuple);
+	size_t ShardCount() const { return shards_.size(); }
+
+public:
+	virtual void OnAgentEvent(const AgentEvent& event) override;
+	virtual void OnAgentResponse(int code, const std::string& err_msg, const std::string& request_id, std::shared_ptr<ChatCompletionsResponse> resp_ptr) override;
+
+private:
+	static void OnHomeAsync(uv_async_t* handle);
+	static void OnHomeAsyncClose(uv_handle_t* handle);
+	size_t GetShardIndex(const std::string& session_id) const;
+	LLMClientCallbackI* GetCallback(const std::string& request_id, bool remove);
+	LLMClientCallbackI* GetSessionCallback(const std::string& session_id);
+	void PostHome(std::function<void()> task);
+	void RunHomeTasks();
+
+private:
+	Logger* logger_ = nullptr;
+	uv_loop_t* home_loop_ = nullptr;
+	uv_async_t* home_async_ = nullptr; // freed in its close callback, it may outlive the runtime on the loop
+	std::vector<std::unique_ptr<AgentShard>> shards_;
+	size_t poll_index_ = 0;
+
+private:
+	std::mutex cb_mutex_;
+	std::map<std::string, LLMClientCallbackI*> callbacks_; // key: request_id
+	// the last callback of a session, for render events that come after the turn
+	std::map<std::string, LLMClientCallbackI*> session_callbacks_; // key: session_id
+
+private:
+	std::mutex task_mutex_;
+	std::list<std::function<void()>> home_tasks_;
+};
+
+#endif
@@ -0,0 +1,336 @@
+#include "agent_server.h"
+#include "utils/timeex.hpp"
+
+AgentServer* AgentServer::instance_ = nullptr;
+
+AgentReplyAwaiter::AgentReplyAwaiter(std::shared_ptr<AgentReply> reply, std::shared_ptr<CoHttpResponse> response, int64_t expire_ms)
+	: reply_(reply)
+	, response_(response)
+	, expire_ms_(expire_ms)
+{
+}
+
+AgentReplyAwaiter::~AgentReplyAwaiter()
+{
+}
+
+bool AgentReplyAwaiter::await_ready() const noexcept {
+	return reply_->done;
+}
+
+void AgentReplyAwaiter::await_suspend(std::coroutine_handle<> h) noexcept {
+	handle_ = h;
+	reply_->waiters.push_back(this);
+}
+
+bool AgentReplyAwaiter::await_resume() const noexcept {
+	return reply_->done;
+}
+
+void AgentReplyAwaiter::Resume() {
+	if (handle_) {
+		std::coroutine_handle<> handle = handle_;
+		handle_ = nullptr;
+		handle.resume();
+	}
+}
+
+void AgentReplyAwaiter::KeepAlive() {
+	if (handle_ && response_) {
+		response_->KeepAlive();
+	}
+}
+
+AgentServer::AgentServer(uv_loop_t* loop, std::shared_ptr<AgentRuntime> runtime, const AgentServerConfig& config, Logger* logger)
+	: TimerInterface(loop, 100)
+	, loop_(loop)
+	, runtime_(runtime)
+	, config_(config)
+	, logger_(logger)
+{
+	instance_ = this;
+	// a suspended long-poll is kept alive by the timer, the margin covers a late tick
+	if (config_.long_poll_ms > CO_HTTP_SESSION_IDLE_MS - 1000) {
+		LogWarnf(logger_, "long poll %dms does not fit under the http idle timeout %dms, use %dms",
+			config_.long_poll_ms, CO_HTTP_SESSION_IDLE_MS, CO_HTTP_SESSION_IDLE_MS - 1000);
+		config_.long_poll_ms = CO_HTTP_SESSION_IDLE_MS - 1000;
+	}
+	http_server_.reset(new CoHttpServer(loop, config_.host, config_.port, logger));
+
+	LogInfof(logger_, "AgentServer initializing, host:%s, port:%d, long poll:%dms, session timeout:%dms, max sessions:%d, max inflight:%d/%d",
+		config_.host.c_str(), config_.port, config_.long_poll_ms, config_.session_timeout_ms,
+		config_.max_sessions, config_.max_inflight_per_session, config_.max_inflight_total);
+}
+
+AgentServer::~AgentServer()
+{
+	if (instance_ == this) {
+		instance_ = nullptr;
+	}
+}
+
+void AgentServer::Start() {
+	http_server_->AddPostHandle("/v1/sessions/{id}/messages", &AgentServer::HandlePostMessage);
+	http_server_->AddGetHandle("/v1/sessions/{id}/messages/{request_id}", &AgentServer::HandleGetMessage);
+	http_server_->Run();
+	StartTimer();
+}
+
+CoVoidTask AgentServer::HandlePostMessage(std::shared_ptr<CoHttpRequest> request, std::shared_ptr<CoHttpResponse> response_ptr) {
+	if (instance_) {
+		instance_->OnPostMessage(request, response_ptr);
+	}
+	co_return;
+}
+
+CoVoidTask AgentServer::HandleGetMessage(std::shared_ptr<CoHttpRequest> request, std::shared_ptr<CoHttpResponse> response_ptr) {
+	if (instance_) {
+		instance_->OnGetMessage(request, response_ptr);
+	}
+	co_return;
+}
+
+CoVoidTask AgentServer::OnPostMessage(std::shared_ptr<CoHttpRequest> request, std::shared_ptr<CoHttpResponse> response_ptr) {
+	std::string session_id = request->params["id"];
+	if (session_id.empty() || session_id.length() > 128) {
+		WriteJson(response_ptr, 400, "Bad Request", json{ {"error", "invalid session id"} });
+		co_return;
+	}
+
+	std::string content;
+	try {
+		std::string body_str(request->content_data_->Data(), request->content_data_->DataLen());
+		auto body_json = json::parse(body_str);
+		if (body_json.contains("content") && body_json["content"].is_string()) {
+			content = body_json["content"].get<std::string>();
+		}
+	}
+	catch (const std::exception& e) {
+		LogErrorf(logger_, "Failed to parse message body, session:%s, error:%s", session_id.c_str(), e.what());
+	}
+	if (content.empty()) {
+		WriteJson(response_ptr, 400, "Bad Request", json{ {"error", "body must be {\"content\":\"...\"}"} });
+		co_return;
+	}
+
+	std::shared_ptr<AgentSession> session = GetOrCreateSession(session_id);
+	if (!session) {
+		response_ptr->AddHeader("Retry-After", "1");
+		WriteJson(response_ptr, 429, "Too Many Requests", json{ {"error", "too many sessions"} });
+		co_return;
+	}
+	session->active_ms = now_millisec();
+
+	if (session->inflight >= config_.max_inflight_per_session
+		|| inflight_total_ >= config_.max_inflight_total
+		|| session->replies.size() >= config_.max_replies_per_session) {
+		LogWarnf(logger_, "Reject message for session:%s, session inflight:%d, total inflight:%d, replies:%zu",
+			session_id.c_str(), session->inflight, inflight_total_, session->replies.size());
+		response_ptr->AddHeader("Retry-After", "1");
+		WriteJson(response_ptr, 429, "Too Many Requests", json{ {"error", "too many requests in flight"} });
+		co_return;
+	}
+
+	std::shared_ptr<AgentReply> reply = std::make_shared<AgentReply>();
+	reply->request_id = "req_" + std::to_string(++request_index_);
+	reply->session_id = session_id;
+
+	session->replies[reply->request_id] = reply;
+	pending_replies_[reply->request_id] = reply;
+	session->inflight++;
+	inflight_total_++;
+
+	LogInfof(logger_, "Session:%s queue prompt, request id:%s", session_id.c_str(), reply->request_id.c_str());
+	runtime_->SendPrompt(reply->request_id, content, session_id, this);
+
+	co_await AgentReplyAwaiter(reply, response_ptr, now_millisec() + config_.long_poll_ms);
+
+	WriteReply(response_ptr, reply);
+}
+
+CoVoidTask AgentServer::OnGetMessage(std::shared_ptr<CoHttpRequest> request, std::shared_ptr<CoHttpResponse> response_ptr) {
+	std::string session_id = request->params["id"];
+	std::string request_id = request->params["request_id"];
+
+	auto session_it = sessions_.find(session_id);
+	if (session_it == sessions_.end()) {
+		WriteJson(response_ptr, 404, "Not Found", json{ {"error", "session not found"} });
+		co_return;
+	}
+	std::shared_ptr<AgentSession> session = session_it->second;
+	auto reply_it = session->replies.find(request_id);
+	if (reply_it == session->replies.end()) {
+		WriteJson(response_ptr, 404, "Not Found", json{ {"error", "request not found"} });
+		co_return;
+	}
+	std::shared_ptr<AgentReply> reply = reply_it->second;
+	session->active_ms = now_millisec();
+
+	if (!reply->done) {
+		co_await AgentReplyAwaiter(reply, response_ptr, now_millisec() + config_.long_poll_ms);
+	}
+	WriteReply(response_ptr, reply);
+}
+
+void AgentServer::OnAgentEvent(const AgentEvent& event) {
+	// the http api only returns final answers, progress goes to the websocket channel;
+	// a full render replacing a preview is added to the reply it belongs to
+	if (event.type != AGENT_EVENT_RENDER_DONE) {
+		return;
+	}
+	auto session_it = sessions_.find(event.session_id);
+	if (session_it == sessions_.end()) {
+		return;
+	}
+	auto reply_it = session_it->second->replies.find(event.request_id);
+	if (reply_it == session_it->second->replies.end()) {
+		LogInfof(logger_, "Render %s of request id:%s, the reply is gone", event.name.c_str(), event.request_id.c_str());
+		return;
+	}
+	json render_json;
+	render_json["job"] = event.name;
+	render_json["code"] = event.code;
+	render_json["result"] = event.content;
+	reply_it->second->renders.push_back(render_json);
+}
+
+void AgentServer::OnAgentResponse(int code, const std::string& err_msg, const std::string& request_id, std::shared_ptr<ChatCompletionsResponse> resp_ptr) {
+	auto it = pending_replies_.find(request_id);
+	if (it == pending_replies_.end()) {
+		LogWarnf(logger_, "No pending reply for request id:%s", request_id.c_str());
+		return;
+	}
+	std::shared_ptr<AgentReply> reply = it->second;
+	pending_replies_.erase(it);
+
+	reply->done = true;
+	reply->done_ms = now_millisec();
+	reply->code = code;
+	reply->err_msg = err_msg;
+	if (code == 0 && resp_ptr) {
+		for (const auto& choice : resp_ptr->choices) {
+			if (choice.message.role == "assistant") {
+				reply->content = choice.message.content;
+				break;
+			}
+		}
+	}
+	else if (code == 0) {
+		reply->code = -1;
+	}
+
+	auto session_it = sessions_.find(reply->session_id);
+	if (session_it != sessions_.end() && session_it->second->inflight > 0) {
+		session_it->second->inflight--;
+	}
+	if (inflight_total_ > 0) {
+		inflight_total_--;
+	}
+	LogInfof(logger_, "Session:%s request id:%s done, code:%d", reply->session_id.c_str(), request_id.c_str(), reply->code);
+
+	WakeWaiters(reply, false, reply->done_ms);
+}
+
+void AgentServer::OnTimer() {
+	int64_t now_ms = now_millisec();
+
+	// resuming a waiter writes its response, collect first so the map is not walked while it runs
+	std::vector<std::shared_ptr<AgentReply>> replies;
+	for (auto& item : pending_replies_) {
+		if (!item.second->waiters.empty()) {
+			replies.push_back(item.second);
+		}
+		// the http session of a suspended handler must outlive the wait
+		for (AgentReplyAwaiter* waiter : item.second->waiters) {
+			waiter->KeepAlive();
+		}
+	}
+	for (auto& reply : replies) {
+		WakeWaiters(reply, true, now_ms);
+	}
+
+	for (auto it = sessions_.begin(); it != sessions_.end();) {
+		std::shared_ptr<AgentSession> session = it->second;
+		for (auto reply_it = session->replies.begin(); reply_it != session->replies.end();) {
+			std::shared_ptr<AgentReply> reply = reply_it->second;
+			if (reply->done && reply->waiters.empty() && now_ms - reply->done_ms > config_.reply_keep_ms) {
+				reply_it = session->replies.erase(reply_it);
+			} else {
+				++reply_it;
+			}
+		}
+		if (session->inflight == 0 && session->replies.empty()
+			&& now_ms - session->active_ms > config_.session_timeout_ms) {
+			LogInfof(logger_, "Session:%s is idle, close it", it->first.c_str());
+			runtime_->CloseSession(it->first);
+			it = sessions_.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+std::shared_ptr<AgentSession> AgentServer::GetOrCreateSession(const std::string& session_id) {
+	auto it = sessions_.find(session_id);
+	if (it != sessions_.end()) {
+		return it->second;
+	}
+	if (sessions_.size() >= config_.max_sessions) {
+		LogErrorf(logger_, "Too many sessions:%zu, reject session:%s", sessions_.size(), session_id.c_str());
+		return nullptr;
+	}
+	std::shared_ptr<AgentSession> session = std::make_shared<AgentSession>();
+	session->session_id = session_id;
+	session->active_ms = now_millisec();
+	sessions_[session_id] = session;
+	LogInfof(logger_, "Session:%s created, sessions:%zu", session_id.c_str(), sessions_.size());
+	return session;
+}
+
+void AgentServer::WriteReply(std::shared_ptr<CoHttpResponse> response_ptr, std::shared_ptr<AgentReply> reply) {
+	json body;
+	body["request_id"] = reply->request_id;
+	if (!reply->done) {
+		body["status"] = "pending";
+		response_ptr->AddHeader("Location", "/v1/sessions/" + reply->session_id + "/messages/" + reply->request_id);
+		WriteJson(response_ptr, 202, "Accepted", body);
+		return;
+	}
+	if (reply->code != 0) {
+		body["status"] = "error";
+		body["code"] = reply->code;
+		body["error"] = reply->err_msg;
+		WriteJson(response_ptr, 502, "Bad Gateway", body);
+		return;
+	}
+	body["status"] = "done";
+	body["content"] = reply->content;
+	if (!reply->renders.empty()) {
+		body["renders"] = reply->renders;
+	}
+	WriteJson(response_ptr, 200, "OK", body);
+}
+
+void AgentServer::WriteJson(std::shared_ptr<CoHttpResponse> response_ptr, int status_code, const std::string& status, const json& body) {
+	response_ptr->SetStatusCode(status_code);
+	response_ptr->SetStatus(status);
+	response_ptr->AddHeader("Content-Type", "application/json");
+
+	std::string body_str = body.dump();
+	response_ptr->Write(body_str.c_str(), body_str.length());
+}
+
+void AgentServer::WakeWaiters(std::shared_ptr<AgentReply> reply, bool expired_only, int64_t now_ms) {
+	std::vector<AgentReplyAwaiter*> wake_waiters;
+	for (auto it = reply->waiters.begin(); it != reply->waiters.end();) {
+		if (!expired_only || (*it)->ExpireMs() <= now_ms) {
+			wake_waiters.push_back(*it);
+			it = reply->waiters.erase(it);
+		} else {
+			++it;
+		}
+	}
+	for (auto waiter : wake_waiters) {
+		waiter->Resume();
+	}
+}
@@ -0,0 +1,140 @@
+#ifndef AGENT_SERVER_H
+#define AGENT_SERVER_H
+#include "llmclient.h"
+#include "agent_runtime.h"
+#include "llm_info.h"
+#include "net/http/co_http/co_http_server.hpp"
+#include "utils/logger.hpp"
+#include "utils/timer.hpp"
+#include "utils/co_pub.hpp"
+
+#include "uv.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <map>
+#include <vector>
+#include <memory>
+#include <coroutine>
+
+using namespace cpp_streamer;
+
+typedef struct
+{
+	std::string host = "0.0.0.0";
+	uint16_t port = 8080;
+	uint32_t long_poll_ms = 4000;           // below the idle timeout of CoHttpSession, larger values are clamped
+	uint32_t session_timeout_ms = 30 * 60 * 1000; // idle sessions and their history are dropped after it
+	uint32_t reply_keep_ms = 5 * 60 * 1000;   // finished replies can be fetched again during this time
+	uint32_t max_sessions = 10000;
+	uint32_t max_inflight_per_session = 1;
+	uint32_t max_inflight_total = 256;
+	uint32_t max_replies_per_session = 16;
+} AgentServerConfig;
+
+class AgentReplyAwaiter;
+
+class AgentReply
+{
+public:
+	std::string request_id;
+	std::string session_id;
+	bool done = false;
+	int code = 0;
+	std::string err_msg;
+	std::string content;
+	json renders = json::array(); // full resolution renders of the tool previews, done after the answer
+	int64_t done_ms = 0;
+	std::vector<AgentReplyAwaiter*> waiters;
+};
+
+class AgentSession
+{
+public:
+	std::string session_id;
+	uint32_t inflight = 0;
+	int64_t active_ms = 0;
+	std::map<std::string, std::shared_ptr<AgentReply>> replies; // key: request_id
+};
+
+// co_await until the reply is done or the long-poll time is over,
+// await_resume returns whether the reply is done. While it waits, the
+// server timer keeps the http session of response from the idle reap,
+// the response writes through it on resume.
+class AgentReplyAwaiter
+{
+public:
+	AgentReplyAwaiter(std::shared_ptr<AgentReply> reply, std::shared_ptr<CoHttpResponse> response, int64_t expire_ms);
+	~AgentReplyAwaiter();
+
+public://for co_await
+	bool await_ready() const noexcept;
+	void await_suspend(std::coroutine_handle<> h) noexcept;
+	bool await_resume() const noexcept;
+
+public:
+	void Resume();
+	void KeepAlive();
+	int64_t ExpireMs() const { return expire_ms_; }
+
+private:
+	std::shared_ptr<AgentReply> reply_;
+	std::shared_ptr<CoHttpResponse> response_;
+	int64_t expire_ms_ = 0;
+	std::coroutine_handle<> handle_;
+};
+
+// HTTP API over CoHttpServer, every session keeps its own conversation history:
+//   POST /v1/sessions/{id}/messages              {"content":"..."}
+//   GET  /v1/sessions/{id}/messages/{request_id}
+// The reply is long-polled: 200 with the answer when it is ready in time,
+// otherwise 202 with the request_id to poll again. Over the limits: 429.
+// Full renders that finish later are listed under "renders" when it is fetched again.
+class AgentServer : public TimerInterface, public LLMClientCallbackI
+{
+public:
+	AgentServer(uv_loop_t* loop, std::shared_ptr<AgentRuntime> runtime, const AgentServerConfig& config, Logger* logger);
+	virtual ~AgentServer();
+
+public:
+	void Start();
+
+public:
+	virtual void OnAgentEvent(const AgentEvent& event) override;
+	virtual void OnAgentResponse(int code, const std::string& err_msg, const std::string& request_id, std::shared_ptr<ChatCompletionsResponse> resp_ptr) override;
+
+protected:
+	virtual void OnTimer() override;
+
+private:
+	// CoHttpServer handles are plain function pointers
+	static CoVoidTask HandlePostMessage(std::shared_ptr<CoHttpRequest> request, std::shared_ptr<CoHttpResponse> response_ptr);
+	static CoVoidTask HandleGetMessage(std::shared_ptr<CoHttpRequest> request, std::shared_ptr<CoHttpResponse> response_ptr);
+
+	CoVoidTask OnPostMessage(std::shared_ptr<CoHttpRequest> request, std::shared_ptr<CoHttpResponse> response_ptr);
+	CoVoidTask OnGetMessage(std::shared_ptr<CoHttpRequest> request, std::shared_ptr<CoHttpResponse> response_ptr);
+
+private:
+	std::shared_ptr<AgentSession> GetOrCreateSession(const std::string& session_id);
+	void WriteReply(std::shared_ptr<CoHttpResponse> response_ptr, std::shared_ptr<AgentReply> reply);
+	void WriteJson(std::shared_ptr<CoHttpResponse> response_ptr, int status_code, const std::string& status, const json& body);
+	void WakeWaiters(std::shared_ptr<AgentReply> reply, bool expired_only, int64_t now_ms);
+
+private:
+	static AgentServer* instance_;
+
+private:
+	uv_loop_t* loop_ = nullptr;
+	std::shared_ptr<AgentRuntime> runtime_;
+	AgentServerConfig config_;
+	Logger* logger_ = nullptr;
+	std::unique_ptr<CoHttpServer> http_server_;
+
+private:
+	std::map<std::string, std::shared_ptr<AgentSession>> sessions_; // key: session_id
+	std::map<std::string, std::shared_ptr<AgentReply>> pending_replies_; // key: request_id, waiting for the llm
+	uint32_t inflight_total_ = 0;
+	uint64_t request_index_ = 0;
+};
+
+#endif
@@ -0,0 +1,229 @@
+#include "agent_ws_server.h"
+
+AgentWsServer* AgentWsServer::instance_ = nullptr;
+
+AgentWsConnection::AgentWsConnection(AgentWsServer* server, WebSocketSession* ws_session, const std::string& session_id, Logger* logger)
+	: server_(server)
+	, ws_session_(ws_session)
+	, session_id_(session_id)
+	, logger_(logger)
+{
+	LogInfof(logger_, "AgentWsConnection created, session:%s", session_id_.c_str());
+}
+
+AgentWsConnection::~AgentWsConnection()
+{
+	LogInfof(logger_, "AgentWsConnection destroyed, session:%s", session_id_.c_str());
+}
+
+void AgentWsConnection::OnReadData(int code, const uint8_t* data, size_t len) {
+	if (code < 0) {
+		OnReadText(code, "");
+		return;
+	}
+	LogWarnf(logger_, "Session:%s binary frame is not supported, len:%zu", session_id_.c_str(), len);
+}
+
+void AgentWsConnection::OnReadText(int code, const std::string& text) {
+	if (code < 0) {
+		LogInfof(logger_, "Session:%s websocket closed, busy:%d", session_id_.c_str(), busy_);
+		ws_session_ = nullptr;
+		prompts_.clear();
+		return;
+	}
+
+	std::string prompt = text;
+	try {
+		auto text_json = json::parse(text);
+		if (text_json.is_object() && text_json.contains("content") && text_json["content"].is_string()) {
+			prompt = text_json["content"].get<std::string>();
+		}
+	}
+	catch (const std::exception&) {
+		// not json, the whole frame is the prompt
+	}
+	if (prompt.empty()) {
+		return;
+	}
+	if (prompts_.size() >= AGENT_WS_MAX_PROMPTS) {
+		json event_json;
+		event_json["type"] = "error";
+		event_json["error"] = "too many queued prompts";
+		SendEvent(event_json);
+		return;
+	}
+	prompts_.push_back(prompt);
+	SendNextPrompt();
+}
+
+void AgentWsConnection::SendNextPrompt() {
+	if (busy_ || prompts_.empty()) {
+		return;
+	}
+	std::string prompt = prompts_.front();
+	prompts_.pop_front();
+
+	busy_ = true;
+	current_request_id_ = session_id_ + "_" + std::to_string(++request_index_);
+	server_->GetRuntime()->SendPrompt(current_request_id_, prompt, session_id_, this);
+}
+
+void AgentWsConnection::OnAgentEvent(const AgentEvent& event) {
+	if (event.type == AGENT_EVENT_DELTA) {
+		if (!pending_delta_request_id_.empty() && pending_delta_request_id_ != event.request_id) {
+			FlushDelta(true);
+		}
+		pending_delta_request_id_ = event.request_id;
+		pending_delta_ += event.content;
+		FlushDelta(false);
+		return;
+	}
+	FlushDelta(true);
+
+	json event_json;
+	event_json["type"] = event.type;
+	event_json["request_id"] = event.request_id;
+	if (event.type == AGENT_EVENT_RENDER_DONE) {
+		event_json["job"] = event.name;
+		event_json["code"] = event.code;
+		event_json["result"] = event.content;
+		SendEvent(event_json);
+		return;
+	}
+	event_json["tool"] = event.name;
+	if (event.type == AGENT_EVENT_TOOL_START) {
+		event_json["args"] = event.content;
+	} else {
+		event_json["code"] = event.code;
+		event_json["result"] = event.content;
+	}
+	SendEvent(event_json);
+}
+
+void AgentWsConnection::OnAgentResponse(int code, const std::string& err_msg, const std::string& request_id, std::shared_ptr<ChatCompletionsResponse> resp_ptr) {
+	FlushDelta(true);
+
+	json event_json;
+	event_json["request_id"] = request_id;
+	if (code == 0 && resp_ptr) {
+		std::string content;
+		for (const auto& choice : resp_ptr->choices) {
+			if (choice.message.role == "assistant") {
+				content = choice.message.content;
+				break;
+			}
+		}
+		event_json["type"] = "final";
+		event_json["content"] = content;
+	} else {
+		event_json["type"] = "error";
+		event_json["code"] = code;
+		event_json["error"] = err_msg;
+	}
+	SendEvent(event_json);
+
+	busy_ = false;
+	current_request_id_.clear();
+	SendNextPrompt();
+}
+
+void AgentWsConnection::OnTimer() {
+	if (!ws_session_) {
+		return;
+	}
+	// the handle is called before the 101 response is written, greet on the first tick
+	if (!hello_sent_) {
+		hello_sent_ = true;
+		json event_json;
+		event_json["type"] = "session";
+		event_json["session_id"] = session_id_;
+		SendEvent(event_json);
+	}
+	FlushDelta(false);
+}
+
+void AgentWsConnection::FlushDelta(bool force) {
+	if (pending_delta_.empty()) {
+		return;
+	}
+	if (!ws_session_) {
+		pending_delta_.clear();
+		pending_delta_request_id_.clear();
+		return;
+	}
+	if (!force && ws_session_->GetWriteQueueSize() > AGENT_WS_COALESCE_BYTES) {
+		coalesced_count_++;
+		return;
+	}
+	if (coalesced_count_ > 0) {
+		LogInfof(logger_, "Session:%s %zu delta events coalesced, %zu bytes", session_id_.c_str(), coalesced_count_ + 1, pending_delta_.length());
+		coalesced_count_ = 0;
+	}
+	json event_json;
+	event_json["type"] = AGENT_EVENT_DELTA;
+	event_json["request_id"] = pending_delta_request_id_;
+	event_json["content"] = pending_delta_;
+	pending_delta_.clear();
+	pending_delta_request_id_.clear();
+	SendEvent(event_json);
+}
+
+void AgentWsConnection::SendEvent(const json& event_json) {
+	if (!ws_session_ || !ws_session_->IsConnected()) {
+		return;
+	}
+	ws_session_->AsyncWriteText(event_json.dump());
+}
+
+AgentWsServer::AgentWsServer(uv_loop_t* loop, uint16_t port, std::shared_ptr<AgentRuntime> runtime, Logger* logger)
+	: TimerInterface(loop, 50)
+	, loop_(loop)
+	, port_(port)
+	, runtime_(runtime)
+	, logger_(logger)
+{
+	instance_ = this;
+}
+
+AgentWsServer::~AgentWsServer()
+{
+	if (instance_ == this) {
+		instance_ = nullptr;
+	}
+}
+
+void AgentWsServer::Start() {
+	ws_server_.reset(new WebSocketServer(port_, loop_, logger_));
+	ws_server_->AddHandle(AGENT_WS_URI, &AgentWsServer::HandleAgentSession);
+	StartTimer();
+	LogInfof(logger_, "AgentWsServer started, port:%d, uri:%s", port_, AGENT_WS_URI);
+}
+
+void AgentWsServer::HandleAgentSession(const std::string& uri, WebSocketSession* ws_session) {
+	if (instance_) {
+		instance_->OnAgentSession(ws_session);
+	}
+}
+
+void AgentWsServer::OnAgentSession(WebSocketSession* ws_session) {
+	std::string session_id = "ws_" + std::to_string(++session_index_);
+	std::shared_ptr<AgentWsConnection> conn = std::make_shared<AgentWsConnection>(this, ws_session, session_id, logger_);
+
+	ws_session->SetSessionCallback(conn.get());
+	connections_[session_id] = conn;
+	LogInfof(logger_, "Agent websocket session:%s from %s, connections:%zu",
+		session_id.c_str(), ws_session->GetRemoteAddress().c_str(), connections_.size());
+}
+
+void AgentWsServer::OnTimer() {
+	for (auto it = connections_.begin(); it != connections_.end();) {
+		std::shared_ptr<AgentWsConnection> conn = it->second;
+		conn->OnTimer();
+		if (conn->IsFinished()) {
+			runtime_->CloseSession(conn->GetSessionId());
+			it = connections_.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
@@ -0,0 +1,106 @@
+#ifndef AGENT_WS_SERVER_H
+#define AGENT_WS_SERVER_H
+#include "llmclient.h"
+#include "agent_runtime.h"
+#include "llm_info.h"
+#include "net/http/websocket/websocket_server.hpp"
+#include "net/http/websocket/websocket_session.hpp"
+#include "utils/logger.hpp"
+#include "utils/timer.hpp"
+
+#include "uv.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <list>
+#include <map>
+#include <memory>
+
+using namespace cpp_streamer;
+
+#define AGENT_WS_URI             "/v1/agent"
+#define AGENT_WS_COALESCE_BYTES  (64*1024) // socket write queue above it: deltas are merged instead of sent
+#define AGENT_WS_MAX_PROMPTS     8         // prompts queued on one connection
+
+class AgentWsServer;
+
+// One websocket connection bound to one agent session.
+// In:  text frames, {"content":"..."} or the plain prompt text.
+// Out: {"type":"session"|"delta"|"tool_start"|"tool_result"|"final"|"error"|"render_done", ...}
+class AgentWsConnection : public WebSocketSessionCallBackI, public LLMClientCallbackI
+{
+public:
+	AgentWsConnection(AgentWsServer* server, WebSocketSession* ws_session, const std::string& session_id, Logger* logger);
+	virtual ~AgentWsConnection();
+
+public:
+	virtual void OnReadData(int code, const uint8_t* data, size_t len) override;
+	virtual void OnReadText(int code, const std::string& text) override;
+
+public:
+	virtual void OnAgentEvent(const AgentEvent& event) override;
+	virtual void OnAgentResponse(int code, const std::string& err_msg, const std::string& request_id, std::shared_ptr<ChatCompletionsResponse> resp_ptr) override;
+
+public:
+	void OnTimer();
+	bool IsFinished() const { return ws_session_ == nullptr && !busy_; }
+	const std::string& GetSessionId() const { return session_id_; }
+
+private:
+	void SendNextPrompt();
+	void SendEvent(const json& event_json);
+	void FlushDelta(bool force);
+
+private:
+	AgentWsServer* server_ = nullptr;
+	WebSocketSession* ws_session_ = nullptr;
+	std::string session_id_;
+	Logger* logger_ = nullptr;
+
+private:
+	bool hello_sent_ = false;
+	bool busy_ = false;
+	uint64_t request_index_ = 0;
+	std::string current_request_id_;
+	std::list<std::string> prompts_;
+
+private:
+	std::string pending_delta_;
+	std::string pending_delta_request_id_;
+	size_t coalesced_count_ = 0;
+};
+
+class AgentWsServer : public TimerInterface
+{
+public:
+	AgentWsServer(uv_loop_t* loop, uint16_t port, std::shared_ptr<AgentRuntime> runtime, Logger* logger);
+	virtual ~AgentWsServer();
+
+public:
+	void Start();
+	std::shared_ptr<AgentRuntime> GetRuntime() { return runtime_; }
+
+protected:
+	virtual void OnTimer() override;
+
+private:
+	// WebSocketServer handles are plain function pointers
+	static void HandleAgentSession(const std::string& uri, WebSocketSession* ws_session);
+	void OnAgentSession(WebSocketSession* ws_session);
+
+private:
+	static AgentWsServer* instance_;
+
+private:
+	uv_loop_t* loop_ = nullptr;
+	uint16_t port_ = 0;
+	std::shared_ptr<AgentRuntime> runtime_;
+	Logger* logger_ = nullptr;
+	std::unique_ptr<WebSocketServer> ws_server_;
+
+private:
+	std::map<std::string, std::shared_ptr<AgentWsConnection>> connections_; // key: session_id
+	uint64_t session_index_ = 0;
+};
+
+#endif
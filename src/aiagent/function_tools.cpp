@@ -1,10 +1,26 @@
 #include "function_tools.h"
 #include "opencv/image_process.h"
+#include "opencv/image_store.h"
+#include "opencv/color_lut.h"
+#include "opencv/batch_processor.h"
+#include "opencv/background_render.h"
+#include "opencv/video_filter.h"
+#include "opencv/image_writer.h"
 #include "utils/url.h"
 #include "utils/timeex.hpp"
 
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+
 using namespace cpp_streamer;
 
+// tools may run in parallel (run_pipeline), the sequence keeps outputs of the same millisecond apart
+static std::string MakeOutputPath(const std::string& src_dir, const std::string& ext) {
+	static std::atomic<uint32_t> output_seq(0);
+	return src_dir + "/output_" + std::to_string(now_millisec() % 100000) + "_" + std::to_string(output_seq++ % 1000) + ext;
+}
+
 FunctionResult GetWeather(std::map<std::string, LLMValue> inputs, Logger* logger) {
 
 	auto location_it = inputs.find("location");
@@ -63,192 +79,559 @@ ToolDefinition CreateWeatherFunctionDefinition() {
 	return def;
 }
 
-// Image Processing Function : Converts a color image to a grayscale image and performs edge detection
-FunctionResult ConvertColorImg2GrayImgTool(std::map<std::string, LLMValue> input_args, Logger* logger) {
+// src_img is a file path or an img:// handle of the image store.
+// origin is the file the image came from, saved results go next to it.
+static bool LoadSrcImage(const std::map<std::string, LLMValue>& input_args, cv::Mat& src, std::string& origin,
+	FunctionResult& error_result, Logger* logger) {
+	error_result.code = -1;
 	auto src_it = input_args.find("src_img");
 	if (src_it == input_args.end()) {
 		LogErrorf(logger, "Missing 'src_img' parameter");
-		FunctionResult error_result;
-		error_result.code = -1;
 		error_result.desc = "Missing 'src_img' parameter";
-		return error_result;
+		return false;
 	}
 	if (src_it->second.type != LLMValue::LLM_VALUE_STRING) {
 		LogErrorf(logger, "Invalid 'src_img' parameter type");
-		FunctionResult error_result;
-		error_result.code = -1;
 		error_result.desc = "Invalid 'src_img' parameter type";
-		return error_result;
+		return false;
 	}
 	std::string src_url = src_it->second.string_value;
-	std::string src_dir;
-	std::string src_filename;
-
-	bool ret = GetSrcDirPathAndFilename(src_url, src_dir, src_filename);
-	if (!ret) {
-		LogErrorf(logger, "GetSrcDirPath failed for url: %s", src_url.c_str());
-		FunctionResult error_result;
-		error_result.code = -1;
-		error_result.desc = "GetSrcDirPath failed for 'src_img'";
-		return error_result;
+	if (ImageStore::IsHandle(src_url)) {
+		if (!ImageStore::Instance().Get(src_url, src, &origin)) {
+			LogErrorf(logger, "Image handle not found: %s", src_url.c_str());
+			error_result.desc = "Image handle not found: " + src_url;
+			return false;
+		}
+		// the tools expect BGR like imread gives, a handle may hold a gray or BGRA result
+		if (src.type() == CV_8UC1) {
+			cv::cvtColor(src, src, cv::COLOR_GRAY2BGR);
+		} else if (src.type() == CV_8UC4) {
+			cv::cvtColor(src, src, cv::COLOR_BGRA2BGR);
+		} else if (src.type() != CV_8UC3) {
+			LogErrorf(logger, "Unsupported image type %d of handle: %s", src.type(), src_url.c_str());
+			error_result.desc = "Unsupported image type of handle: " + src_url;
+			return false;
+		}
+		return true;
+	}
+	// the file may be the output of an earlier tool that is still encoding
+	if (ImageWriter::Instance().WaitPending(src_url) < 0) {
+		LogErrorf(logger, "The earlier write of the image failed: %s", src_url.c_str());
+		error_result.desc = "The earlier write of the image failed: " + src_url;
+		return false;
 	}
+	src = cv::imread(src_url, cv::IMREAD_COLOR);
+	if (src.empty()) {
+		LogErrorf(logger, "Failed to load image: %s", src_url.c_str());
+		error_result.desc = "Failed to load image: " + src_url;
+		return false;
+	}
+	origin = src_url;
+	return true;
+}
 
-	std::string dst_img_url = src_dir + "/output_" + std::to_string(now_millisec() %100000) + ".jpg";
+// optional "format" (jpg, png, webp), "image_quality" (1..100), "progressive", "chroma_subsampling"
+// (420, 422, 444) and "png_compression" (0..9) of saved files
+static ImageEncodeParams GetEncodeParams(const std::map<std::string, LLMValue>& input_args) {
+	ImageEncodeParams params;
+	auto format_it = input_args.find("format");
+	if (format_it != input_args.end() && format_it->second.type == LLMValue::LLM_VALUE_STRING) {
+		const std::string& format = format_it->second.string_value;
+		if (format == "jpg" || format == "jpeg" || format == "png" || format == "webp") {
+			params.format = format;
+		}
+	}
+	auto quality_it = input_args.find("image_quality");
+	if (quality_it != input_args.end() && quality_it->second.type == LLMValue::LLM_VALUE_NUMBER) {
+		params.quality = (int)quality_it->second.number_value;
+	}
+	auto progressive_it = input_args.find("progressive");
+	if (progressive_it != input_args.end() && progressive_it->second.type == LLMValue::LLM_VALUE_BOOL) {
+		params.progressive = progressive_it->second.bool_value;
+	}
+	auto chroma_it = input_args.find("chroma_subsampling");
+	if (chroma_it != input_args.end()) {
+		// a number or a string like "4:4:4"
+		int chroma = 0;
+		if (chroma_it->second.type == LLMValue::LLM_VALUE_NUMBER) {
+			chroma = (int)chroma_it->second.number_value;
+		} else if (chroma_it->second.type == LLMValue::LLM_VALUE_STRING) {
+			std::string digits;
+			for (char c : chroma_it->second.string_value) {
+				if (isdigit((unsigned char)c)) {
+					digits += c;
+				}
+			}
+			chroma = digits.empty() ? 0 : atoi(digits.c_str());
+		}
+		if (chroma == 420 || chroma == 422 || chroma == 444) {
+			params.chroma_subsampling = chroma;
+		}
+	}
+	auto png_it = input_args.find("png_compression");
+	if (png_it != input_args.end() && png_it->second.type == LLMValue::LLM_VALUE_NUMBER) {
+		params.png_compression = std::min(9, std::max(0, (int)png_it->second.number_value));
+	}
+	return params;
+}
 
-	int proc_ret = ConvertColorImg2GrayImg(src_url.c_str(), dst_img_url.c_str(), logger);
-	if (proc_ret < 0) {
-		LogErrorf(logger, "ConvertColorImg2GrayImg failed for src: %s", src_filename.c_str());
-		FunctionResult error_result;
-		error_result.code = -1;
-		error_result.desc = "ConvertColorImg2GrayImg failed";
-		return error_result;
+// the encode runs in the background, what can fail there is checked before queueing it:
+// a writer for the extension and a writable directory. A write that still fails is logged
+// by ImageWriter and reported to the next tool that reads the path.
+static bool CheckOutputPath(const std::string& path, std::string& err_msg) {
+	try {
+		if (!cv::haveImageWriter(path)) {
+			err_msg = "No image encoder for the file extension: " + path;
+			return false;
+		}
 	}
+	catch (const std::exception& e) {
+		err_msg = "No image encoder for " + path + ": " + e.what();
+		return false;
+	}
+	std::filesystem::path dir = std::filesystem::path(path).parent_path();
+	if (dir.empty()) {
+		dir = ".";
+	}
+	std::error_code ec;
+	if (!std::filesystem::is_directory(dir, ec)) {
+		err_msg = "Output directory does not exist: " + dir.string();
+		return false;
+	}
+	std::string probe_path = path + ".probe";
+	{
+		std::ofstream probe(probe_path, std::ios::binary | std::ios::trunc);
+		if (!probe) {
+			err_msg = "Output directory is not writable: " + dir.string();
+			return false;
+		}
+	}
+	std::filesystem::remove(probe_path, ec);
+	return true;
+}
+
+static void AddEncodeParameters(FunctionParameter& params) {
+	ParameterProperties format_prop;
+	format_prop.type = "string";
+	format_prop.description = "Optional file format of the saved image: jpg, png or webp, by default the file extension";
+	params.properties["format"] = format_prop;
+	ParameterProperties quality_prop;
+	quality_prop.type = "number";
+	quality_prop.description = "Optional JPEG/WebP quality 1..100 (default 95), lower gives smaller files";
+	params.properties["image_quality"] = quality_prop;
+	ParameterProperties progressive_prop;
+	progressive_prop.type = "boolean";
+	progressive_prop.description = "Optional, true for a progressive JPEG";
+	params.properties["progressive"] = progressive_prop;
+	ParameterProperties chroma_prop;
+	chroma_prop.type = "number";
+	chroma_prop.description = "Optional JPEG chroma subsampling: 420 (default, smallest), 422 or 444 (sharpest color edges)";
+	params.properties["chroma_subsampling"] = chroma_prop;
+	ParameterProperties png_prop;
+	png_prop.type = "number";
+	png_prop.description = "Optional PNG compression level 0..9, higher gives smaller files and slower saving";
+	params.properties["png_compression"] = png_prop;
+}
+
+// The result is encoded only when the caller gives an 'output' file path,
+// otherwise it stays decoded in the image store and its handle is returned.
+// Files are encoded by ImageWriter in the background, the path is returned
+// as soon as the pixels are ready.
+static FunctionResult OutputImage(const std::map<std::string, LLMValue>& input_args, const cv::Mat& dst,
+	const std::string& origin, Logger* logger) {
 	FunctionResult result;
+	auto output_it = input_args.find("output");
+	if (output_it != input_args.end() && output_it->second.type == LLMValue::LLM_VALUE_STRING
+		&& !output_it->second.string_value.empty()) {
+		ImageEncodeParams encode_params = GetEncodeParams(input_args);
+		std::string output_path = ApplyImageFormat(output_it->second.string_value, encode_params);
+		std::string err_msg;
+		if (!CheckOutputPath(output_path, err_msg)) {
+			LogErrorf(logger, "%s", err_msg.c_str());
+			result.code = -1;
+			result.desc = err_msg;
+			return result;
+		}
+		ImageWriter::Instance().Write(output_path, dst, encode_params);
+		result.value.string_value = output_path;
+	} else {
+		result.value.string_value = ImageStore::Instance().Put(dst, origin);
+	}
 	result.code = 0;
 	result.desc = "Success";
 	result.value.type = LLMValue::LLM_VALUE_STRING;
-	result.value.string_value = dst_img_url;
 	return result;
 }
 
-ToolDefinition ConvertColorImg2GrayImgFunctionDefinition() {
-	ToolDefinition def;
-
-	FunctionDefinition fd;
+static FunctionParameter ImageToolParameters() {
 	FunctionParameter params;
 	params.type = "object";
 	params.required_vec.push_back("src_img");
 	ParameterProperties src_img_prop;
 	src_img_prop.type = "string";
-	src_img_prop.description = "The source image file path";
+	src_img_prop.description = "The source image file path or an img:// handle returned by another image tool";
 	params.properties["src_img"] = src_img_prop;
-	fd.name = "convert_color_img_to_gray_img";
-	fd.description = "Convert a color image to a grayscale image and perform edge detection";
-	fd.parameters = params;
-	def.type = "function";
-	def.function = fd;
+	ParameterProperties output_prop;
+	output_prop.type = "string";
+	output_prop.description = "Optional file path to save the result to. Without it the result is kept in memory "
+		"and an img:// handle is returned, pass it to the next image tool or to save_image";
+	params.properties["output"] = output_prop;
+	AddEncodeParameters(params);
+	return params;
+}
 
-	return def;
+static bool IsPreview(const std::map<std::string, LLMValue>& input_args) {
+	auto it = input_args.find("preview");
+	if (it == input_args.end()) {
+		return false;
+	}
+	if (it->second.type == LLMValue::LLM_VALUE_BOOL) {
+		return it->second.bool_value;
+	}
+	return it->second.type == LLMValue::LLM_VALUE_STRING && it->second.string_value == "true";
 }
 
-// Beauty filter function: make the picture more beatiful, Implements skin smoothing and wrinkle reduction
-FunctionResult ApplyBeautyFilterTool(std::map<std::string, LLMValue> input_args, Logger* logger) {
-	FunctionResult result;
+// Runs an image filter for a tool call. With 'preview' a downscaled copy is
+// filtered and saved first, the full resolution render is queued on
+// BackgroundRender and replaces the preview file when it is done.
+static FunctionResult FilterImage(const std::map<std::string, LLMValue>& input_args, const cv::Mat& src,
+	const std::string& origin, const std::string& name, RenderFunc filter, Logger* logger) {
+	FunctionResult error_result;
+	error_result.code = -1;
+	cv::Mat dst;
+	if (!IsPreview(input_args) || src.total() <= (size_t)PREVIEW_MAX_PIXELS) {
+		if (filter(src, dst) < 0) {
+			LogErrorf(logger, "%s failed for src: %s", name.c_str(), origin.c_str());
+			error_result.desc = name + " failed";
+			return error_result;
+		}
+		return OutputImage(input_args, dst, origin, logger);
+	}
 
-	auto src_it = input_args.find("src_img");
-	if (src_it == input_args.end()) {
-		LogErrorf(logger, "Missing 'src_img' parameter");
-		FunctionResult error_result;
-		error_result.code = -1;
-		error_result.desc = "Missing 'src_img' parameter";
-		return error_result;
+	// the preview needs a file for the full render to replace
+	ImageEncodeParams encode_params = GetEncodeParams(input_args);
+	std::string output_path;
+	auto output_it = input_args.find("output");
+	if (output_it != input_args.end() && output_it->second.type == LLMValue::LLM_VALUE_STRING) {
+		output_path = output_it->second.string_value;
 	}
-	if (src_it->second.type != LLMValue::LLM_VALUE_STRING) {
-		LogErrorf(logger, "Invalid 'src_img' parameter type");
-		FunctionResult error_result;
-		error_result.code = -1;
-		error_result.desc = "Invalid 'src_img' parameter type";
-		return error_result;
+	if (output_path.empty()) {
+		std::string src_dir;
+		std::string src_filename;
+		if (!GetSrcDirPathAndFilename(origin, src_dir, src_filename)) {
+			LogErrorf(logger, "GetSrcDirPath failed for url: %s", origin.c_str());
+			error_result.desc = "GetSrcDirPath failed, give 'output' for the preview";
+			return error_result;
+		}
+		output_path = MakeOutputPath(src_dir, ".jpg");
 	}
-	std::string src_url = src_it->second.string_value;
-	std::string src_dir;
-	std::string src_filename;
+	output_path = ApplyImageFormat(output_path, encode_params);
 
-	bool ret = GetSrcDirPathAndFilename(src_url, src_dir, src_filename);
-	if (!ret) {
-		LogErrorf(logger, "GetSrcDirPath failed for url: %s", src_url.c_str());
-		FunctionResult error_result;
-		error_result.code = -1;
-		error_result.desc = "GetSrcDirPath failed for 'src_img'";
+	if (filter(BackgroundRender::MakePreview(src), dst) < 0) {
+		LogErrorf(logger, "%s preview failed for src: %s", name.c_str(), origin.c_str());
+		error_result.desc = name + " failed";
 		return error_result;
 	}
-
-	std::string dst_img_url = src_dir + "/output_" + std::to_string(now_millisec() % 100000) + ".jpg";
-	float smoothStrength = 0.4f;
-
-	int proc_ret = ApplyBeautyFilter(src_url, dst_img_url, smoothStrength, logger);
-	if (proc_ret < 0) {
-		LogErrorf(logger, "ApplyBeautyFilter failed for src: %s", src_filename.c_str());
-		FunctionResult error_result;
-		error_result.code = -1;
-		error_result.desc = "ApplyBeautyFilter failed";
+	if (ImageWriter::WriteFile(output_path, dst, encode_params, logger) < 0) {
+		LogErrorf(logger, "Failed to save preview image: %s", output_path.c_str());
+		error_result.desc = "Failed to save preview image: " + output_path;
 		return error_result;
 	}
+
+	json preview_json;
+	preview_json["preview"] = output_path;
+	preview_json["preview_size"] = std::to_string(dst.cols) + "x" + std::to_string(dst.rows);
+	std::string job_id = BackgroundRender::Instance().Submit(src, output_path, encode_params, name, filter);
+	if (job_id.empty()) {
+		preview_json["note"] = "Busy, only the preview was rendered";
+	} else {
+		preview_json["render_job"] = job_id;
+		preview_json["note"] = "The full resolution image replaces the preview file when the render job finishes";
+	}
+	LogInfof(logger, "%s preview saved to: %s, full render job:%s", name.c_str(), output_path.c_str(), job_id.c_str());
+
+	FunctionResult result;
 	result.code = 0;
 	result.desc = "Success";
 	result.value.type = LLMValue::LLM_VALUE_STRING;
-	result.value.string_value = dst_img_url;
+	result.value.string_value = preview_json.dump();
 	return result;
 }
 
-ToolDefinition ApplyBeautyFilterFunctionDefinition() {
+static FunctionParameter FilterToolParameters() {
+	FunctionParameter params = ImageToolParameters();
+	ParameterProperties preview_prop;
+	preview_prop.type = "boolean";
+	preview_prop.description = "Optional, true to get a quick low resolution preview file first, "
+		"the full resolution result replaces it in the background. Use it to try styles on large photos";
+	params.properties["preview"] = preview_prop;
+	return params;
+}
+
+// optional "quality" of the edge preserving smoothing, the guided filter is the default for tool calls
+static SmoothQuality GetSmoothQuality(const std::map<std::string, LLMValue>& input_args) {
+	auto it = input_args.find("quality");
+	if (it == input_args.end() || it->second.type != LLMValue::LLM_VALUE_STRING) {
+		return SMOOTH_BALANCED;
+	}
+	return ParseSmoothQuality(it->second.string_value, SMOOTH_BALANCED);
+}
+
+static FunctionParameter SmoothToolParameters() {
+	FunctionParameter params = FilterToolParameters();
+	ParameterProperties quality_prop;
+	quality_prop.type = "string";
+	quality_prop.description = "Optional smoothing quality: 'fast' for previews and large images, "
+		"'balanced' (default) or 'best' for the slow, highest quality bilateral filter";
+	params.properties["quality"] = quality_prop;
+	return params;
+}
+
+// Image Processing Function : Converts a color image to a grayscale image and performs edge detection
+FunctionResult ConvertColorImg2GrayImgTool(std::map<std::string, LLMValue> input_args, Logger* logger) {
+	cv::Mat src;
+	std::string origin;
+	FunctionResult error_result;
+	if (!LoadSrcImage(input_args, src, origin, error_result, logger)) {
+		return error_result;
+	}
+	return FilterImage(input_args, src, origin, "ConvertColorImg2GrayImg", [logger](const cv::Mat& in, cv::Mat& out) {
+		return ConvertColorImg2GrayImg(in, out, logger);
+	}, logger);
+}
+
+ToolDefinition ConvertColorImg2GrayImgFunctionDefinition() {
 	ToolDefinition def;
+	FunctionDefinition fd;
+	fd.name = "convert_color_img_to_gray_img";
+	fd.description = "Convert a color image to a grayscale image and perform edge detection";
+	fd.parameters = FilterToolParameters();
+	def.type = "function";
+	def.function = fd;
+	return def;
+}
 
+// Beauty filter function: make the picture more beatiful, Implements skin smoothing and wrinkle reduction
+FunctionResult ApplyBeautyFilterTool(std::map<std::string, LLMValue> input_args, Logger* logger) {
+	cv::Mat src;
+	std::string origin;
+	FunctionResult error_result;
+	if (!LoadSrcImage(input_args, src, origin, error_result, logger)) {
+		return error_result;
+	}
+	float smoothStrength = 0.4f;
+	SmoothQuality quality = GetSmoothQuality(input_args);
+	return FilterImage(input_args, src, origin, "ApplyBeautyFilter", [smoothStrength, quality, logger](const cv::Mat& in, cv::Mat& out) {
+		return ApplyBeautyFilter(in, out, smoothStrength, logger, quality);
+	}, logger);
+}
+
+ToolDefinition ApplyBeautyFilterFunctionDefinition() {
+	ToolDefinition def;
 	FunctionDefinition fd;
-	FunctionParameter params;
-	params.type = "object";
-	params.required_vec.push_back("src_img");
-	ParameterProperties src_img_prop;
-	src_img_prop.type = "string";
-	src_img_prop.description = "The source image file path";
-	params.properties["src_img"] = src_img_prop;
 	fd.name = "apply_beauty_filter";
 	fd.description = "Apply a beauty filter to an image to make it more beautiful";
-	fd.parameters = params;
+	fd.parameters = SmoothToolParameters();
 	def.type = "function";
 	def.function = fd;
-
 	return def;
 }
 
 // Cartoonify filter function: Applies a cartoon effect to the image
 FunctionResult ApplyCartoonFilterTool(std::map<std::string, LLMValue> input_args, Logger* logger) {
-	auto src_it = input_args.find("src_img");
-	if (src_it == input_args.end()) {
-		LogErrorf(logger, "Missing 'src_img' parameter");
-		FunctionResult error_result;
-		error_result.code = -1;
-		error_result.desc = "Missing 'src_img' parameter";
+	cv::Mat src;
+	std::string origin;
+	FunctionResult error_result;
+	if (!LoadSrcImage(input_args, src, origin, error_result, logger)) {
 		return error_result;
 	}
-	if (src_it->second.type != LLMValue::LLM_VALUE_STRING) {
-		LogErrorf(logger, "Invalid 'src_img' parameter type");
-		FunctionResult error_result;
-		error_result.code = -1;
-		error_result.desc = "Invalid 'src_img' parameter type";
+	SmoothQuality quality = GetSmoothQuality(input_args);
+	return FilterImage(input_args, src, origin, "ApplyCartoonFilter", [quality, logger](const cv::Mat& in, cv::Mat& out) {
+		return ApplyCartoonFilter(in, out, logger, quality);
+	}, logger);
+}
+
+ToolDefinition ApplyCartoonFilterFunctionDefinition() {
+	ToolDefinition def;
+	FunctionDefinition fd;
+	fd.name = "apply_cartoon_filter";
+	fd.description = "Apply a cartoon filter to an image to make it look like a cartoon";
+	fd.parameters = SmoothToolParameters();
+	def.type = "function";
+	def.function = fd;
+	return def;
+}
+
+FunctionResult ApplySunGlassesTool(std::map<std::string, LLMValue> input_args, Logger* logger) {
+	cv::Mat src;
+	std::string origin;
+	FunctionResult error_result;
+	if (!LoadSrcImage(input_args, src, origin, error_result, logger)) {
 		return error_result;
 	}
-	std::string src_url = src_it->second.string_value;
-	std::string src_dir;
-	std::string src_filename;
-	bool ret = GetSrcDirPathAndFilename(src_url, src_dir, src_filename);
-	if (!ret) {
-		LogErrorf(logger, "GetSrcDirPath failed for url: %s", src_url.c_str());
-		FunctionResult error_result;
-		error_result.code = -1;
-		error_result.desc = "GetSrcDirPath failed for 'src_img'";
+	return FilterImage(input_args, src, origin, "ApplySunGlasses", [logger](const cv::Mat& in, cv::Mat& out) {
+		return ApplySunGlasses(in, out, logger);
+	}, logger);
+}
+
+ToolDefinition ApplySunGlassesFunctionDefinition() {
+	ToolDefinition def;
+	FunctionDefinition fd;
+	fd.name = "apply_sun_glasses";
+	fd.description = "Apply sun glasses to a person in the image";
+	fd.parameters = FilterToolParameters();
+	def.type = "function";
+	def.function = fd;
+	return def;
+}
+
+FunctionResult ConvertImage2CyberPunkStyleTool(std::map<std::string, LLMValue> input_args, Logger* logger) {
+	cv::Mat src;
+	std::string origin;
+	FunctionResult error_result;
+	if (!LoadSrcImage(input_args, src, origin, error_result, logger)) {
 		return error_result;
 	}
-	std::string dst_img_url = src_dir + "/output_" + std::to_string(now_millisec() % 100000) + ".jpg";
+	return FilterImage(input_args, src, origin, "ConvertImage2CyberPunkStyle", [logger](const cv::Mat& in, cv::Mat& out) {
+		return ConvertImage2CyberPunkStyle(in, out, logger);
+	}, logger);
+}
 
-	int proc_ret = ApplyCartoonFilter(src_url, dst_img_url, logger);
-	if (proc_ret < 0) {
-		LogErrorf(logger, "ApplyCartoonFilter failed for src: %s", src_filename.c_str());
-		FunctionResult error_result;
-		error_result.code = -1;
-		error_result.desc = "ApplyCartoonFilter failed";
+ToolDefinition ConvertImage2CyberPunkStyleFunctionDefinition() {
+	ToolDefinition def;
+	FunctionDefinition fd;
+	fd.name = "convert_image_to_cyberpunk_style";
+	fd.description = "Convert an image to cyberpunk style";
+	fd.parameters = FilterToolParameters();
+	def.type = "function";
+	def.function = fd;
+	return def;
+}
+
+// Color LUT function: grade an image with a .cube 3D LUT, by catalog name or file path
+FunctionResult ApplyColorLutTool(std::map<std::string, LLMValue> input_args, Logger* logger) {
+	cv::Mat src;
+	std::string origin;
+	FunctionResult error_result;
+	if (!LoadSrcImage(input_args, src, origin, error_result, logger)) {
 		return error_result;
 	}
+
+	auto lut_it = input_args.find("lut");
+	if (lut_it == input_args.end() || lut_it->second.type != LLMValue::LLM_VALUE_STRING) {
+		LogErrorf(logger, "Invalid or missing 'lut' parameter");
+		error_result.desc = "Invalid or missing 'lut' parameter";
+		return error_result;
+	}
+	std::string lut_path = lut_it->second.string_value;
+	std::error_code ec;
+	if (!std::filesystem::is_regular_file(lut_path, ec)) {
+		std::filesystem::path catalog_path = std::filesystem::path(COLOR_LUT_DIR) / lut_path;
+		if (catalog_path.extension() != ".cube") {
+			catalog_path += ".cube";
+		}
+		lut_path = catalog_path.string();
+	}
+
+	ColorLutInterp interp = COLOR_LUT_TETRAHEDRAL;
+	auto interp_it = input_args.find("interpolation");
+	if (interp_it != input_args.end() && interp_it->second.type == LLMValue::LLM_VALUE_STRING
+		&& interp_it->second.string_value == "trilinear") {
+		interp = COLOR_LUT_TRILINEAR;
+	}
+
+	std::string err_msg;
+	std::shared_ptr<const ColorLut> lut = ColorLutCache::Instance().Get(lut_path, err_msg);
+	if (!lut) {
+		LogErrorf(logger, "Load color LUT failed: %s", err_msg.c_str());
+		error_result.desc = err_msg;
+		return error_result;
+	}
+	cv::Mat dst;
+	lut->Apply(src, dst, interp);
+	LogInfof(logger, "Color LUT %s applied, size:%d", lut_path.c_str(), lut->Size());
+	return OutputImage(input_args, dst, origin, logger);
+}
+
+ToolDefinition ApplyColorLutFunctionDefinition() {
+	ToolDefinition def;
+	FunctionDefinition fd;
+
+	// the looks found in the catalog directory at registration
+	std::string catalog;
+	std::error_code ec;
+	for (const auto& entry : std::filesystem::directory_iterator(COLOR_LUT_DIR, ec)) {
+		if (entry.path().extension() == ".cube") {
+			catalog += (catalog.empty() ? "" : ", ") + entry.path().stem().string();
+		}
+	}
+
+	FunctionParameter params = ImageToolParameters();
+	params.required_vec.push_back("lut");
+	ParameterProperties lut_prop;
+	lut_prop.type = "string";
+	lut_prop.description = "Name of a look in the LUT catalog or the path of a .cube file";
+	if (!catalog.empty()) {
+		lut_prop.description += ", catalog: " + catalog;
+	}
+	params.properties["lut"] = lut_prop;
+	ParameterProperties interp_prop;
+	interp_prop.type = "string";
+	interp_prop.description = "Optional interpolation, 'tetrahedral' (default) or 'trilinear'";
+	params.properties["interpolation"] = interp_prop;
+
+	fd.name = "apply_color_lut";
+	fd.description = "Color grade an image with a 3D LUT (.cube film look)";
+	fd.parameters = params;
+	def.type = "function";
+	def.function = fd;
+	return def;
+}
+
+// Save image function: encodes an image handle (or re-encodes a file) to a file
+FunctionResult SaveImageTool(std::map<std::string, LLMValue> input_args, Logger* logger) {
+	cv::Mat src;
+	std::string origin;
+	FunctionResult error_result;
+	if (!LoadSrcImage(input_args, src, origin, error_result, logger)) {
+		return error_result;
+	}
+
+	std::string dst_img_url;
+	auto dst_it = input_args.find("dst_img");
+	if (dst_it != input_args.end() && dst_it->second.type == LLMValue::LLM_VALUE_STRING) {
+		dst_img_url = dst_it->second.string_value;
+	}
+	if (dst_img_url.empty()) {
+		std::string src_dir;
+		std::string src_filename;
+		if (!GetSrcDirPathAndFilename(origin, src_dir, src_filename)) {
+			LogErrorf(logger, "GetSrcDirPath failed for url: %s", origin.c_str());
+			error_result.desc = "GetSrcDirPath failed, give 'dst_img'";
+			return error_result;
+		}
+		dst_img_url = MakeOutputPath(src_dir, ".jpg");
+	}
+	ImageEncodeParams encode_params = GetEncodeParams(input_args);
+	dst_img_url = ApplyImageFormat(dst_img_url, encode_params);
+	std::string err_msg;
+	if (!CheckOutputPath(dst_img_url, err_msg)) {
+		LogErrorf(logger, "%s", err_msg.c_str());
+		error_result.desc = err_msg;
+		return error_result;
+	}
+	ImageWriter::Instance().Write(dst_img_url, src, encode_params);
+	LogInfof(logger, "Image queued for saving to: %s", dst_img_url.c_str());
+
 	FunctionResult result;
 	result.code = 0;
 	result.desc = "Success";
 	result.value.type = LLMValue::LLM_VALUE_STRING;
 	result.value.string_value = dst_img_url;
-
 	return result;
 }
 
-ToolDefinition ApplyCartoonFilterFunctionDefinition() {
+ToolDefinition SaveImageFunctionDefinition() {
 	ToolDefinition def;
 	FunctionDefinition fd;
 	FunctionParameter params;
@@ -256,138 +639,220 @@ ToolDefinition ApplyCartoonFilterFunctionDefinition() {
 	params.required_vec.push_back("src_img");
 	ParameterProperties src_img_prop;
 	src_img_prop.type = "string";
-	src_img_prop.description = "The source image file path";
+	src_img_prop.description = "The img:// handle returned by an image tool";
 	params.properties["src_img"] = src_img_prop;
-	fd.name = "apply_cartoon_filter";
-	fd.description = "Apply a cartoon filter to an image to make it look like a cartoon";
+	ParameterProperties dst_img_prop;
+	dst_img_prop.type = "string";
+	dst_img_prop.description = "Optional destination file path, by default next to the original image";
+	params.properties["dst_img"] = dst_img_prop;
+	AddEncodeParameters(params);
+	fd.name = "save_image";
+	fd.description = "Save an image to a file, call it to give the user the file of the final result";
 	fd.parameters = params;
 	def.type = "function";
 	def.function = fd;
 	return def;
 }
 
-FunctionResult ApplySunGlassesTool(std::map<std::string, LLMValue> input_args, Logger* logger) {
-	auto src_it = input_args.find("src_img");
-	if (src_it == input_args.end()) {
-		LogErrorf(logger, "Missing 'src_img' parameter");
-		FunctionResult error_result;
-		error_result.code = -1;
-		error_result.desc = "Missing 'src_img' parameter";
-		return error_result;
+// filters batch_apply and filter_video can run, by tool argument name
+static bool GetBatchFilter(const std::string& name, SmoothQuality quality, BatchFilterFunc& filter, Logger* logger) {
+	if (name == "gray") {
+		filter = [logger](const cv::Mat& src, cv::Mat& dst) { return ConvertColorImg2GrayImg(src, dst, logger); };
+	} else if (name == "beauty") {
+		filter = [logger, quality](const cv::Mat& src, cv::Mat& dst) { return ApplyBeautyFilter(src, dst, 0.4f, logger, quality); };
+	} else if (name == "cartoon") {
+		filter = [logger, quality](const cv::Mat& src, cv::Mat& dst) { return ApplyCartoonFilter(src, dst, logger, quality); };
+	} else if (name == "sunglasses") {
+		filter = [logger](const cv::Mat& src, cv::Mat& dst) { return ApplySunGlasses(src, dst, logger); };
+	} else if (name == "cyberpunk") {
+		filter = [logger](const cv::Mat& src, cv::Mat& dst) { return ConvertImage2CyberPunkStyle(src, dst, logger); };
+	} else {
+		return false;
 	}
-	if (src_it->second.type != LLMValue::LLM_VALUE_STRING) {
-		LogErrorf(logger, "Invalid 'src_img' parameter type");
-		FunctionResult error_result;
-		error_result.code = -1;
-		error_result.desc = "Invalid 'src_img' parameter type";
+	return true;
+}
+
+// Batch function: applies one filter to every image of a directory or glob
+FunctionResult BatchApplyTool(std::map<std::string, LLMValue> input_args, Logger* logger) {
+	FunctionResult error_result;
+	error_result.code = -1;
+	auto src_it = input_args.find("src");
+	auto filter_it = input_args.find("filter");
+	if (src_it == input_args.end() || src_it->second.type != LLMValue::LLM_VALUE_STRING
+		|| filter_it == input_args.end() || filter_it->second.type != LLMValue::LLM_VALUE_STRING) {
+		LogErrorf(logger, "Invalid or missing 'src' or 'filter' parameter");
+		error_result.desc = "Invalid or missing 'src' or 'filter' parameter";
 		return error_result;
 	}
-	std::string src_url = src_it->second.string_value;
-	std::string src_dir;
-	std::string src_filename;
-	bool ret = GetSrcDirPathAndFilename(src_url, src_dir, src_filename);
-	if (!ret) {
-		LogErrorf(logger, "GetSrcDirPath failed for url: %s", src_url.c_str());
-		FunctionResult error_result;
-		error_result.code = -1;
-		error_result.desc = "GetSrcDirPath failed for 'src_img'";
+	std::string filter_name = filter_it->second.string_value;
+	BatchFilterFunc filter;
+	if (!GetBatchFilter(filter_name, GetSmoothQuality(input_args), filter, logger)) {
+		error_result.desc = "Unknown filter: " + filter_name;
 		return error_result;
 	}
-	std::string dst_img_url = src_dir + "/output_" + std::to_string(now_millisec() % 100000) + ".png";
-	int proc_ret = ApplySunGlasses(src_url, dst_img_url, logger);
-	if (proc_ret < 0) {
-		LogErrorf(logger, "ApplySunGlasses failed for src: %s", src_filename.c_str());
-		FunctionResult error_result;
-		error_result.code = -1;
-		error_result.desc = "ApplySunGlasses failed";
+	std::string output_dir;
+	auto output_it = input_args.find("output_dir");
+	if (output_it != input_args.end() && output_it->second.type == LLMValue::LLM_VALUE_STRING) {
+		output_dir = output_it->second.string_value;
+	}
+
+	std::vector<std::string> files;
+	std::string err_msg;
+	if (!ListBatchFiles(src_it->second.string_value, files, err_msg)) {
+		LogErrorf(logger, "batch_apply: %s", err_msg.c_str());
+		error_result.desc = err_msg;
 		return error_result;
 	}
+
+	BatchSummary summary;
+	RunBatch(files, output_dir, filter_name, filter, BatchOptions(), summary, logger);
+
+	json summary_json;
+	summary_json["total"] = summary.total;
+	summary_json["succeeded"] = summary.succeeded;
+	summary_json["failed"] = summary.total - summary.succeeded;
+	summary_json["elapsed_ms"] = summary.elapsed_ms;
+	if (summary.elapsed_ms > 0) {
+		summary_json["images_per_sec"] = summary.succeeded * 1000.0 / summary.elapsed_ms;
+	}
+	json outputs = json::array();
+	for (const auto& output : summary.outputs) {
+		if (!output.empty()) {
+			outputs.push_back(output);
+		}
+	}
+	summary_json["outputs"] = outputs;
+	summary_json["errors"] = summary.errors;
+
 	FunctionResult result;
-	result.code = 0;
-	result.desc = "Success";
+	result.code = summary.succeeded > 0 ? 0 : -1;
+	result.desc = summary.succeeded == summary.total ? "Success" : "Some images failed";
 	result.value.type = LLMValue::LLM_VALUE_STRING;
-	result.value.string_value = dst_img_url;
+	result.value.string_value = summary_json.dump();
 	return result;
 }
 
-ToolDefinition ApplySunGlassesFunctionDefinition() {
+ToolDefinition BatchApplyFunctionDefinition() {
 	ToolDefinition def;
 	FunctionDefinition fd;
 	FunctionParameter params;
 	params.type = "object";
-	params.required_vec.push_back("src_img");
-	ParameterProperties src_img_prop;
-	src_img_prop.type = "string";
-	src_img_prop.description = "The source image file path";
-	params.properties["src_img"] = src_img_prop;
-	fd.name = "apply_sun_glasses";
-	fd.description = "Apply sun glasses to a person in the image";
+	params.required_vec.push_back("src");
+	params.required_vec.push_back("filter");
+	ParameterProperties src_prop;
+	src_prop.type = "string";
+	src_prop.description = "A directory of images or a glob of files, e.g. photos/*.jpg";
+	params.properties["src"] = src_prop;
+	ParameterProperties filter_prop;
+	filter_prop.type = "string";
+	filter_prop.description = "The filter to apply: gray, beauty, cartoon, sunglasses or cyberpunk";
+	params.properties["filter"] = filter_prop;
+	ParameterProperties output_dir_prop;
+	output_dir_prop.type = "string";
+	output_dir_prop.description = "Optional directory for the results, by default next to each image as <name>_<filter>";
+	params.properties["output_dir"] = output_dir_prop;
+	ParameterProperties quality_prop;
+	quality_prop.type = "string";
+	quality_prop.description = "Optional smoothing quality of beauty and cartoon: 'fast', 'balanced' (default) or 'best'";
+	params.properties["quality"] = quality_prop;
+
+	fd.name = "batch_apply";
+	fd.description = "Apply one image filter to every image of a folder in a single call, returns a summary";
 	fd.parameters = params;
 	def.type = "function";
 	def.function = fd;
 	return def;
 }
 
-FunctionResult ConvertImage2CyberPunkStyleTool(std::map<std::string, LLMValue> input_args, Logger* logger) {
-	std::string src_url;
-
-	auto src_it = input_args.find("src_img");
-	if (src_it == input_args.end()) {
-		LogErrorf(logger, "Missing 'src_img' parameter");
-		FunctionResult error_result;
-		error_result.code = -1;
-		error_result.desc = "Missing 'src_img' parameter";
+// Video function: applies a per-frame filter to a local video file
+FunctionResult FilterVideoTool(std::map<std::string, LLMValue> input_args, Logger* logger) {
+	FunctionResult error_result;
+	error_result.code = -1;
+	auto src_it = input_args.find("src_video");
+	auto filter_it = input_args.find("filter");
+	if (src_it == input_args.end() || src_it->second.type != LLMValue::LLM_VALUE_STRING
+		|| filter_it == input_args.end() || filter_it->second.type != LLMValue::LLM_VALUE_STRING) {
+		LogErrorf(logger, "Invalid or missing 'src_video' or 'filter' parameter");
+		error_result.desc = "Invalid or missing 'src_video' or 'filter' parameter";
 		return error_result;
 	}
-	if (src_it->second.type != LLMValue::LLM_VALUE_STRING) {
-		LogErrorf(logger, "Invalid 'src_img' parameter type");
-		FunctionResult error_result;
-		error_result.code = -1;
-		error_result.desc = "Invalid 'src_img' parameter type";
+	std::string src_video = src_it->second.string_value;
+	std::string filter_name = filter_it->second.string_value;
+	BatchFilterFunc filter;
+	if (!GetBatchFilter(filter_name, GetSmoothQuality(input_args), filter, logger)) {
+		error_result.desc = "Unknown filter: " + filter_name;
 		return error_result;
 	}
-	src_url = src_it->second.string_value;
-	std::string src_dir;
-	std::string src_filename;
-	bool ret = GetSrcDirPathAndFilename(src_url, src_dir, src_filename);
-	if (!ret) {
-		LogErrorf(logger, "GetSrcDirPath failed for url: %s", src_url.c_str());
-		FunctionResult error_result;
-		error_result.code = -1;
-		error_result.desc = "GetSrcDirPath failed for 'src_img'";
-		return error_result;
+
+	std::string output_path;
+	auto output_it = input_args.find("output");
+	if (output_it != input_args.end() && output_it->second.type == LLMValue::LLM_VALUE_STRING) {
+		output_path = output_it->second.string_value;
 	}
-	std::string dst_img_url = src_dir + "/output_" + std::to_string(now_millisec() % 100000) + ".jpg";
-	int proc_ret = ConvertImage2CyberPunkStyle(src_url, dst_img_url, logger);
-	if (proc_ret < 0) {
-		LogErrorf(logger, "ConvertImage2CyberPunkStyle failed for src: %s", src_filename.c_str());
-		FunctionResult error_result;
-		error_result.code = -1;
-		error_result.desc = "ConvertImage2CyberPunkStyle failed";
+	if (output_path.empty()) {
+		std::string src_dir;
+		std::string src_filename;
+		if (!GetSrcDirPathAndFilename(src_video, src_dir, src_filename)) {
+			LogErrorf(logger, "GetSrcDirPath failed for url: %s", src_video.c_str());
+			error_result.desc = "GetSrcDirPath failed, give 'output'";
+			return error_result;
+		}
+		output_path = MakeOutputPath(src_dir, ".mp4");
+	}
+
+	VideoFilterSummary summary;
+	std::string err_msg;
+	if (FilterVideo(src_video, output_path, filter, VideoFilterOptions(), summary, err_msg, logger) < 0) {
+		LogErrorf(logger, "filter_video failed: %s", err_msg.c_str());
+		error_result.desc = err_msg;
 		return error_result;
 	}
+
+	json summary_json;
+	summary_json["output"] = output_path;
+	summary_json["frames"] = summary.frames;
+	summary_json["failed_frames"] = summary.failed_frames;
+	summary_json["size"] = std::to_string(summary.width) + "x" + std::to_string(summary.height);
+	summary_json["source_fps"] = summary.source_fps;
+	summary_json["achieved_fps"] = summary.achieved_fps;
+	summary_json["elapsed_ms"] = summary.elapsed_ms;
+
 	FunctionResult result;
 	result.code = 0;
 	result.desc = "Success";
 	result.value.type = LLMValue::LLM_VALUE_STRING;
-	result.value.string_value = dst_img_url;
+	result.value.string_value = summary_json.dump();
 	return result;
 }
 
-ToolDefinition ConvertImage2CyberPunkStyleFunctionDefinition() {
+ToolDefinition FilterVideoFunctionDefinition() {
 	ToolDefinition def;
 	FunctionDefinition fd;
 	FunctionParameter params;
 	params.type = "object";
-	params.required_vec.push_back("src_img");
-	ParameterProperties src_img_prop;
-	src_img_prop.type = "string";
-	src_img_prop.description = "The source image file path";
-	params.properties["src_img"] = src_img_prop;
-	fd.name = "convert_image_to_cyberpunk_style";
-	fd.description = "Convert an image to cyberpunk style";
+	params.required_vec.push_back("src_video");
+	params.required_vec.push_back("filter");
+	ParameterProperties src_prop;
+	src_prop.type = "string";
+	src_prop.description = "The local video file path";
+	params.properties["src_video"] = src_prop;
+	ParameterProperties filter_prop;
+	filter_prop.type = "string";
+	filter_prop.description = "The per-frame filter: gray, cartoon, cyberpunk, beauty or sunglasses";
+	params.properties["filter"] = filter_prop;
+	ParameterProperties output_prop;
+	output_prop.type = "string";
+	output_prop.description = "Optional output video path (.mp4 or .avi), by default next to the source";
+	params.properties["output"] = output_prop;
+	ParameterProperties quality_prop;
+	quality_prop.type = "string";
+	quality_prop.description = "Optional smoothing quality of beauty and cartoon: 'fast', 'balanced' (default) or 'best'";
+	params.properties["quality"] = quality_prop;
+
+	fd.name = "filter_video";
+	fd.description = "Apply an image filter to every frame of a video file, returns the output path and the achieved fps";
 	fd.parameters = params;
 	def.type = "function";
 	def.function = fd;
 	return def;
-}
\ No newline at end of file
+}
@@ -29,5 +29,21 @@ ToolDefinition ApplySunGlassesFunctionDefinition();
 FunctionResult ConvertImage2CyberPunkStyleTool(std::map<std::string, LLMValue>, Logger* logger);
 ToolDefinition ConvertImage2CyberPunkStyleFunctionDefinition();
 
+// Color LUT function: grade an image with a .cube 3D LUT
+FunctionResult ApplyColorLutTool(std::map<std::string, LLMValue>, Logger* logger);
+ToolDefinition ApplyColorLutFunctionDefinition();
+
+// Save image function: write an img:// handle of the image tools to a file
+FunctionResult SaveImageTool(std::map<std::string, LLMValue>, Logger* logger);
+ToolDefinition SaveImageFunctionDefinition();
+
+// Batch function: apply one filter to every image of a directory or glob
+FunctionResult BatchApplyTool(std::map<std::string, LLMValue>, Logger* logger);
+ToolDefinition BatchApplyFunctionDefinition();
+
+// Video function: apply a per-frame filter to a video file
+FunctionResult FilterVideoTool(std::map<std::string, LLMValue>, Logger* logger);
+ToolDefinition FilterVideoFunctionDefinition();
+
 #endif
 
@@ -32,6 +32,7 @@ LLMHttpClient::~LLMHttpClient()
 
 void LLMHttpClient::OnHttpRead(int ret, std::shared_ptr<HttpClientResponse> resp_ptr)
 {
+	request_span_.End();
 	if (ret != 0) {
 		LogErrorf(logger_, "HTTP read error: %d", ret);
 		cb_->OnResponse(ret, "HTTP read error", id_, nullptr);
@@ -48,18 +49,24 @@ void LLMHttpClient::OnHttpRead(int ret, std::shared_ptr<HttpClientResponse> resp
 	std::string resp_str((char*)resp_ptr->data_.Data(), resp_ptr->data_.DataLen());
 
 	try {
-		auto resp_json = json::parse(resp_str);
-		auto chat_resp_ptr = ChatCompletionsResponse::Parse(resp_json);
+		std::shared_ptr<ChatCompletionsResponse> chat_resp_ptr;
+		{
+			TraceScope trace_scope("llm", "llm.parse_response", trace_parent_id_);
+			auto resp_json = json::parse(resp_str);
+			chat_resp_ptr = ChatCompletionsResponse::Parse(resp_json);
+		}
 		if (chat_resp_ptr) {
 			LogInfof(logger_, "Parsed ChatCompletionsResponse: %s", chat_resp_ptr->Dump().c_str());
 			cb_->OnResponse(0, "OK", id_, chat_resp_ptr);
 		}
 		else {
 			LogErrorf(logger_, "Failed to parse ChatCompletionsResponse");
+			cb_->OnResponse(-1, "Failed to parse chat completions response", id_, nullptr);
 		}
 	}
 	catch (const std::exception& e) {
 		LogErrorf(logger_, "JSON parse error: %s", e.what());
+		cb_->OnResponse(-1, "JSON parse error", id_, nullptr);
 	}
 }
 
@@ -67,17 +74,24 @@ int LLMHttpClient::SendPrompt(const std::list<ChatCompletionsMessage>& messages,
 {
 	ChatCompletionsInfo info;
 
+	request_span_.Begin("llm", "llm.chat_completions", trace_parent_id_);
+	http_client_->SetTraceParent(request_span_.Id());
+
 	info.model = model_name_;
 	info.messages = messages;
 	info.tools_definition = tools_definition;
 
-	std::string json_payload = info.DumpJson();
+	std::string json_payload;
+	{
+		TraceScope trace_scope("llm", "llm.serialize_request", request_span_.Id());
+		json_payload = info.DumpJson();
+	}
 	LogInfof(logger_, "Sending JSON Payload: %s", json_payload.c_str());
 
 	std::map<std::string, std::string> headers;
 	headers["Content-Type"] = "application/json";
 	headers["Authorization"] = "Bearer " + api_key_;
-	return http_client_->Post(subpath_, headers, json_payload);
+	return http_client_->Post(subpath_, headers, std::move(json_payload));
 }
 
 void LLMHttpClient::Close() {
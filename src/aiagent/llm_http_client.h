@@ -2,6 +2,7 @@
 #define LLM_HTTP_CLIENT_H
 #include "http_client.hpp"
 #include "utils/logger.hpp"
+#include "utils/trace.hpp"
 #include "llm_info.h"
 #include "llm_tool.h"
 
@@ -33,6 +34,7 @@ public:
 	void Close();
 	std::string GetId() const { return id_; }
 	void SetId(const std::string& id) { id_ = id; }
+	void SetTraceParent(uint64_t parent_id) { trace_parent_id_ = parent_id; }
 
 private:
 	uv_loop_t* loop_ = nullptr;
@@ -49,5 +51,9 @@ private:
 private:
 	std::string id_; // Unique identifier for the request
 	LLMResponseInterface* cb_ = nullptr;
+
+private:
+	uint64_t trace_parent_id_ = 0;
+	TraceSpan request_span_;
 };
 #endif
\ No newline at end of file
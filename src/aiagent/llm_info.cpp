@@ -217,6 +217,56 @@ std::shared_ptr<ChatCompletionsResponse> ChatCompletionsResponse::Parse(json& in
 	return resp_ptr;
 }
 
+LLMValue LLMValue::FromJson(const json& j) {
+	LLMValue val;
+	if (j.is_string()) {
+		val.type = LLM_VALUE_STRING;
+		val.string_value = j.get<std::string>();
+	}
+	else if (j.is_number()) {
+		val.type = LLM_VALUE_NUMBER;
+		val.number_value = j.get<double>();
+	}
+	else if (j.is_boolean()) {
+		val.type = LLM_VALUE_BOOL;
+		val.bool_value = j.get<bool>();
+	}
+	else if (j.is_object()) {
+		val.type = LLM_VALUE_OBJECT;
+		val.object_value = j;
+	}
+	else if (j.is_array()) {
+		val.type = LLM_VALUE_ARRAY;
+		for (const auto& item : j) {
+			val.array_value.push_back(FromJson(item));
+		}
+	}
+	return val;
+}
+
+json LLMValue::ToJson() const {
+	switch (type) {
+	case LLM_VALUE_NUMBER:
+		return number_value;
+	case LLM_VALUE_STRING:
+		return string_value;
+	case LLM_VALUE_BOOL:
+		return bool_value;
+	case LLM_VALUE_OBJECT:
+		return object_value;
+	case LLM_VALUE_ARRAY:
+	{
+		json j = json::array();
+		for (const auto& item : array_value) {
+			j.push_back(item.ToJson());
+		}
+		return j;
+	}
+	default:
+		return nullptr;
+	}
+}
+
 json FunctionParameter::ToJson() const {
 	json j;
 	j["type"] = type;
@@ -226,6 +276,9 @@ json FunctionParameter::ToJson() const {
 		json jprop;
 		jprop["type"] = prop.second.type;
 		jprop["description"] = prop.second.description;
+		if (!prop.second.items.is_null()) {
+			jprop["items"] = prop.second.items;
+		}
 
 		j["properties"][prop.first] = jprop;
 	}
@@ -41,6 +41,10 @@ public:
 public:
 	LLMValue() : type(LLM_VALUE_NULL), number_value(0), bool_value(false) {}
 	~LLMValue() {}
+
+public:
+	static LLMValue FromJson(const json& j);
+	json ToJson() const;
 };
 
 //using һָ LLMFunctionʾһΪһLLMValue󣬷ֵΪһLLMValue
@@ -50,6 +54,7 @@ typedef struct
 {
 	std::string type;
 	std::string description;
+	json items; // element schema of an "array" parameter
 } ParameterProperties;
 
 class FunctionParameter
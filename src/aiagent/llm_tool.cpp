@@ -1,4 +1,5 @@
 #include "llm_tool.h"
+#include "tool_worker_pool.h"
 
 LLMTool::LLMTool(Logger* logger) {
 	logger_ = logger;
@@ -24,4 +25,11 @@ ToolFunction LLMTool::GetTool(const std::string& id) {
 	}
 	LogErrorf(logger_, "Tool with id: %s not found", id.c_str());
 	return nullptr;
-}
\ No newline at end of file
+}
+
+FunctionResult LLMTool::CallTool(const std::string& id, ToolFunction func, const std::map<std::string, LLMValue>& args) {
+	if (ToolWorkerPool::Instance().Handles(id, args)) {
+		return ToolWorkerPool::Instance().Call(id, args);
+	}
+	return func(args, logger_);
+}
@@ -26,6 +26,8 @@ public:
 
 	void AddTool(const std::string& id, ToolFunction func);
 	ToolFunction GetTool(const std::string& id);
+	// run func, in a tool worker process when the pool handles the tool
+	FunctionResult CallTool(const std::string& id, ToolFunction func, const std::map<std::string, LLMValue>& args);
 
 public:
 	void AddToolDefinition(const ToolDefinition& def) {
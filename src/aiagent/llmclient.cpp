@@ -1,7 +1,6 @@
 #include "llmclient.h"
-#include <thread>
+#include "opencv/background_render.h"
 
-bool LLMClient::init_ = false;
 const size_t MAX_RECENT_MESSAGES = 100;
 
 LLMClient::LLMClient(uv_loop_t* loop, const std::string& model_name, const std::string& host, uint16_t port, const std::string& api_key, const std::string& subpath, Logger* logger)
@@ -18,7 +17,12 @@ LLMClient::LLMClient(uv_loop_t* loop, const std::string& model_name, const std::
 
 	uv_async_init(loop_, &async_, &LLMClient::UVAsyncCallback);
 	async_.data = this;
+	uv_async_init(loop_, &task_async_, &LLMClient::UVTaskAsyncCallback);
+	task_async_.data = this;
+	loop_tasks_->async = &task_async_;
 	llm_tool_ptr_.reset(new LLMTool(logger_));
+	tool_pipeline_ptr_.reset(new ToolPipeline(llm_tool_ptr_.get(), logger_));
+	llm_tool_ptr_->AddToolDefinition(ToolPipeline::GetToolDefinition());
 	//LogInfofв
 	LogInfof(logger_, "LLMClient initializing with model: %s, host: %s, port: %d, api_key: %s, subpath: %s",
 		model_name.c_str(), host.c_str(), port, api_key.c_str(), subpath.c_str());
@@ -26,28 +30,16 @@ LLMClient::LLMClient(uv_loop_t* loop, const std::string& model_name, const std::
 
 LLMClient::~LLMClient()
 {
+	StopToolThread();
+	{
+		std::lock_guard<std::mutex> lock(loop_tasks_->mutex);
+		loop_tasks_->async = nullptr;
+		loop_tasks_->tasks.clear();
+	}
 	model_clients_.clear();
 	LogInfof(logger_, "LLMClient destroyed");
 }
 
-void LLMClient::Init(uv_loop_t* loop, Logger* logger)
-{
-	if (init_) {
-		return;
-	}
-	init_ = true;
-
-	std::thread run_uv_loop_thread([loop, logger]() {
-		LogInfof(logger, "Starting UV loop thread");
-		uv_run(loop, UV_RUN_DEFAULT);
-		LogInfof(logger, "UV loop thread exiting");
-		std::cout << "UV loop thread exiting" << std::endl;
-		exit(0);
-		});
-	run_uv_loop_thread.detach();
-	return;
-}
-
 void LLMClient::OnTimer() {
 	while (remove_id_queue_.size() > 0) {
 		std::string id = remove_id_queue_.front();
@@ -60,36 +52,64 @@ void LLMClient::OnTimer() {
 	}
 }
 
-void LLMClient::AddRecentMessage(const ChatCompletionsMessage & message) {
+void LLMClient::AddRecentMessage(const std::string& session_id, const ChatCompletionsMessage & message) {
 	std::lock_guard<std::mutex> lock(mutex_);
-	recent_messages_.push_back(message);
+	std::list<ChatCompletionsMessage>& messages = session_messages_[session_id];
+	messages.push_back(message);
 
-	if (recent_messages_.size() > MAX_RECENT_MESSAGES) {
-		recent_messages_.pop_front();
+	if (messages.size() > MAX_RECENT_MESSAGES) {
+		messages.pop_front();
 	}
 }
 
-std::list<ChatCompletionsMessage>  LLMClient::GetRecentMessages() {
+std::list<ChatCompletionsMessage>  LLMClient::GetRecentMessages(const std::string& session_id) {
 	std::lock_guard<std::mutex> lock(mutex_);
-	return recent_messages_;
+	auto it = session_messages_.find(session_id);
+	if (it == session_messages_.end()) {
+		return std::list<ChatCompletionsMessage>();
+	}
+	return it->second;
+}
+
+void LLMClient::CloseSession(const std::string& session_id) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	session_messages_.erase(session_id);
 }
 
-void LLMClient::SendPrompt(const std::string& id, const std::string& prompt) {
+void LLMClient::SendPrompt(const std::string& id, const std::string& prompt, const std::string& session_id, LLMClientCallbackI* cb) {
 	std::string message = prompt;
 	message += ", response without markdown and without Emoji";
-	AddPromptToQueue(id, message);
+	AddPromptToQueue(PromptInfo{ id, session_id, message, cb });
 	uv_async_send(&async_);
 }
 
-void LLMClient::OnSendPrompt(const std::string& id, const std::string& prompt) {
+void LLMClient::OnSendPrompt(const PromptInfo& prompt_info) {
+	auto deferred_it = deferred_prompts_.find(prompt_info.session_id);
+	if (deferred_it != deferred_prompts_.end()) {
+		LogInfof(logger_, "Prompt id:%s waits for the tool calls of session:%s",
+			prompt_info.id.c_str(), prompt_info.session_id.c_str());
+		deferred_it->second.push_back(prompt_info);
+		return;
+	}
+	const std::string& id = prompt_info.id;
+	RequestContext context;
+	context.session_id = prompt_info.session_id;
+	context.request_id = id;
+	context.cb = prompt_info.cb;
+	context.turn_span = std::make_shared<TraceSpan>();
+	context.turn_span->Begin("agent", "agent.turn");
+	TraceScope trace_scope("agent", "agent.send_prompt", context.turn_span->Id());
+
 	std::shared_ptr<LLMHttpClient> client_ptr = std::make_shared<LLMHttpClient>(loop_, host_, port_,
 		subpath_, model_, api_key_, id, this, logger_);
+	client_ptr->SetTraceParent(context.turn_span->Id());
 
 	model_clients_[id] = client_ptr;
+	request_contexts_[id] = context;
 
-	AddRecentMessage(ChatCompletionsMessage{ "user", prompt });
+	AddRecentMessage(context.session_id, ChatCompletionsMessage{ "user", prompt_info.prompt });
 
-	client_ptr->SendPrompt(GetRecentMessages(), llm_tool_ptr_->GetToolDefinitions());
+	client_ptr->SendPrompt(GetRecentMessages(context.session_id), llm_tool_ptr_->GetToolDefinitions());
 }
 
 void LLMClient::UVAsyncCallback(uv_async_t* handle) {
@@ -100,114 +120,96 @@ void LLMClient::UVAsyncCallback(uv_async_t* handle) {
 }
 
 void LLMClient::OnAsyncCallback() {
-	std::pair<std::string, std::string> prompt_pair = GetPromptFromQueue();
-	if (prompt_pair.first.empty() || prompt_pair.second.empty()) {
-		LogErrorf(logger_, "No prompt in queue");
-		return;
+	// uv_async_send calls may be coalesced into one callback, so drain the whole queue
+	PromptInfo prompt_info;
+	while (GetPromptFromQueue(prompt_info)) {
+		if (prompt_info.id.empty() || prompt_info.prompt.empty()) {
+			LogErrorf(logger_, "Empty prompt in queue, id:%s", prompt_info.id.c_str());
+			continue;
+		}
+		OnSendPrompt(prompt_info);
 	}
-	OnSendPrompt(prompt_pair.first, prompt_pair.second);
 }
 
-void LLMClient::AddPromptToQueue(const std::string& id, const std::string& prompt) {
+void LLMClient::AddPromptToQueue(const PromptInfo& prompt_info) {
 	std::lock_guard<std::mutex> lock(prompt_mutex_);
-	prompt_queue_.emplace_back(id, prompt);
+	prompt_queue_.push_back(prompt_info);
 }
 
-std::pair<std::string, std::string> LLMClient::GetPromptFromQueue() {
+bool LLMClient::GetPromptFromQueue(PromptInfo& prompt_info) {
 	std::lock_guard<std::mutex> lock(prompt_mutex_);
 	if (prompt_queue_.empty()) {
-		return std::make_pair("", "");
+		return false;
 	}
-	auto prompt = prompt_queue_.front();
+	prompt_info = prompt_queue_.front();
 	prompt_queue_.pop_front();
-	return prompt;
+	return true;
 }
 
 void LLMClient::OnResponse(int code, const std::string& err_msg, const std::string& id, std::shared_ptr<ChatCompletionsResponse> resp_ptr) {
 	LogInfof(logger_, "OnResponse called with code: %d, err_msg: %s, id: %s", code, err_msg.c_str(), id.c_str());
 
+	RequestContext context;
+	auto context_it = request_contexts_.find(id);
+	if (context_it != request_contexts_.end()) {
+		context = context_it->second;
+		request_contexts_.erase(context_it);
+	}
+	else {
+		context.request_id = id;
+	}
 	if (resp_ptr) {
 		LogInfof(logger_, "Received response for id: %s, response: %s", id.c_str(), resp_ptr->Dump().c_str());
 		if (resp_ptr->choices.size() > 0) {
 			for (const auto& choice : resp_ptr->choices) {
 				if (choice.message.role == "assistant") {
-					AddRecentMessage(choice.message);
+					AddRecentMessage(context.session_id, choice.message);
+					if (!choice.message.content.empty()) {
+						AgentEvent delta_event;
+						delta_event.type = AGENT_EVENT_DELTA;
+						delta_event.content = choice.message.content;
+						NotifyEvent(context, delta_event);
+					}
 					if (!choice.message.tool_calls.empty()) {
+						std::vector<ToolCallJob> jobs;
 						for (const auto& tool_call : choice.message.tool_calls) {
-							std::string call_id = tool_call.id;
-							std::string func_name = tool_call.function_parameters.name;
-							std::string params_str = tool_call.function_parameters.parameters;
-							ToolFunction func = llm_tool_ptr_->GetTool(func_name);
-							if (func) {
-								std::map<std::string, LLMValue> params_map;
-								if (params_str.size() > 0) {
-									try {
-										auto params_json = json::parse(params_str);
-
-										if (params_json.is_object()) {
-											for (auto it = params_json.begin(); it != params_json.end(); ++it) {
-												//get iter key
-												std::string key = it.key();
-
-												LLMValue val;
-												if (it.value().is_string()) {
-													val.type = LLMValue::LLM_VALUE_STRING;
-													val.string_value = it.value().get<std::string>();
-												}
-												else if (it.value().is_number()) {
-													val.type = LLMValue::LLM_VALUE_NUMBER;
-													val.number_value = it.value().get<double>();
-												}
-												else if (it.value().is_boolean()) {
-													val.type = LLMValue::LLM_VALUE_BOOL;
-													val.bool_value = it.value().get<bool>();
-												}
-												else {
-													val.type = LLMValue::LLM_VALUE_NULL;
-												}
-												params_map.emplace(key, val);
-											}
-										}
-										else {
-											LogErrorf(logger_, "Function parameters is not a JSON object: %s", params_str.c_str());
+							ToolCallJob job;
+							job.call_id = tool_call.id;
+							job.name = tool_call.function_parameters.name;
+							job.params_str = tool_call.function_parameters.parameters;
+							job.is_pipeline = (job.name == TOOL_PIPELINE_NAME);
+							job.func = job.is_pipeline ? nullptr : llm_tool_ptr_->GetTool(job.name);
+
+							if (!job.func && !job.is_pipeline) {
+								LogErrorf(logger_, "No tool function found for name: %s", job.name.c_str());
+								// every tool call needs its tool message, or the next request of the session is rejected
+								job.content = "Error: no tool function found for name " + job.name;
+								jobs.push_back(job);
+								continue;
+							}
+							if (job.params_str.size() > 0) {
+								try {
+									auto params_json = json::parse(job.params_str);
+
+									if (params_json.is_object()) {
+										for (auto it = params_json.begin(); it != params_json.end(); ++it) {
+											job.params.emplace(it.key(), LLMValue::FromJson(it.value()));
 										}
 									}
-									catch (const std::exception& e) {
-										LogErrorf(logger_, "Failed to parse function parameters JSON: %s", e.what());
+									else {
+										LogErrorf(logger_, "Function parameters is not a JSON object: %s", job.params_str.c_str());
 									}
 								}
-
-								FunctionResult func_result = func(params_map, logger_);
-								
-								std::string id = call_id;
-								std::shared_ptr<LLMHttpClient> client_ptr = std::make_shared<LLMHttpClient>(loop_, host_, port_,
-									subpath_, model_, api_key_, id, this, logger_);
-
-								model_clients_[id] = client_ptr;
-
-								ChatCompletionsMessage tool_msg;
-								tool_msg.role = "tool";
-
-								if (func_result.code != 0) {
-									tool_msg.content = "Error: " + func_result.desc;
+								catch (const std::exception& e) {
+									LogErrorf(logger_, "Failed to parse function parameters JSON: %s", e.what());
 								}
-								else
-								{
-									tool_msg.content = func_result.value.string_value;
-									tool_msg.tool_call_id = call_id;
-								}
-
-								AddRecentMessage(tool_msg);
-
-								client_ptr->SendPrompt(GetRecentMessages(), llm_tool_ptr_->GetToolDefinitions());
-							}
-							else {
-								LogErrorf(logger_, "No tool function found for name: %s", func_name.c_str());
 							}
+							jobs.push_back(job);
 						}
+						StartToolCalls(context, std::move(jobs));
 					}
 					else {
-						InsertRespQueue(code, err_msg, id, resp_ptr);
+						NotifyResponse(context, code, err_msg, resp_ptr);
 					}
 					break;
 				}
@@ -215,15 +217,213 @@ void LLMClient::OnResponse(int code, const std::string& err_msg, const std::stri
 		}
 		else {
 			LogErrorf(logger_, "Response choices are empty for id: %s", id.c_str());
+			NotifyResponse(context, -1, "response choices are empty", nullptr);
 		}
 	}
 	else {
 		LogErrorf(logger_, "Received null response for id: %s", id.c_str());
+		NotifyResponse(context, code != 0 ? code : -1, err_msg, nullptr);
 	}
 
 	remove_id_queue_.push(id);
 }
 
+void LLMClient::StartToolCalls(const RequestContext& context, std::vector<ToolCallJob> jobs) {
+	bool runnable = false;
+	for (const auto& job : jobs) {
+		runnable = runnable || job.func || job.is_pipeline;
+	}
+	if (!runnable) {
+		OnToolCallsDone(context, jobs);
+		return;
+	}
+	deferred_prompts_.emplace(context.session_id, std::list<PromptInfo>());
+	PostTool([this, context, jobs]() mutable {
+		RunToolCalls(context, jobs);
+	});
+}
+
+void LLMClient::RunToolCalls(const RequestContext& context, std::vector<ToolCallJob>& jobs) {
+	uint64_t turn_span_id = context.turn_span ? context.turn_span->Id() : 0;
+
+	for (auto& job : jobs) {
+		if (!job.func && !job.is_pipeline) {
+			continue;
+		}
+		AgentEvent tool_event;
+		tool_event.type = AGENT_EVENT_TOOL_START;
+		tool_event.name = job.name;
+		tool_event.content = job.params_str;
+		PostLoop([this, context, tool_event]() mutable {
+			NotifyEvent(context, tool_event);
+		});
+
+		// the full render behind a preview ends after the turn, it is reported to the session
+		if (context.cb) {
+			std::shared_ptr<LoopTaskQueue> loop_tasks = loop_tasks_;
+			BackgroundRender::SetThreadListener([this, loop_tasks, context](const RenderResult& render_result) {
+				AgentEvent render_event;
+				render_event.type = AGENT_EVENT_RENDER_DONE;
+				render_event.name = render_result.job_id;
+				render_event.code = render_result.code;
+				render_event.content = render_result.desc + ": " + render_result.path;
+				PostLoop(loop_tasks, [this, context, render_event]() mutable {
+					NotifyEvent(context, render_event);
+				});
+			});
+		}
+		FunctionResult func_result;
+		try {
+			TraceScope trace_scope("tool", job.name.c_str(), turn_span_id);
+			func_result = job.is_pipeline ? tool_pipeline_ptr_->Run(job.params) : llm_tool_ptr_->CallTool(job.name, job.func, job.params);
+		}
+		catch (const std::exception& e) {
+			LogErrorf(logger_, "Tool %s exception: %s", job.name.c_str(), e.what());
+			func_result.code = -1;
+			func_result.desc = std::string("tool exception: ") + e.what();
+		}
+		BackgroundRender::SetThreadListener(nullptr);
+
+		tool_event.type = AGENT_EVENT_TOOL_RESULT;
+		tool_event.code = func_result.code;
+		tool_event.content = func_result.code != 0 ? func_result.desc : func_result.value.string_value;
+		PostLoop([this, context, tool_event]() mutable {
+			NotifyEvent(context, tool_event);
+		});
+
+		job.content = func_result.code != 0 ? "Error: " + func_result.desc : func_result.value.string_value;
+	}
+	PostLoop([this, context, jobs]() {
+		OnToolCallsDone(context, jobs);
+	});
+}
+
+void LLMClient::OnToolCallsDone(const RequestContext& context, const std::vector<ToolCallJob>& jobs) {
+	std::string last_call_id;
+	for (const auto& job : jobs) {
+		ChatCompletionsMessage tool_msg;
+		tool_msg.role = "tool";
+		tool_msg.tool_call_id = job.call_id;
+		tool_msg.content = job.content;
+		AddRecentMessage(context.session_id, tool_msg);
+		if (job.func || job.is_pipeline) {
+			last_call_id = job.call_id;
+		}
+	}
+
+	// all tool results of the turn go back in one request
+	if (!last_call_id.empty()) {
+		std::string id = last_call_id;
+		std::shared_ptr<LLMHttpClient> client_ptr = std::make_shared<LLMHttpClient>(loop_, host_, port_,
+			subpath_, model_, api_key_, id, this, logger_);
+		client_ptr->SetTraceParent(context.turn_span ? context.turn_span->Id() : 0);
+
+		model_clients_[id] = client_ptr;
+		request_contexts_[id] = context;
+
+		client_ptr->SendPrompt(GetRecentMessages(context.session_id), llm_tool_ptr_->GetToolDefinitions());
+	}
+	else {
+		NotifyResponse(context, -1, "no tool function found", nullptr);
+	}
+
+	auto deferred_it = deferred_prompts_.find(context.session_id);
+	if (deferred_it == deferred_prompts_.end()) {
+		return;
+	}
+	std::list<PromptInfo> prompts;
+	prompts.swap(deferred_it->second);
+	deferred_prompts_.erase(deferred_it);
+	for (const auto& prompt_info : prompts) {
+		OnSendPrompt(prompt_info);
+	}
+}
+
+void LLMClient::PostTool(std::function<void()> task) {
+	std::lock_guard<std::mutex> lock(tool_mutex_);
+	if (!tool_thread_.joinable()) {
+		tool_thread_ = std::thread(&LLMClient::ToolThreadLoop, this);
+	}
+	tool_tasks_.push_back(std::move(task));
+	tool_cond_.notify_one();
+}
+
+void LLMClient::ToolThreadLoop() {
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(tool_mutex_);
+			tool_cond_.wait(lock, [this] { return tool_stop_ || !tool_tasks_.empty(); });
+			if (tool_stop_) {
+				return;
+			}
+			task = std::move(tool_tasks_.front());
+			tool_tasks_.pop_front();
+		}
+		task();
+	}
+}
+
+void LLMClient::StopToolThread() {
+	{
+		std::lock_guard<std::mutex> lock(tool_mutex_);
+		tool_stop_ = true;
+		tool_tasks_.clear();
+	}
+	tool_cond_.notify_all();
+	if (tool_thread_.joinable()) {
+		tool_thread_.join();
+	}
+}
+
+void LLMClient::PostLoop(std::function<void()> task) {
+	PostLoop(loop_tasks_, std::move(task));
+}
+
+void LLMClient::PostLoop(const std::shared_ptr<LoopTaskQueue>& queue, std::function<void()> task) {
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	if (!queue->async) {
+		return;
+	}
+	queue->tasks.push_back(std::move(task));
+	uv_async_send(queue->async);
+}
+
+void LLMClient::UVTaskAsyncCallback(uv_async_t* handle) {
+	LLMClient* client = static_cast<LLMClient*>(handle->data);
+	if (client) {
+		client->RunLoopTasks();
+	}
+}
+
+void LLMClient::RunLoopTasks() {
+	std::list<std::function<void()>> tasks;
+	{
+		std::lock_guard<std::mutex> lock(loop_tasks_->mutex);
+		tasks.swap(loop_tasks_->tasks);
+	}
+	for (auto& task : tasks) {
+		task();
+	}
+}
+
+void LLMClient::NotifyResponse(const RequestContext& context, int code, const std::string& err_msg, std::shared_ptr<ChatCompletionsResponse> resp_ptr) {
+	if (context.cb) {
+		context.cb->OnAgentResponse(code, err_msg, context.request_id, resp_ptr);
+		return;
+	}
+	InsertRespQueue(code, err_msg, context.request_id, resp_ptr);
+}
+
+void LLMClient::NotifyEvent(const RequestContext& context, AgentEvent& event) {
+	if (!context.cb) {
+		return;
+	}
+	event.request_id = context.request_id;
+	event.session_id = context.session_id;
+	context.cb->OnAgentEvent(event);
+}
+
 void LLMClient::InsertRespQueue(int code, const std::string& err_msg, const std::string& id, std::shared_ptr<ChatCompletionsResponse> resp_ptr) {
 	std::lock_guard<std::mutex> lock(resp_mutex_);
 
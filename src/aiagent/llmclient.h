@@ -5,20 +5,82 @@
 #include "llm_http_client.h"
 #include "llm_info.h"
 #include "llm_tool.h"
+#include "tool_pipeline.h"
 #include "utils/logger.hpp"
 #include "utils/timer.hpp"
+#include "utils/trace.hpp"
 #include <stdint.h>
 #include <stddef.h>
 #include <string>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
 
 using namespace cpp_streamer;
 
 // int code, std::string err_msg, std::string id, std::shared_ptr< ChatCompletionsResponse>
 using ResponseTuple = std::tuple<int, std::string, std::string, std::shared_ptr< ChatCompletionsResponse>>;
 
+#define AGENT_EVENT_DELTA       "delta"       // assistant text of one llm round trip
+#define AGENT_EVENT_TOOL_START  "tool_start"
+#define AGENT_EVENT_TOOL_RESULT "tool_result"
+#define AGENT_EVENT_RENDER_DONE "render_done" // the full resolution render behind a preview, after the turn
+
+typedef struct {
+	std::string type;
+	std::string request_id;
+	std::string session_id;
+	std::string name;    // tool name, or the render job id
+	std::string content; // delta text, tool arguments, tool result or render result
+	int code = 0;
+} AgentEvent;
+
+// Progress and final result of a prompt, called on the loop thread.
+// Prompts sent with a callback do not go to the response queue.
+class LLMClientCallbackI
+{
+public:
+	virtual void OnAgentEvent(const AgentEvent& event) = 0;
+	virtual void OnAgentResponse(int code, const std::string& err_msg, const std::string& request_id, std::shared_ptr<ChatCompletionsResponse> resp_ptr) = 0;
+};
+
+typedef struct {
+	std::string id;
+	std::string session_id;
+	std::string prompt;
+	LLMClientCallbackI* cb;
+} PromptInfo;
+
+// state shared by the first request of a prompt and its tool follow-up requests
+typedef struct {
+	std::string session_id;
+	std::string request_id;
+	std::shared_ptr<TraceSpan> turn_span;
+	LLMClientCallbackI* cb = nullptr;
+} RequestContext;
+
+// one tool call of an assistant message
+typedef struct {
+	std::string call_id;
+	std::string name;
+	std::string params_str;
+	std::map<std::string, LLMValue> params;
+	ToolFunction func = nullptr;
+	bool is_pipeline = false;
+	std::string content; // the tool message, set once the tool ran
+} ToolCallJob;
+
+// tasks posted to the loop from other threads; render listeners hold it and
+// may outlive the client, async is nullptr once the client is gone
+typedef struct {
+	std::mutex mutex;
+	std::list<std::function<void()>> tasks;
+	uv_async_t* async = nullptr;
+} LoopTaskQueue;
+
 class LLMClient : public TimerInterface, public LLMResponseInterface
 {
 public:
@@ -26,15 +88,17 @@ public:
 	~LLMClient();
 	
 public:
-	static void Init(uv_loop_t* loop, Logger* logger);
 	static void UVAsyncCallback(uv_async_t* handle);
+	static void UVTaskAsyncCallback(uv_async_t* handle);
 
 public:
 	virtual void OnResponse(int code, const std::string& err_msg, const std::string& id, std::shared_ptr<ChatCompletionsResponse> resp_ptr) override;
 
 public:
-	// Send a prompt to the LLM and receive a response
-	void SendPrompt(const std::string& id, const std::string& prompt);
+	// Send a prompt to the LLM and receive a response.
+	// Prompts with the same session_id share the conversation history.
+	void SendPrompt(const std::string& id, const std::string& prompt, const std::string& session_id = "", LLMClientCallbackI* cb = nullptr);
+	void CloseSession(const std::string& session_id);
 	bool GetRespQueue(ResponseTuple& resp_tuple);
 	void AddFunctionTool(const std::string& name, const ToolDefinition& def, ToolFunction func);
 	const std::vector<ToolDefinition>& GetToolDefinitions() const;
@@ -43,24 +107,36 @@ protected:
 	virtual void OnTimer() override;
 
 private:
-	void AddRecentMessage(const ChatCompletionsMessage& message);
-	std::list<ChatCompletionsMessage> GetRecentMessages();
+	void AddRecentMessage(const std::string& session_id, const ChatCompletionsMessage& message);
+	std::list<ChatCompletionsMessage> GetRecentMessages(const std::string& session_id);
 	void OnAsyncCallback();
-	void AddPromptToQueue(const std::string& id,const std::string& prompt);
-	std::pair<std::string, std::string> GetPromptFromQueue();
-	void OnSendPrompt(const std::string& id, const std::string& prompt);
+	void AddPromptToQueue(const PromptInfo& prompt_info);
+	bool GetPromptFromQueue(PromptInfo& prompt_info);
+	void OnSendPrompt(const PromptInfo& prompt_info);
+
+private:
+	// the tool calls of a turn run on the tool thread, never on the loop;
+	// events and the end of the calls are posted back to the loop
+	void StartToolCalls(const RequestContext& context, std::vector<ToolCallJob> jobs);
+	void RunToolCalls(const RequestContext& context, std::vector<ToolCallJob>& jobs);
+	void OnToolCallsDone(const RequestContext& context, const std::vector<ToolCallJob>& jobs);
+	void PostTool(std::function<void()> task);
+	void PostLoop(std::function<void()> task);
+	static void PostLoop(const std::shared_ptr<LoopTaskQueue>& queue, std::function<void()> task);
+	void RunLoopTasks();
+	void ToolThreadLoop();
+	void StopToolThread();
 
 private:
 	void InsertRespQueue(int code, const std::string& err_msg, const std::string& id, std::shared_ptr<ChatCompletionsResponse>);
+	void NotifyResponse(const RequestContext& context, int code, const std::string& err_msg, std::shared_ptr<ChatCompletionsResponse> resp_ptr);
+	void NotifyEvent(const RequestContext& context, AgentEvent& event);
 
 private:
 	std::mutex mutex_;
 	std::mutex prompt_mutex_;
 	std::mutex resp_mutex_;
 
-private:
-	static bool init_;
-
 private:
 	uv_loop_t* loop_ = nullptr;
 	std::string model_;
@@ -71,16 +147,31 @@ private:
 	Logger* logger_ = nullptr;
 
 private:
-	std::list<std::pair<std::string, std::string>> prompt_queue_;
-	std::map<std::string, std::shared_ptr<LLMHttpClient>> model_clients_; // key: session_id, value: shared_ptr<LLMHttpClient>
-	std::list<ChatCompletionsMessage> recent_messages_;
+	std::list<PromptInfo> prompt_queue_;
+	std::map<std::string, std::shared_ptr<LLMHttpClient>> model_clients_; // key: client id, value: shared_ptr<LLMHttpClient>
+	std::map<std::string, RequestContext> request_contexts_; // key: client id
+	std::map<std::string, std::list<ChatCompletionsMessage>> session_messages_; // key: session_id
 	std::queue<std::string> remove_id_queue_;
 	std::queue<ResponseTuple> response_queue_;
 
 private:
 	std::unique_ptr<LLMTool> llm_tool_ptr_;
+	std::unique_ptr<ToolPipeline> tool_pipeline_ptr_;
 private:
 	uv_async_t async_;
+
+private:
+	uv_async_t task_async_;
+	std::shared_ptr<LoopTaskQueue> loop_tasks_ = std::make_shared<LoopTaskQueue>();
+	// started on the first tool call, after the tool worker pool forked
+	std::thread tool_thread_;
+	std::mutex tool_mutex_;
+	std::condition_variable tool_cond_;
+	std::list<std::function<void()>> tool_tasks_;
+	bool tool_stop_ = false;
+	// sessions with tool calls running, and the prompts they got meanwhile:
+	// the tool messages must follow the assistant message in the history
+	std::map<std::string, std::list<PromptInfo>> deferred_prompts_; // key: session_id
 };
 
 #endif
@@ -0,0 +1,299 @@
+#include "tool_pipeline.h"
+#include "utils/trace.hpp"
+#include "opencv/background_render.h"
+
+#include <thread>
+
+ToolPipeline::ToolPipeline(LLMTool* llm_tool, Logger* logger)
+	: llm_tool_(llm_tool)
+	, logger_(logger)
+{
+}
+
+ToolPipeline::~ToolPipeline()
+{
+}
+
+ToolDefinition ToolPipeline::GetToolDefinition() {
+	ToolDefinition def;
+	FunctionDefinition fd;
+	FunctionParameter params;
+
+	params.type = "object";
+	params.required_vec.push_back("steps");
+
+	ParameterProperties steps_prop;
+	steps_prop.type = "array";
+	steps_prop.description = "The tool calls to run, e.g. [{\"id\":\"a\",\"tool\":\"apply_cartoon_filter\",\"args\":{\"src_img\":\"/tmp/1.jpg\"}},"
+		"{\"id\":\"b\",\"tool\":\"apply_sun_glasses\",\"args\":{\"src_img\":\"$a\"}}]. "
+		"An argument \"$<id>\" is replaced by the output of step <id>. "
+		"Steps which do not depend on each other run in parallel.";
+	steps_prop.items = {
+		{"type", "object"},
+		{"properties", {
+			{"id", {{"type", "string"}, {"description", "Unique step id"}}},
+			{"tool", {{"type", "string"}, {"description", "Name of the tool to call"}}},
+			{"args", {{"type", "object"}, {"description", "Arguments of the tool"}}},
+			{"depends_on", {{"type", "array"}, {"items", {{"type", "string"}}}, {"description", "Extra step ids to wait for"}}}
+		}},
+		{"required", {"id", "tool", "args"}}
+	};
+	params.properties["steps"] = steps_prop;
+
+	fd.name = TOOL_PIPELINE_NAME;
+	fd.description = "Run several tools in one call, passing the output of a step to the following steps. "
+		"Use it when the result of a tool is only needed as the input of another tool.";
+	fd.parameters = params;
+
+	def.type = "function";
+	def.function = fd;
+
+	return def;
+}
+
+FunctionResult ToolPipeline::Run(const std::map<std::string, LLMValue>& input_args) {
+	FunctionResult result;
+	std::vector<PipelineStep> steps;
+	std::map<std::string, size_t> step_index;
+	std::vector<std::vector<size_t>> levels;
+	std::string err_msg;
+
+	if (!ParseSteps(input_args, steps, err_msg) || !SortSteps(steps, step_index, levels, err_msg)) {
+		LogErrorf(logger_, "run_pipeline rejected: %s", err_msg.c_str());
+		result.code = -1;
+		result.desc = err_msg;
+		return result;
+	}
+	LogInfof(logger_, "run_pipeline starts, steps:%zu, levels:%zu", steps.size(), levels.size());
+
+	// called inside the trace scope of the run_pipeline tool call
+	uint64_t trace_parent = Tracer::CurrentSpanId();
+	// and with the render listener of the calling turn, the steps of a level run on threads of their own
+	RenderDoneFunc render_listener = BackgroundRender::GetThreadListener();
+	std::vector<FunctionResult> results(steps.size());
+
+	for (const auto& level : levels) {
+		std::vector<std::thread> threads;
+		for (size_t pos = 1; pos < level.size(); pos++) {
+			const PipelineStep& step = steps[level[pos]];
+			threads.emplace_back([this, &step, &step_index, &results, trace_parent, render_listener]() {
+				BackgroundRender::SetThreadListener(render_listener);
+				RunStep(step, step_index, results, trace_parent);
+				});
+		}
+		RunStep(steps[level[0]], step_index, results, trace_parent);
+		for (auto& thread : threads) {
+			thread.join();
+		}
+	}
+
+	json result_json;
+	result_json["steps"] = json::array();
+	bool all_done = true;
+	for (size_t index = 0; index < steps.size(); index++) {
+		json step_json;
+		step_json["id"] = steps[index].id;
+		step_json["tool"] = steps[index].tool;
+		step_json["code"] = results[index].code;
+		if (results[index].code == 0) {
+			step_json["output"] = results[index].value.ToJson();
+		} else {
+			step_json["error"] = results[index].desc;
+			all_done = false;
+		}
+		result_json["steps"].push_back(step_json);
+	}
+	// the last step of the last level is the final output of a chain
+	const FunctionResult& last_result = results[levels.back().back()];
+	if (last_result.code == 0) {
+		result_json["output"] = last_result.value.ToJson();
+	}
+	LogInfof(logger_, "run_pipeline done, result:%s", result_json.dump().c_str());
+
+	if (!all_done) {
+		result.code = -1;
+		result.desc = result_json.dump();
+		return result;
+	}
+	result.code = 0;
+	result.desc = "Success";
+	result.value.type = LLMValue::LLM_VALUE_STRING;
+	result.value.string_value = result_json.dump();
+	return result;
+}
+
+bool ToolPipeline::ParseSteps(const std::map<std::string, LLMValue>& input_args, std::vector<PipelineStep>& steps, std::string& err_msg) {
+	auto steps_it = input_args.find("steps");
+	if (steps_it == input_args.end()) {
+		err_msg = "Missing 'steps' parameter";
+		return false;
+	}
+	json steps_json;
+	if (steps_it->second.type == LLMValue::LLM_VALUE_STRING) {
+		// some models send the array json encoded
+		try {
+			steps_json = json::parse(steps_it->second.string_value);
+		}
+		catch (const std::exception& e) {
+			err_msg = std::string("Invalid 'steps' json: ") + e.what();
+			return false;
+		}
+	} else {
+		steps_json = steps_it->second.ToJson();
+	}
+	if (!steps_json.is_array() || steps_json.empty()) {
+		err_msg = "'steps' must be a non-empty array";
+		return false;
+	}
+	if (steps_json.size() > TOOL_PIPELINE_MAX_STEPS) {
+		err_msg = "Too many steps, max " + std::to_string(TOOL_PIPELINE_MAX_STEPS);
+		return false;
+	}
+
+	for (const auto& step_json : steps_json) {
+		PipelineStep step;
+		if (!step_json.is_object() || !step_json.contains("tool") || !step_json["tool"].is_string()) {
+			err_msg = "Every step needs a 'tool' name";
+			return false;
+		}
+		step.tool = step_json["tool"].get<std::string>();
+		step.id = "step" + std::to_string(steps.size() + 1);
+		if (step_json.contains("id") && step_json["id"].is_string()) {
+			step.id = step_json["id"].get<std::string>();
+		}
+		if (step.tool == TOOL_PIPELINE_NAME || !llm_tool_->GetTool(step.tool)) {
+			err_msg = "Step " + step.id + ": unknown tool " + step.tool;
+			return false;
+		}
+		step.args = json::object();
+		if (step_json.contains("args") && step_json["args"].is_object()) {
+			step.args = step_json["args"];
+		}
+		if (step_json.contains("depends_on") && step_json["depends_on"].is_array()) {
+			for (const auto& dep : step_json["depends_on"]) {
+				if (dep.is_string()) {
+					step.depends_on.push_back(dep.get<std::string>());
+				}
+			}
+		}
+		for (const auto& prev : steps) {
+			if (prev.id == step.id) {
+				err_msg = "Duplicate step id " + step.id;
+				return false;
+			}
+		}
+		steps.push_back(step);
+	}
+	return true;
+}
+
+bool ToolPipeline::SortSteps(std::vector<PipelineStep>& steps, std::map<std::string, size_t>& step_index,
+	std::vector<std::vector<size_t>>& levels, std::string& err_msg) {
+	for (size_t index = 0; index < steps.size(); index++) {
+		step_index[steps[index].id] = index;
+	}
+	for (auto& step : steps) {
+		for (auto it = step.args.begin(); it != step.args.end(); ++it) {
+			if (!it.value().is_string()) {
+				continue;
+			}
+			std::string value = it.value().get<std::string>();
+			if (value.length() > 1 && value[0] == '$' && step_index.find(value.substr(1)) != step_index.end()) {
+				step.depends_on.push_back(value.substr(1));
+			}
+		}
+		for (const auto& dep : step.depends_on) {
+			if (step_index.find(dep) == step_index.end()) {
+				err_msg = "Step " + step.id + " depends on unknown step " + dep;
+				return false;
+			}
+		}
+	}
+
+	// level = 1 + the highest level of the dependencies, at most steps.size() passes without a cycle
+	std::vector<bool> placed(steps.size(), false);
+	size_t placed_count = 0;
+	int level = 0;
+	while (placed_count < steps.size()) {
+		std::vector<size_t> ready;
+		for (size_t index = 0; index < steps.size(); index++) {
+			if (placed[index]) {
+				continue;
+			}
+			bool deps_placed = true;
+			for (const auto& dep : steps[index].depends_on) {
+				if (!placed[step_index.at(dep)]) {
+					deps_placed = false;
+					break;
+				}
+			}
+			if (deps_placed) {
+				ready.push_back(index);
+			}
+		}
+		if (ready.empty()) {
+			err_msg = "The steps have a dependency cycle";
+			return false;
+		}
+		for (size_t index : ready) {
+			placed[index] = true;
+			steps[index].level = level;
+		}
+		placed_count += ready.size();
+		levels.push_back(ready);
+		level++;
+	}
+	return true;
+}
+
+void ToolPipeline::RunStep(const PipelineStep& step, const std::map<std::string, size_t>& step_index,
+	std::vector<FunctionResult>& results, uint64_t trace_parent) {
+	// steps of one level write to different slots, the slots they read were written by earlier levels
+	FunctionResult& result = results[step_index.at(step.id)];
+
+	for (const auto& dep : step.depends_on) {
+		const FunctionResult& dep_result = results[step_index.at(dep)];
+		if (dep_result.code != 0) {
+			result.code = -1;
+			result.desc = "Skipped, step " + dep + " failed";
+			LogWarnf(logger_, "run_pipeline step:%s skipped, step %s failed", step.id.c_str(), dep.c_str());
+			return;
+		}
+	}
+
+	// a step runs on its own thread or unwinds past joinable ones, no exception may leave it
+	try {
+		std::map<std::string, LLMValue> args;
+		for (auto it = step.args.begin(); it != step.args.end(); ++it) {
+			args.emplace(it.key(), ResolveArg(it.value(), step_index, results));
+		}
+
+		ToolFunction func = llm_tool_->GetTool(step.tool);
+		LogInfof(logger_, "run_pipeline step:%s level:%d calls %s, args:%s",
+			step.id.c_str(), step.level, step.tool.c_str(), step.args.dump().c_str());
+		TraceScope trace_scope("tool", step.tool.c_str(), trace_parent);
+		result = llm_tool_->CallTool(step.tool, func, args);
+	}
+	catch (const std::exception& e) {
+		result = FunctionResult();
+		result.code = -1;
+		result.desc = std::string("Step exception: ") + e.what();
+	}
+	if (result.code != 0) {
+		LogErrorf(logger_, "run_pipeline step:%s failed, code:%d, desc:%s", step.id.c_str(), result.code, result.desc.c_str());
+	}
+}
+
+LLMValue ToolPipeline::ResolveArg(const json& arg, const std::map<std::string, size_t>& step_index,
+	const std::vector<FunctionResult>& results) {
+	if (arg.is_string()) {
+		std::string value = arg.get<std::string>();
+		if (value.length() > 1 && value[0] == '$') {
+			auto it = step_index.find(value.substr(1));
+			if (it != step_index.end()) {
+				return results[it->second].value;
+			}
+		}
+	}
+	return LLMValue::FromJson(arg);
+}
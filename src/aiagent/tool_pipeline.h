@@ -0,0 +1,53 @@
+#ifndef TOOL_PIPELINE_H
+#define TOOL_PIPELINE_H
+#include "llm_tool.h"
+#include "llm_info.h"
+#include "utils/logger.hpp"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <map>
+
+using namespace cpp_streamer;
+
+#define TOOL_PIPELINE_NAME       "run_pipeline"
+#define TOOL_PIPELINE_MAX_STEPS  16
+
+typedef struct {
+	std::string id;
+	std::string tool;
+	json args;                           // string values "$<id>" take the output of step <id>
+	std::vector<std::string> depends_on; // explicit and "$<id>" dependencies
+	int level = 0;                       // steps of the same level run in parallel
+} PipelineStep;
+
+// run_pipeline meta tool: the model sends a DAG of tool calls in one tool call,
+// the steps are run locally level by level and one combined result goes back,
+// instead of one llm round trip per tool.
+class ToolPipeline
+{
+public:
+	ToolPipeline(LLMTool* llm_tool, Logger* logger);
+	~ToolPipeline();
+
+public:
+	static ToolDefinition GetToolDefinition();
+	FunctionResult Run(const std::map<std::string, LLMValue>& input_args);
+
+private:
+	bool ParseSteps(const std::map<std::string, LLMValue>& input_args, std::vector<PipelineStep>& steps, std::string& err_msg);
+	bool SortSteps(std::vector<PipelineStep>& steps, std::map<std::string, size_t>& step_index,
+		std::vector<std::vector<size_t>>& levels, std::string& err_msg);
+	void RunStep(const PipelineStep& step, const std::map<std::string, size_t>& step_index,
+		std::vector<FunctionResult>& results, uint64_t trace_parent);
+	LLMValue ResolveArg(const json& arg, const std::map<std::string, size_t>& step_index,
+		const std::vector<FunctionResult>& results);
+
+private:
+	LLMTool* llm_tool_ = nullptr;
+	Logger* logger_ = nullptr;
+};
+
+#endif
@@ -0,0 +1,655 @@
+#include "tool_worker_pool.h"
+#include "warmup.h"
+#include "opencv/image_store.h"
+#include "opencv/image_writer.h"
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <atomic>
+#include <filesystem>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define TOOL_WORKER_MAX_FDS 8 // images passed with one message
+#endif
+
+ToolWorkerPool& ToolWorkerPool::Instance() {
+	static ToolWorkerPool pool;
+	return pool;
+}
+
+ToolWorkerPool::~ToolWorkerPool() {
+	Stop();
+}
+
+void ToolWorkerPool::AddTool(const std::string& name, ToolFunction func, int timeout_ms) {
+	tools_[name] = func;
+	timeouts_[name] = timeout_ms;
+}
+
+bool ToolWorkerPool::Handles(const std::string& name, const std::map<std::string, LLMValue>& args) {
+	if (!IsRunning() || tools_.find(name) == tools_.end()) {
+		return false;
+	}
+	// the full render of a preview is reported by the BackgroundRender of the calling process
+	auto preview_it = args.find("preview");
+	if (preview_it != args.end() && (preview_it->second.bool_value || preview_it->second.string_value == "true")) {
+		return false;
+	}
+	return true;
+}
+
+#ifdef _WIN32
+
+bool ToolWorkerPool::Start(size_t worker_count, Logger* logger) {
+	logger_ = logger;
+	LogInfof(logger_, "tool worker processes are not supported on this platform, tools run in process");
+	return false;
+}
+
+void ToolWorkerPool::Stop() {
+}
+
+FunctionResult ToolWorkerPool::Call(const std::string& name, const std::map<std::string, LLMValue>& args) {
+	return tools_[name](args, logger_);
+}
+
+bool ToolWorkerPool::SpawnWorker(ToolWorker& worker) {
+	return false;
+}
+
+void ToolWorkerPool::RetireWorker(ToolWorker& worker, bool kill_it) {
+}
+
+size_t ToolWorkerPool::AcquireWorker() {
+	return (size_t)-1;
+}
+
+void ToolWorkerPool::ReleaseWorker(size_t index) {
+}
+
+#else
+
+static bool SendAll(int fd, const char* data, size_t len) {
+	while (len > 0) {
+		ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		data += n;
+		len -= n;
+	}
+	return true;
+}
+
+// message: uint32 body length, uint32 fd count, json body; the fds ride on the header
+static bool SendMessage(int fd, const std::string& body, const std::vector<int>& fds) {
+	if (fds.size() > TOOL_WORKER_MAX_FDS) {
+		return false;
+	}
+	uint32_t header[2] = { (uint32_t)body.size(), (uint32_t)fds.size() };
+	struct iovec iov;
+	iov.iov_base = header;
+	iov.iov_len = sizeof(header);
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	char control[CMSG_SPACE(sizeof(int) * TOOL_WORKER_MAX_FDS)];
+	if (!fds.empty()) {
+		memset(control, 0, sizeof(control));
+		msg.msg_control = control;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+		struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+		memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+	}
+	ssize_t n;
+	do {
+		n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+	} while (n < 0 && errno == EINTR);
+	if (n <= 0) {
+		return false;
+	}
+	if ((size_t)n < sizeof(header) && !SendAll(fd, (const char*)header + n, sizeof(header) - n)) {
+		return false;
+	}
+	return SendAll(fd, body.data(), body.size());
+}
+
+// timeout_ms < 0: wait forever
+static bool WaitReadable(int fd, int timeout_ms) {
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	int ret;
+	do {
+		ret = poll(&pfd, 1, timeout_ms);
+	} while (ret < 0 && errno == EINTR);
+	return ret > 0;
+}
+
+static bool RecvAll(int fd, char* data, size_t len, int timeout_ms) {
+	while (len > 0) {
+		if (!WaitReadable(fd, timeout_ms)) {
+			return false;
+		}
+		ssize_t n = recv(fd, data, len, 0);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		data += n;
+		len -= n;
+	}
+	return true;
+}
+
+// return 0 on success, -1 when the peer is gone or the message is bad, -2 on timeout
+static int RecvMessage(int fd, std::string& body, std::vector<int>& fds, int timeout_ms) {
+	if (!WaitReadable(fd, timeout_ms)) {
+		return -2;
+	}
+	uint32_t header[2] = { 0, 0 };
+	struct iovec iov;
+	iov.iov_base = header;
+	iov.iov_len = sizeof(header);
+	char control[CMSG_SPACE(sizeof(int) * TOOL_WORKER_MAX_FDS)];
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	ssize_t n;
+	do {
+		n = recvmsg(fd, &msg, 0);
+	} while (n < 0 && errno == EINTR);
+	if (n <= 0) {
+		return -1;
+	}
+	for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+			size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			int* received = (int*)CMSG_DATA(cmsg);
+			for (size_t i = 0; i < count; i++) {
+				fcntl(received[i], F_SETFD, FD_CLOEXEC);
+				fds.push_back(received[i]);
+			}
+		}
+	}
+	if ((size_t)n < sizeof(header) && !RecvAll(fd, (char*)header + n, sizeof(header) - n, timeout_ms)) {
+		return -1;
+	}
+	if (header[0] > TOOL_WORKER_MAX_MESSAGE || header[1] != fds.size()) {
+		return -1;
+	}
+	body.resize(header[0]);
+	if (header[0] > 0 && !RecvAll(fd, &body[0], header[0], timeout_ms)) {
+		return -1;
+	}
+	return 0;
+}
+
+static void CloseFds(std::vector<int>& fds) {
+	for (int fd : fds) {
+		close(fd);
+	}
+	fds.clear();
+}
+
+// one copy of the pixels into an anonymous shared memory file
+static int ImageToSharedMemory(const cv::Mat& img) {
+	cv::Mat continuous = img.isContinuous() ? img : img.clone();
+	size_t len = continuous.total() * continuous.elemSize();
+	if (len == 0) {
+		return -1;
+	}
+#ifdef __linux__
+	int fd = memfd_create("aiagent_img", MFD_CLOEXEC);
+#else
+	static std::atomic<uint32_t> shm_seq(0);
+	std::string name = "/aiagent_img_" + std::to_string(getpid()) + "_" + std::to_string(shm_seq++);
+	int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd >= 0) {
+		shm_unlink(name.c_str());
+	}
+#endif
+	if (fd < 0) {
+		return -1;
+	}
+	if (ftruncate(fd, (off_t)len) != 0) {
+		close(fd);
+		return -1;
+	}
+	void* addr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+	memcpy(addr, continuous.data, len);
+	munmap(addr, len);
+	return fd;
+}
+
+typedef struct {
+	void* addr = nullptr;
+	size_t len = 0;
+} SharedMapping;
+
+// the Mat points into the mapping (copy on write), valid until munmap
+static bool ImageFromSharedMemory(int fd, const json& meta, cv::Mat& img, SharedMapping& mapping) {
+	int rows = meta.value("rows", 0);
+	int cols = meta.value("cols", 0);
+	int type = meta.value("type", 0);
+	if (rows <= 0 || cols <= 0) {
+		return false;
+	}
+	size_t len = (size_t)rows * cols * CV_ELEM_SIZE(type);
+	void* addr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (addr == MAP_FAILED) {
+		return false;
+	}
+	mapping.addr = addr;
+	mapping.len = len;
+	img = cv::Mat(rows, cols, type, addr);
+	return true;
+}
+
+static json ImageMeta(const cv::Mat& img, const std::string& origin) {
+	json meta;
+	meta["rows"] = img.rows;
+	meta["cols"] = img.cols;
+	meta["type"] = img.type();
+	meta["origin"] = origin;
+	return meta;
+}
+
+// inside the spill directory of the agent process, which the zygote inherited
+static std::string WorkerSpillDir(const std::string& agent_spill_dir, int pid) {
+	return (std::filesystem::path(agent_spill_dir) / ("worker_" + std::to_string(pid))).string();
+}
+
+static void WorkerLoop(int fd, const std::map<std::string, ToolFunction>& tools, Logger* logger) {
+	ImageStore::Instance().SetSpillDir(WorkerSpillDir(ImageStore::Instance().GetSpillDir(), (int)getpid()));
+	// ready before the first job, the workers are spawned at Start
+	std::vector<WarmupStep> steps;
+	Warmup::WarmupImageTools(steps, logger);
+	LogInfof(logger, "tool worker %d started", (int)getpid());
+
+	while (true) {
+		std::string body;
+		std::vector<int> fds;
+		if (RecvMessage(fd, body, fds, -1) < 0) {
+			CloseFds(fds);
+			break;
+		}
+		json response;
+		std::vector<std::string> handles;
+		std::vector<SharedMapping> mappings;
+		FunctionResult result;
+		result.code = -1;
+		try {
+			json request = json::parse(body);
+			std::string name = request.value("tool", "");
+			std::map<std::string, LLMValue> args;
+			if (request.contains("args") && request["args"].is_object()) {
+				for (auto it = request["args"].begin(); it != request["args"].end(); ++it) {
+					args[it.key()] = LLMValue::FromJson(it.value());
+				}
+			}
+			// the images of the caller become handles of this process
+			if (request.contains("images") && request["images"].is_array()) {
+				size_t index = 0;
+				for (const auto& meta : request["images"]) {
+					cv::Mat img;
+					SharedMapping mapping;
+					if (index < fds.size() && ImageFromSharedMemory(fds[index], meta, img, mapping)) {
+						mappings.push_back(mapping);
+						std::string handle = ImageStore::Instance().Put(img, meta.value("origin", ""));
+						handles.push_back(handle);
+						args[meta.value("arg", "")].string_value = handle;
+					}
+					index++;
+				}
+			}
+			auto tool_it = tools.find(name);
+			if (tool_it == tools.end()) {
+				result.desc = "Unknown tool in worker: " + name;
+			} else {
+				result = tool_it->second(args, logger);
+			}
+		}
+		catch (const std::exception& e) {
+			result.code = -1;
+			result.desc = std::string("Tool worker exception: ") + e.what();
+		}
+		CloseFds(fds);
+
+		std::vector<int> out_fds;
+		if (result.code == 0 && result.value.type == LLMValue::LLM_VALUE_STRING) {
+			const std::string& value = result.value.string_value;
+			if (ImageStore::IsHandle(value)) {
+				cv::Mat img;
+				std::string origin;
+				if (ImageStore::Instance().Get(value, img, &origin)) {
+					int shm_fd = ImageToSharedMemory(img);
+					if (shm_fd >= 0) {
+						out_fds.push_back(shm_fd);
+						response["image"] = ImageMeta(img, origin);
+					}
+				}
+				handles.push_back(value);
+			} else {
+				// the caller may open the file right away, and does not see this process' failed writes
+				if (ImageWriter::Instance().WaitPending(value) < 0) {
+					result.code = -1;
+					result.desc = "Failed to save output image: " + value;
+				}
+			}
+		}
+		response["code"] = result.code;
+		response["desc"] = result.desc;
+		response["value"] = result.value.ToJson();
+		bool sent = SendMessage(fd, response.dump(), out_fds);
+		CloseFds(out_fds);
+
+		for (const auto& handle : handles) {
+			ImageStore::Instance().Remove(handle);
+		}
+		for (const auto& mapping : mappings) {
+			munmap(mapping.addr, mapping.len);
+		}
+		if (!sent) {
+			break;
+		}
+	}
+	// _exit follows, no destructor cleans up
+	ImageStore::Instance().RemoveSpillDir();
+	LogInfof(logger, "tool worker %d exiting", (int)getpid());
+}
+
+// a killed worker leaves its spill files behind, they go once it is reaped
+static void ReapWorkers(const std::string& agent_spill_dir, bool wait_all) {
+	while (true) {
+		pid_t pid = waitpid(-1, nullptr, wait_all ? 0 : WNOHANG);
+		if (pid <= 0) {
+			if (pid < 0 && errno == EINTR) {
+				continue;
+			}
+			return;
+		}
+		std::error_code ec;
+		std::filesystem::remove_all(WorkerSpillDir(agent_spill_dir, (int)pid), ec);
+	}
+}
+
+// forked before the agent starts its threads, forks one worker per request
+static void ZygoteLoop(int control_fd, const std::map<std::string, ToolFunction>& tools, Logger* logger) {
+	std::string agent_spill_dir = ImageStore::Instance().GetSpillDir();
+	while (true) {
+		// workers are reaped every second, or before the next spawn
+		ReapWorkers(agent_spill_dir, false);
+		if (!WaitReadable(control_fd, 1000)) {
+			continue;
+		}
+		std::string body;
+		std::vector<int> fds;
+		if (RecvMessage(control_fd, body, fds, -1) < 0) {
+			break;
+		}
+		CloseFds(fds);
+
+		int sv[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+			SendMessage(control_fd, "{\"pid\":0}", {});
+			continue;
+		}
+		pid_t pid = fork();
+		if (pid == 0) {
+			close(control_fd);
+			close(sv[0]);
+			WorkerLoop(sv[1], tools, logger);
+			_exit(0);
+		}
+		close(sv[1]);
+		json reply;
+		reply["pid"] = pid > 0 ? (int)pid : 0;
+		std::vector<int> reply_fds;
+		if (pid > 0) {
+			reply_fds.push_back(sv[0]);
+		}
+		SendMessage(control_fd, reply.dump(), reply_fds);
+		close(sv[0]);
+	}
+	// Stop closed the worker sockets before this one
+	ReapWorkers(agent_spill_dir, true);
+}
+
+bool ToolWorkerPool::Start(size_t worker_count, Logger* logger) {
+	logger_ = logger;
+	if (worker_count == 0 || tools_.empty() || IsRunning()) {
+		return IsRunning();
+	}
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+		LogErrorf(logger_, "tool worker pool socketpair failed, errno:%d", errno);
+		return false;
+	}
+	pid_t pid = fork();
+	if (pid < 0) {
+		LogErrorf(logger_, "tool worker pool fork failed, errno:%d", errno);
+		close(sv[0]);
+		close(sv[1]);
+		return false;
+	}
+	if (pid == 0) {
+		close(sv[0]);
+		ZygoteLoop(sv[1], tools_, logger_);
+		_exit(0);
+	}
+	close(sv[1]);
+	fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+	zygote_fd_ = sv[0];
+	zygote_pid_ = (int)pid;
+	workers_.resize(worker_count);
+	for (auto& worker : workers_) {
+		SpawnWorker(worker);
+	}
+	LogInfof(logger_, "tool worker pool started, zygote pid:%d, workers:%zu, tools:%zu",
+		zygote_pid_, worker_count, tools_.size());
+	return true;
+}
+
+void ToolWorkerPool::Stop() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (auto& worker : workers_) {
+		if (worker.fd >= 0) {
+			RetireWorker(worker, false);
+		}
+	}
+	if (zygote_fd_ >= 0) {
+		close(zygote_fd_);
+		zygote_fd_ = -1;
+		waitpid(zygote_pid_, nullptr, 0);
+		zygote_pid_ = 0;
+	}
+}
+
+bool ToolWorkerPool::SpawnWorker(ToolWorker& worker) {
+	std::lock_guard<std::mutex> lock(zygote_mutex_);
+	if (zygote_fd_ < 0 || !SendMessage(zygote_fd_, "{}", {})) {
+		return false;
+	}
+	std::string body;
+	std::vector<int> fds;
+	if (RecvMessage(zygote_fd_, body, fds, 10 * 1000) < 0 || fds.size() != 1) {
+		CloseFds(fds);
+		LogErrorf(logger_, "tool worker spawn failed");
+		return false;
+	}
+	json reply = json::parse(body, nullptr, false);
+	worker.fd = fds[0];
+	worker.pid = reply.is_object() ? reply.value("pid", 0) : 0;
+	worker.jobs = 0;
+	LogInfof(logger_, "tool worker spawned, pid:%d", worker.pid);
+	return true;
+}
+
+void ToolWorkerPool::RetireWorker(ToolWorker& worker, bool kill_it) {
+	if (kill_it && worker.pid > 0) {
+		kill(worker.pid, SIGKILL);
+	}
+	// the worker exits when it reads the end of its socket
+	if (worker.fd >= 0) {
+		close(worker.fd);
+	}
+	LogInfof(logger_, "tool worker retired, pid:%d, jobs:%d, killed:%d", worker.pid, worker.jobs, kill_it ? 1 : 0);
+	worker.fd = -1;
+	worker.pid = 0;
+	worker.jobs = 0;
+}
+
+size_t ToolWorkerPool::AcquireWorker() {
+	size_t index = 0;
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		cond_.wait(lock, [this] {
+			for (const auto& worker : workers_) {
+				if (!worker.busy) {
+					return true;
+				}
+			}
+			return false;
+		});
+		// a worker with a live process first
+		index = workers_.size();
+		for (size_t i = 0; i < workers_.size(); i++) {
+			if (!workers_[i].busy && (index == workers_.size() || workers_[i].fd >= 0)) {
+				index = i;
+			}
+		}
+		workers_[index].busy = true;
+	}
+	if (workers_[index].fd < 0 && !SpawnWorker(workers_[index])) {
+		ReleaseWorker(index);
+		return (size_t)-1;
+	}
+	return index;
+}
+
+void ToolWorkerPool::ReleaseWorker(size_t index) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	workers_[index].busy = false;
+	cond_.notify_one();
+}
+
+FunctionResult ToolWorkerPool::Call(const std::string& name, const std::map<std::string, LLMValue>& args) {
+	FunctionResult result;
+	result.code = -1;
+
+	// img:// arguments go as shared memory, the worker has its own image store
+	json request;
+	request["tool"] = name;
+	request["args"] = json::object();
+	request["images"] = json::array();
+	std::vector<int> fds;
+	for (const auto& arg : args) {
+		if (arg.second.type == LLMValue::LLM_VALUE_STRING && ImageStore::IsHandle(arg.second.string_value)
+			&& fds.size() < TOOL_WORKER_MAX_FDS) {
+			cv::Mat img;
+			std::string origin;
+			if (!ImageStore::Instance().Get(arg.second.string_value, img, &origin)) {
+				CloseFds(fds);
+				result.desc = "Image handle not found: " + arg.second.string_value;
+				return result;
+			}
+			int shm_fd = ImageToSharedMemory(img);
+			if (shm_fd < 0) {
+				CloseFds(fds);
+				LogWarnf(logger_, "shared memory for %s failed, run %s in process", arg.second.string_value.c_str(), name.c_str());
+				return tools_[name](args, logger_);
+			}
+			json meta = ImageMeta(img, origin);
+			meta["arg"] = arg.first;
+			request["images"].push_back(meta);
+			fds.push_back(shm_fd);
+		}
+		request["args"][arg.first] = arg.second.ToJson();
+	}
+
+	size_t index = AcquireWorker();
+	if (index == (size_t)-1) {
+		CloseFds(fds);
+		LogWarnf(logger_, "no tool worker available, run %s in process", name.c_str());
+		return tools_[name](args, logger_);
+	}
+	ToolWorker& worker = workers_[index];
+	bool sent = SendMessage(worker.fd, request.dump(), fds);
+	CloseFds(fds);
+
+	std::string body;
+	std::vector<int> result_fds;
+	int ret = sent ? RecvMessage(worker.fd, body, result_fds, timeouts_.at(name)) : -1;
+	if (ret < 0) {
+		CloseFds(result_fds);
+		LogErrorf(logger_, "tool %s in worker pid:%d %s", name.c_str(), worker.pid, ret == -2 ? "timed out" : "crashed");
+		result.desc = ret == -2 ? "Tool timed out, its worker process was stopped" : "Tool worker process crashed";
+		RetireWorker(worker, true);
+		ReleaseWorker(index);
+		return result;
+	}
+
+	json response = json::parse(body, nullptr, false);
+	if (response.is_object()) {
+		result.code = response.value("code", -1);
+		result.desc = response.value("desc", "");
+		if (response.contains("value")) {
+			result.value = LLMValue::FromJson(response["value"]);
+		}
+		if (response.contains("image") && result_fds.size() == 1) {
+			cv::Mat img;
+			SharedMapping mapping;
+			if (ImageFromSharedMemory(result_fds[0], response["image"], img, mapping)) {
+				// own memory for the store, the mapping goes away below
+				result.value.type = LLMValue::LLM_VALUE_STRING;
+				result.value.string_value = ImageStore::Instance().Put(img.clone(), response["image"].value("origin", ""));
+				munmap(mapping.addr, mapping.len);
+			} else {
+				result.code = -1;
+				result.desc = "Failed to map the result image of " + name;
+			}
+		}
+	} else {
+		result.desc = "Bad response from tool worker";
+	}
+	CloseFds(result_fds);
+
+	if (++worker.jobs >= TOOL_WORKER_MAX_JOBS) {
+		RetireWorker(worker, false);
+	}
+	ReleaseWorker(index);
+	return result;
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef TOOL_WORKER_POOL_H
+#define TOOL_WORKER_POOL_H
+#include "llm_tool.h"
+#include "llm_info.h"
+#include "utils/logger.hpp"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+
+using namespace cpp_streamer;
+
+#define TOOL_WORKER_MAX_JOBS     200               // a worker process is replaced after this many jobs
+#define TOOL_WORKER_TIMEOUT_MS   (5 * 60 * 1000)   // default: a job running longer gets its worker killed
+#define TOOL_WORKER_NO_TIMEOUT   (-1)              // for long batch and video jobs, only a crash ends them
+#define TOOL_WORKER_MAX_MESSAGE  (16 * 1024 * 1024)
+
+typedef struct {
+	int fd = -1;       // unix socket to the worker
+	int pid = 0;
+	int jobs = 0;
+	bool busy = false;
+} ToolWorker;
+
+// Pool of worker processes that run the heavy tools out of process, so a
+// crash or a runaway input only costs a worker, and the tools get their own
+// cores instead of competing with the loop threads.
+// A zygote process is forked in Start, before any thread exists; the workers
+// are forked from it at Start and again after a retire, they inherit the
+// registered tools and warm up before their first job. Requests and results
+// are json over a unix socket, img:// images travel as shared memory file
+// descriptors (memfd) passed with the message, never encoded.
+// POSIX only: on Windows Start fails and the tools run in process.
+class ToolWorkerPool
+{
+public:
+	static ToolWorkerPool& Instance();
+
+public:
+	// before Start, the zygote inherits the registry
+	void AddTool(const std::string& name, ToolFunction func, int timeout_ms = TOOL_WORKER_TIMEOUT_MS);
+	// call before any thread is started, false: tools run in process
+	bool Start(size_t worker_count, Logger* logger);
+	void Stop();
+	bool IsRunning() const { return zygote_fd_ >= 0; }
+	// the tool is registered, the pool runs and the call can run out of process
+	bool Handles(const std::string& name, const std::map<std::string, LLMValue>& args);
+	// blocks while all workers are busy and until the tool ends, so it is
+	// called on the tool thread of LLMClient, never on a loop thread
+	FunctionResult Call(const std::string& name, const std::map<std::string, LLMValue>& args);
+
+private:
+	ToolWorkerPool() = default;
+	~ToolWorkerPool();
+	bool SpawnWorker(ToolWorker& worker);
+	void RetireWorker(ToolWorker& worker, bool kill_it);
+	size_t AcquireWorker();
+	void ReleaseWorker(size_t index);
+
+private:
+	Logger* logger_ = nullptr;
+	std::map<std::string, ToolFunction> tools_; // key: tool name
+	std::map<std::string, int> timeouts_;       // key: tool name, value: ms or TOOL_WORKER_NO_TIMEOUT
+	int zygote_fd_ = -1;
+	int zygote_pid_ = 0;
+
+	std::mutex mutex_;
+	std::mutex zygote_mutex_;
+	std::condition_variable cond_;
+	std::vector<ToolWorker> workers_;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include "warmup.h"
+#include "ssl_client.hpp"
+#include "dns_resolver.hpp"
+#include "opencv/face_detector.h"
+#include "utils/timeex.hpp"
+
+#include "uv.h"
+#include <opencv2/opencv.hpp>
+#include <functional>
+
+static void RunStep(const std::string& name, const std::function<bool()>& func,
+	std::vector<WarmupStep>& steps, Logger* logger) {
+	WarmupStep step;
+	step.name = name;
+	int64_t start_ms = now_millisec();
+	try {
+		step.code = func() ? 0 : -1;
+	}
+	catch (const std::exception& e) {
+		LogErrorf(logger, "warmup %s exception: %s", name.c_str(), e.what());
+		step.code = -1;
+	}
+	step.elapsed_ms = now_millisec() - start_ms;
+	LogInfof(logger, "warmup %s, code:%d, elapsed:%lldms", name.c_str(), step.code, (long long)step.elapsed_ms);
+	steps.push_back(step);
+}
+
+Warmup& Warmup::Instance() {
+	static Warmup warmup;
+	return warmup;
+}
+
+Warmup::~Warmup() {
+	if (thread_.joinable()) {
+		thread_.join();
+	}
+}
+
+void Warmup::WarmupImageTools(std::vector<WarmupStep>& steps, Logger* logger) {
+	RunStep("face_cascade", [logger]() {
+		return FaceDetector::Instance().Init(FACE_CASCADE_FILE, logger);
+	}, steps, logger);
+
+	// the first parallel_for_ starts the OpenCV worker threads
+	RunStep("opencv_parallel", []() {
+		cv::Mat src(512, 512, CV_8UC3, cv::Scalar(128, 128, 128));
+		cv::Mat dst;
+		cv::GaussianBlur(src, dst, cv::Size(5, 5), 0);
+		cv::parallel_for_(cv::Range(0, cv::getNumThreads() * 4), [&](const cv::Range& range) {
+			for (int i = range.start; i < range.end; i++) {
+				dst.at<cv::Vec3b>(i % dst.rows, 0)[0] ^= 1;
+			}
+		});
+		return !dst.empty();
+	}, steps, logger);
+
+	RunStep("image_codecs", []() {
+		cv::Mat img(64, 64, CV_8UC3, cv::Scalar(0, 128, 255));
+		for (const char* ext : { ".jpg", ".png", ".webp" }) {
+			std::vector<uchar> encoded;
+			if (!cv::imencode(ext, img, encoded) || cv::imdecode(encoded, cv::IMREAD_COLOR).empty()) {
+				return false;
+			}
+		}
+		return true;
+	}, steps, logger);
+}
+
+void Warmup::Start(const std::string& llm_host, Logger* logger) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (started_) {
+		return;
+	}
+	logger_ = logger;
+	started_ = true;
+	thread_ = std::thread(&Warmup::OnWork, this, llm_host);
+}
+
+void Warmup::Wait() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	cond_.wait(lock, [this] { return !started_ || done_; });
+}
+
+bool Warmup::IsDone() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return done_;
+}
+
+std::vector<WarmupStep> Warmup::GetSteps() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return steps_;
+}
+
+int64_t Warmup::GetElapsedMs() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return elapsed_ms_;
+}
+
+void Warmup::OnWork(const std::string& llm_host) {
+	int64_t start_ms = now_millisec();
+	std::vector<WarmupStep> steps;
+
+	WarmupImageTools(steps, logger_);
+
+	RunStep("ssl_context", [this]() {
+		return SslClient::SharedContext(logger_) != nullptr;
+	}, steps, logger_);
+
+	// fills the DnsResolver cache for the first connect, on a loop of its own
+	RunStep("dns_llm_host", [&llm_host]() {
+		uv_loop_t loop;
+		if (uv_loop_init(&loop) != 0) {
+			return false;
+		}
+		int result = -1;
+		DnsResolver::Instance().Resolve(&loop, llm_host,
+			[&result](int status, const std::vector<sockaddr_storage>& addrs) {
+			result = status;
+		});
+		uv_run(&loop, UV_RUN_DEFAULT);
+		uv_loop_close(&loop);
+		return result == 0;
+	}, steps, logger_);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	steps_ = steps;
+	elapsed_ms_ = now_millisec() - start_ms;
+	done_ = true;
+	LogInfof(logger_, "warmup done, steps:%zu, elapsed:%lldms", steps_.size(), (long long)elapsed_ms_);
+	cond_.notify_all();
+}
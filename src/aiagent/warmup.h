@@ -0,0 +1,57 @@
+#ifndef WARMUP_H
+#define WARMUP_H
+#include "utils/logger.hpp"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+using namespace cpp_streamer;
+
+typedef struct {
+	std::string name;
+	int code = 0;          // 0: done, -1: failed, the resource is then set up on first use
+	int64_t elapsed_ms = 0;
+} WarmupStep;
+
+// Startup warm-up of what the first turn would otherwise pay for: the face
+// cascade, the OpenCV thread pool, the image codecs, the client SSL_CTX and
+// the address of the llm host. The steps run on a background thread, every
+// resource still initializes lazily when a request gets there first.
+class Warmup
+{
+public:
+	static Warmup& Instance();
+
+public:
+	// start after the tool worker pool, it forks and needs a process without threads
+	void Start(const std::string& llm_host, Logger* logger);
+	void Wait();
+	bool IsDone();
+	std::vector<WarmupStep> GetSteps();
+	int64_t GetElapsedMs();
+
+public:
+	// the image steps, run synchronously by each tool worker process
+	static void WarmupImageTools(std::vector<WarmupStep>& steps, Logger* logger);
+
+private:
+	Warmup() = default;
+	~Warmup();
+	void OnWork(const std::string& llm_host);
+
+private:
+	Logger* logger_ = nullptr;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::thread thread_;
+	std::vector<WarmupStep> steps_;
+	int64_t elapsed_ms_ = 0;
+	bool started_ = false;
+	bool done_ = false;
+};
+
+#endif
@@ -190,6 +190,14 @@ CoTask<SendResult> CoHttpResponse::Write(const char* data, size_t len, bool cont
     };
 }
 
+void CoHttpResponse::KeepAlive()
+{
+    if (is_close_ || cb_ == nullptr) {
+        return;
+    }
+    cb_->OnResponseAlive();
+}
+
 void CoHttpResponse::Close()
 {
     if (is_close_) {
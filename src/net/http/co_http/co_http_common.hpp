@@ -71,6 +71,8 @@ public:
 public:
     Logger* GetLogger() { return logger_; }
     void Close();
+    // keeps the session from the idle reap while a handler waits before writing
+    void KeepAlive();
 
 private:
     std::shared_ptr<TcpCoAcceptConn> accept_conn_;
@@ -1,6 +1,7 @@
 #include "co_http_server.hpp"
 #include "net/tcp/co_tcp/co_tcp_server/co_tcp_accept_conn.hpp"
 #include "utils/co_pub.hpp"
+#include "utils/stringex.hpp"
 
 namespace cpp_streamer
 {
@@ -44,15 +45,71 @@ void CoHttpServer::OnTimer() {
     }
 }
 
+bool CoHttpServer::IsUriPattern(const std::string& uri) {
+    return uri.find("{") != uri.npos;
+}
+
+CO_HTTP_HANDLE_PTR CoHttpServer::MatchUriPattern(const std::vector<UriPatternHandle>& patterns,
+                                            const std::string& uri,
+                                            std::shared_ptr<CoHttpRequest> request) {
+    std::vector<std::string> segments;
+    StringSplit(uri, "/", segments);
+
+    for (const auto& pattern : patterns) {
+        if (pattern.segments.size() != segments.size()) {
+            continue;
+        }
+        std::map<std::string, std::string> matched;
+        bool match = true;
+        for (size_t index = 0; index < segments.size(); index++) {
+            const std::string& item = pattern.segments[index];
+            if (item.size() > 2 && item.front() == '{' && item.back() == '}') {
+                if (segments[index].empty()) {
+                    match = false;
+                    break;
+                }
+                matched[item.substr(1, item.size() - 2)] = segments[index];
+                continue;
+            }
+            if (item != segments[index]) {
+                match = false;
+                break;
+            }
+        }
+        if (!match) {
+            continue;
+        }
+        for (auto& param : matched) {
+            request->params[param.first] = param.second;
+        }
+        return pattern.handle_func;
+    }
+    return nullptr;
+}
+
 void CoHttpServer::AddGetHandle(const std::string& uri, CO_HTTP_HANDLE_PTR handle_func) {
     std::string get_uri(uri);
     std::string uri_key = GetUri(get_uri);
+    if (IsUriPattern(uri_key)) {
+        UriPatternHandle pattern;
+        StringSplit(uri_key, "/", pattern.segments);
+        pattern.handle_func = handle_func;
+        get_pattern_handles_.push_back(pattern);
+        return;
+    }
     get_handle_map_[uri_key] = handle_func;
 }
 
 void CoHttpServer::AddPostHandle(const std::string& uri, CO_HTTP_HANDLE_PTR handle_func) {
     std::string post_uri(uri);
     std::string uri_key = GetUri(post_uri);
+    if (IsUriPattern(uri_key)) {
+        UriPatternHandle pattern;
+        StringSplit(uri_key, "/", pattern.segments);
+        pattern.handle_func = handle_func;
+        post_pattern_handles_.push_back(pattern);
+        return;
+    }
     post_handle_map_[uri_key] = handle_func;
 }
 
@@ -75,11 +132,19 @@ CO_HTTP_HANDLE_PTR CoHttpServer::GetHandle(std::shared_ptr<CoHttpRequest> reques
         if (it != get_handle_map_.end()) {
             return it->second;
         }
+        CO_HTTP_HANDLE_PTR handle_func = MatchUriPattern(get_pattern_handles_, uri, request);
+        if (handle_func) {
+            return handle_func;
+        }
     } else if (request->method_ == "POST") {
         auto it = post_handle_map_.find(uri);
         if (it != post_handle_map_.end()) {
             return it->second;
         }
+        CO_HTTP_HANDLE_PTR handle_func = MatchUriPattern(post_pattern_handles_, uri, request);
+        if (handle_func) {
+            return handle_func;
+        }
     }
     auto it = get_handle_map_.find("/");
     if (it != get_handle_map_.end()) {
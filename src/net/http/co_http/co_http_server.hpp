@@ -12,6 +12,7 @@
 #include <string>
 #include <uv.h>
 #include <unordered_map>
+#include <vector>
 
 namespace cpp_streamer
 {
@@ -32,9 +33,22 @@ protected:
     virtual void OnTimer() override;
 
 public:
+    // uri may contain "{name}" segments, e.g. "/v1/sessions/{id}/messages",
+    // the matched segments are put into request->params
     void AddGetHandle(const std::string& uri, CO_HTTP_HANDLE_PTR handle_func);
     void AddPostHandle(const std::string& uri, CO_HTTP_HANDLE_PTR handle_func);
 
+private:
+    typedef struct {
+        std::vector<std::string> segments;
+        CO_HTTP_HANDLE_PTR handle_func;
+    } UriPatternHandle;
+
+    static bool IsUriPattern(const std::string& uri);
+    static CO_HTTP_HANDLE_PTR MatchUriPattern(const std::vector<UriPatternHandle>& patterns,
+                                            const std::string& uri,
+                                            std::shared_ptr<CoHttpRequest> request);
+
 private:
     Logger* logger_ = nullptr;
     std::shared_ptr<CoTcpServer> tcp_server_ptr_;
@@ -43,6 +57,8 @@ private:
     std::unordered_map<std::string, std::shared_ptr<CoHttpSession>> http_sessions_;
     std::unordered_map< std::string, CO_HTTP_HANDLE_PTR > get_handle_map_;
     std::unordered_map< std::string, CO_HTTP_HANDLE_PTR > post_handle_map_;
+    std::vector<UriPatternHandle> get_pattern_handles_;
+    std::vector<UriPatternHandle> post_pattern_handles_;
 };
 
 }
@@ -166,7 +166,7 @@ void CoHttpSession::OnResponseClose() {
 }
 
 bool CoHttpSession::IsAlive() const {
-    return now_millisec() - alive_ms_ < 5000 && !is_close_;
+    return now_millisec() - alive_ms_ < CO_HTTP_SESSION_IDLE_MS && !is_close_;
 }
 
 } // namespace cpp_streamer
\ No newline at end of file
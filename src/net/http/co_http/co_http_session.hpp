@@ -12,6 +12,8 @@
 
 #include <memory>
 
+#define CO_HTTP_SESSION_IDLE_MS 5000 // a session without receive or send activity for longer is closed
+
 namespace cpp_streamer
 {
 class CoHttpSession : public HttpResponseCallbackI
@@ -1,11 +1,8 @@
 #include "http_client.hpp"
 #include "utils/logger.hpp"
-#include "utils/stringex.hpp"
 
 #include <string>
-#include <sstream>
 #include <uv.h>
-#include <assert.h>
 
 namespace cpp_streamer
 {
@@ -17,6 +14,7 @@ HttpClient::HttpClient(uv_loop_t* loop,
                        Logger* logger,
                        bool ssl_enable): host_(host)
                                          , port_(port)
+                                         , parser_(this)
                                          , cb_(cb)
                                          , logger_(logger)
 {
@@ -37,20 +35,30 @@ int HttpClient::Get(const std::string& subpath, const std::map<std::string, std:
     subpath_ = subpath;
     headers_ = headers;
 
+    request_span_.Begin("http", "http.get", trace_parent_id_);
+    client_->SetTraceParent(request_span_.Id());
+
     LogInfof(logger_, "http get connect host:%s, port:%d, subpath:%s", host_.c_str(), port_, subpath.c_str());
     client_->Connect(host_, port_);
     return 0;
 }
 
 int HttpClient::Post(const std::string& subpath, const std::map<std::string, std::string>& headers, const std::string& data) {
+    return Post(subpath, headers, std::string(data));
+}
+
+int HttpClient::Post(const std::string& subpath, const std::map<std::string, std::string>& headers, std::string&& data) {
     method_    = HTTP_POST;
     subpath_   = subpath;
-    post_data_ = data;
+    post_data_ = std::move(data);
     headers_   = headers;
 
-    client_->Connect(host_, port_);
+    request_span_.Begin("http", "http.post", trace_parent_id_);
+    client_->SetTraceParent(request_span_.Id());
+
     LogInfof(logger_, "http post connect host:%s, port:%d, subpath:%s, post data:%s", 
-            host_.c_str(), port_, subpath.c_str(), data.c_str());
+            host_.c_str(), port_, subpath.c_str(), post_data_.c_str());
+    client_->Connect(host_, port_);
     return 0;
 }
 
@@ -63,37 +71,65 @@ TcpClient* HttpClient::GetTcpClient() {
     return client_;
 }
 
+void HttpClient::SetTraceParent(uint64_t parent_id) {
+    trace_parent_id_ = parent_id;
+}
+
+void HttpClient::PauseRead() {
+    read_paused_ = true;
+    client_->StopRead();
+}
+
+void HttpClient::ResumeRead() {
+    if (!read_paused_) {
+        return;
+    }
+    read_paused_ = false;
+    client_->AsyncRead();
+}
+
 void HttpClient::OnConnect(int ret_code) {
     if (ret_code < 0) {
         LogErrorf(logger_, "http client OnConnect error:%d", ret_code);
         std::shared_ptr<HttpClientResponse> resp_ptr;
+        request_span_.End();
         cb_->OnHttpRead(ret_code, resp_ptr);
         return;
     }
-    std::stringstream http_stream;
-
     LogInfof(logger_, "on connect code:%d", ret_code);
+    resp_ptr_.reset();
+
+    // sized once up front; the body is not appended, it goes out as a second buffer
+    size_t header_size = subpath_.size() + host_.size() + 96;
+    for (auto& header : headers_) {
+        header_size += header.first.size() + header.second.size() + 4;
+    }
+    std::string http_header;
+    http_header.reserve(header_size);
     if (method_ == HTTP_GET) {
-        http_stream << "GET " << subpath_ << " HTTP/1.1\r\n";
+        http_header.append("GET ");
     } else if (method_ == HTTP_POST) {
-        http_stream << "POST " << subpath_ << " HTTP/1.1\r\n";
+        http_header.append("POST ");
     } else {
         CSM_THROW_ERROR("unkown http method:%d", method_);
     }
-    http_stream << "Accept: */*\r\n";
-    http_stream << "Host: " << host_ << "\r\n";
+    http_header.append(subpath_).append(" HTTP/1.1\r\n");
+    http_header.append("Accept: */*\r\n");
+    http_header.append("Host: ").append(host_).append("\r\n");
     for (auto& header : headers_) {
-        http_stream << header.first << ": " << header.second << "\r\n";
+        http_header.append(header.first).append(": ").append(header.second).append("\r\n");
     }
     if (method_ == HTTP_POST) {
-        http_stream << "Content-Length: " << post_data_.length() << "\r\n";
+        http_header.append("Content-Length: ").append(std::to_string(post_data_.length())).append("\r\n");
     }
-    http_stream << "\r\n";
+    http_header.append("\r\n");
+    LogInfof(logger_, "http request header:%s, body length:%zu", http_header.c_str(), post_data_.length());
+
+    std::string body;
     if (method_ == HTTP_POST) {
-        http_stream << post_data_;
+        body = std::move(post_data_);
     }
-    LogInfof(logger_, "http post:%s", http_stream.str().c_str());
-    client_->Send(http_stream.str().c_str(), http_stream.str().length());
+    client_->SendBuffers(std::move(http_header), std::move(body));
 }
 
 void HttpClient::OnWrite(int ret_code, size_t sent_size) {
@@ -103,148 +139,107 @@ void HttpClient::OnWrite(int ret_code, size_t sent_size) {
 }
 
 void HttpClient::OnRead(int ret_code, const char* data, size_t data_size) {
-    uint8_t* content_p = nullptr;
-	size_t content_len = 0;
-
+    if (resp_ptr_ && parser_.IsDone()) {
+        // the response was reported, a late read or the close of the connection is not
+        return;
+    }
+    if (ret_code == UV_EOF && resp_ptr_ && parser_.GetStatusCode() != 101
+        && parser_.IsBodyUntilClose() && parser_.OnEof()) {
+        // a body without a length ends with the connection
+        client_->StopRead();
+        resp_ptr_->body_ready_ = true;
+        request_span_.End();
+        cb_->OnHttpRead(0, resp_ptr_);
+        return;
+    }
     if (ret_code < 0) {
         LogErrorf(logger_, "http client OnRead error:%d, err name:%s, err msg:%s", ret_code, uv_err_name(ret_code), uv_strerror(ret_code));
+        request_span_.End();
         cb_->OnHttpRead(ret_code, resp_ptr_);
         return;
     }
-	LogInfof(logger_, "http onread:%s", std::string(data, data_size).c_str());
+    if (body_streaming_) {
+        LogDebugf(logger_, "http onread len:%zu", data_size);
+    } else {
+        LogInfof(logger_, "http onread:%.*s", (int)data_size, data);
+    }
     if (data_size == 0) {
+        request_span_.End();
         cb_->OnHttpRead(-2, resp_ptr_);
         return;
     }
 
     if (!resp_ptr_) {
         resp_ptr_ = std::make_shared<HttpClientResponse>();
+        parser_.Reset();
     }
 
-    if (!resp_ptr_->header_ready_) {
-		header_buffer_.AppendData(data, data_size);
-
-        std::string header_str(header_buffer_.Data(), header_buffer_.DataLen());
-        size_t pos = header_str.find("\r\n\r\n");
-        if (pos != std::string::npos) {
-            std::vector<std::string> lines_vec;
-            resp_ptr_->header_ready_ = true;
-            header_str = header_str.substr(0, pos);
-            content_p = (uint8_t*)data + pos + 4;
-			content_len = data_size - (pos + 4);
-
-            StringSplit(header_str, "\r\n", lines_vec);
-            for (size_t i = 0; i < lines_vec.size(); i++) {
-                if (i == 0) {
-                    std::vector<std::string> item_vec;
-                    StringSplit(lines_vec[0], " ", item_vec);
-                    assert(item_vec.size() >= 3);
-
-                    pos = item_vec[0].find("/");
-                    assert(pos != std::string::npos);
-                    resp_ptr_->proto_   = item_vec[0].substr(0, pos);
-                    resp_ptr_->version_ = item_vec[0].substr(pos+1);
-                    resp_ptr_->status_code_ = atoi(item_vec[1].c_str());
-                    if (item_vec.size() == 3) {
-                        resp_ptr_->status_      = item_vec[2];
-                    } else {
-                        std::string status_string("");
-                        for (size_t i = 2; i < item_vec.size(); i++) {
-                            status_string += item_vec[i];
-                        }
-                        resp_ptr_->status_ = status_string;
-                    }
-                    continue;
-                }
-                pos = lines_vec[i].find(":");
-                assert(pos != std::string::npos);
-                std::string key   = lines_vec[i].substr(0, pos);
-                std::string value = lines_vec[i].substr(pos + 2);
-
-                if (key == "Content-Length") {
-                    resp_ptr_->content_length_ = atoi(value.c_str());
-                    LogInfof(logger_, "http content length:%d", resp_ptr_->content_length_);
-                }
-                if (key == "Transfer-Encoding" && value == "chunked") {
-                    resp_ptr_->chunked_ = true;
-                }
-                resp_ptr_->headers_[key] = value;
-                LogInfof(logger_, "header: %s: %s", key.c_str(), value.c_str());
-            }
-            if (!resp_ptr_->chunked_) {
-                resp_ptr_->data_.AppendData((char*)content_p, content_len);
-			}
-        } else {
-            LogInfof(logger_, "header not ready, read more");
-            client_->AsyncRead();
+    const char* p = data;
+    size_t left = data_size;
+    while (left > 0 && !parser_.IsDone()) {
+        int consumed = parser_.Feed(p, left);
+        if (consumed < 0) {
+            LogErrorf(logger_, "http response parse error:%s", parser_.GetError().c_str());
+            request_span_.End();
+            cb_->OnHttpRead(-1, resp_ptr_);
             return;
         }
-    }
-    else {
-        if (!resp_ptr_->chunked_) {
-			resp_ptr_->data_.AppendData(data, data_size);
+        p += consumed;
+        left -= (size_t)consumed;
+        if (parser_.IsBodyUntilClose() && parser_.GetStatusCode() == 101 && !body_streaming_) {
+            // websocket upgrade: the headers, then the data of every read
+            request_span_.End();
+            cb_->OnHttpRead(0, resp_ptr_);
         }
-        else {
-			OnHandleChuckedBody((uint8_t*)data, data_size);
-            return;
+        if (consumed == 0) {
+            break;
         }
     }
-    if (resp_ptr_->chunked_) {
-        OnHandleChuckedBody(content_p, content_len);
-        return;
-	}
-
-    if (resp_ptr_->content_length_ > 0) {
-        LogInfof(logger_, "http receive data len:%lu, content len:%d",
-                resp_ptr_->data_.DataLen(), resp_ptr_->content_length_);
-        if ((int)resp_ptr_->data_.DataLen() >= resp_ptr_->content_length_) {
-            resp_ptr_->body_ready_ = true;
-            cb_->OnHttpRead(0, resp_ptr_);
-        } else {
-            client_->AsyncRead();
+    if (parser_.IsDone()) {
+        if (left > 0) {
+            LogWarnf(logger_, "http response done, %zu bytes after it are dropped", left);
         }
-    } else {
+        client_->StopRead();
+        resp_ptr_->body_ready_ = true;
+        request_span_.End();
         cb_->OnHttpRead(0, resp_ptr_);
+        return;
+    }
+    if (!read_paused_) {
         client_->AsyncRead();
     }
 }
 
-void HttpClient::OnHandleChuckedBody(uint8_t* data, size_t data_len) {
-    if (!resp_ptr_->chunked_) {
-        return;
-    }
-	uint8_t* p = data;
-	int64_t content_len = (int64_t)data_len;
+void HttpClient::OnStatusLine(std::string_view proto, std::string_view version,
+        int status_code, std::string_view status) {
+    resp_ptr_->proto_ = proto;
+    resp_ptr_->version_ = version;
+    resp_ptr_->status_code_ = status_code;
+    resp_ptr_->status_ = status;
+}
 
-    while (true) {
-        std::string body_str((char*)p, content_len);
-        size_t pos = body_str.find("\r\n");
-        if (pos == std::string::npos) {
-            LogInfof(logger_, "chunked body not ready, read more");
-            client_->AsyncRead();
-            return;
-        }
-        std::string chunk_size_str = body_str.substr(0, pos);
-        char* endptr = nullptr;
-        int chunk_size = (int)strtol(chunk_size_str.c_str(), &endptr, 16);
-        // ǷкϷֱ
-        if (endptr == chunk_size_str.c_str() || chunk_size < 0) {
-            break;
-        }
-        if (chunk_size == 0) {
-            resp_ptr_->body_ready_ = true;
-            cb_->OnHttpRead(0, resp_ptr_);
-            return;
-        }
-		p += pos + 2;
-		content_len -= (int64_t)(pos + 2);
+void HttpClient::OnHeader(std::string_view key, std::string_view value) {
+    LogInfof(logger_, "header: %.*s: %.*s", (int)key.size(), key.data(), (int)value.size(), value.data());
+    resp_ptr_->headers_[std::string(key)] = value;
+}
 
-		resp_ptr_->data_.AppendData((char*)p, (size_t)chunk_size);
+void HttpClient::OnHeadersDone() {
+    resp_ptr_->header_ready_ = true;
+    resp_ptr_->chunked_ = parser_.IsChunked();
+    if (parser_.GetContentLength() > 0) {
+        resp_ptr_->content_length_ = (int)parser_.GetContentLength();
+        LogInfof(logger_, "http content length:%d", resp_ptr_->content_length_);
+    }
+    if (body_streaming_) {
+        cb_->OnHttpHeaders(resp_ptr_);
+    }
+}
 
-		std::string content_str(resp_ptr_->data_.Data(), resp_ptr_->data_.DataLen());
-		LogInfof(logger_, "chunked body size:%d, content:%s", chunk_size, content_str.c_str());
-        // resp_ptr_->data_.ConsumeData(chunk_size);
-        // resp_ptr_->data_.ConsumeData(2); //\r\n
-	}
+void HttpClient::OnBody(const char* data, size_t len) {
+    if (body_streaming_) {
+        cb_->OnHttpBody((const uint8_t*)data, len);
+        return;
+    }
+    resp_ptr_->data_.AppendData(data, len);
 }
 }
@@ -4,10 +4,12 @@
 #define WIN32_LEAN_AND_MEAN  //  Windows ɰͷļ winsock.h
 #endif
 #include "http_common.hpp"
+#include "http_response_parser.hpp"
 #include "tcp_client.hpp"
 #include "tcp_pub.hpp"
 #include "data_buffer.hpp"
 #include "logger.hpp"
+#include "trace.hpp"
 #include <string>
 #include <memory>
 #include <map>
@@ -39,10 +41,14 @@ public:
 class HttpClientCallbackI
 {
 public:
+    // the whole response, or the end of a streamed body (data_ is then empty)
     virtual void OnHttpRead(int ret, std::shared_ptr<HttpClientResponse> resp_ptr) = 0;
+    // with SetBodyStreaming: the status and headers, then the body as it is read
+    virtual void OnHttpHeaders(std::shared_ptr<HttpClientResponse> resp_ptr) {}
+    virtual void OnHttpBody(const uint8_t* data, size_t len) {}
 };
 
-class HttpClient : public TcpClientCallback
+class HttpClient : public TcpClientCallback, public HttpResponseParserCallbackI
 {
 public:
     HttpClient(uv_loop_t* loop, const std::string& host, uint16_t port,
@@ -52,8 +58,18 @@ public:
 public:
     int Get(const std::string& subpath, const std::map<std::string, std::string>& headers);
     int Post(const std::string& subpath, const std::map<std::string, std::string>& headers, const std::string& data);
+    // the body is moved in and handed to the write as it is
+    int Post(const std::string& subpath, const std::map<std::string, std::string>& headers, std::string&& data);
     void Close();
     TcpClient* GetTcpClient();
+    void SetTraceParent(uint64_t parent_id);
+    // the body goes to OnHttpBody instead of HttpClientResponse::data_, so it
+    // can be written to disk or parsed with constant memory
+    void SetBodyStreaming(bool enable) { body_streaming_ = enable; }
+    // backpressure for a streaming consumer, the bytes of a read already
+    // received are still delivered after PauseRead
+    void PauseRead();
+    void ResumeRead();
     
 private:
     virtual void OnConnect(int ret_code) override;
@@ -61,19 +77,29 @@ private:
     virtual void OnRead(int ret_code, const char* data, size_t data_size) override;
 
 private:
-	void OnHandleChuckedBody(uint8_t* data, size_t data_len);
+    virtual void OnStatusLine(std::string_view proto, std::string_view version,
+            int status_code, std::string_view status) override;
+    virtual void OnHeader(std::string_view key, std::string_view value) override;
+    virtual void OnHeadersDone() override;
+    virtual void OnBody(const char* data, size_t len) override;
 
 private:
     TcpClient* client_ = nullptr;
     std::string host_;
     uint16_t port_ = 0;
     HTTP_METHOD method_ = HTTP_GET;
-	DataBuffer header_buffer_;
+    HttpResponseParser parser_;
     std::map<std::string, std::string> headers_;
     std::string subpath_;
     HttpClientCallbackI* cb_ = nullptr;
     std::string post_data_;
     std::shared_ptr<HttpClientResponse> resp_ptr_;
+    bool body_streaming_ = false;
+    bool read_paused_ = false;
+
+private:
+    uint64_t trace_parent_id_ = 0;
+    TraceSpan request_span_;
 
 private:
     Logger* logger_ = nullptr;
@@ -0,0 +1,317 @@
+#include "http_response_parser.hpp"
+#include <string.h>
+
+namespace cpp_streamer
+{
+
+static std::string_view TrimView(std::string_view str) {
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+        str.remove_prefix(1);
+    }
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) {
+        str.remove_suffix(1);
+    }
+    return str;
+}
+
+static char LowerChar(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+static bool EqualsNoCase(std::string_view str, std::string_view lower) {
+    if (str.size() != lower.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < str.size(); i++) {
+        if (LowerChar(str[i]) != lower[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool EndsWithNoCase(std::string_view str, std::string_view lower) {
+    return str.size() >= lower.size() && EqualsNoCase(str.substr(str.size() - lower.size()), lower);
+}
+
+HttpResponseParser::HttpResponseParser(HttpResponseParserCallbackI* cb) : cb_(cb)
+{
+}
+
+void HttpResponseParser::Reset() {
+    state_ = HTTP_PARSE_STATUS_LINE;
+    line_buf_.clear();
+    line_pending_ = false;
+    header_bytes_ = 0;
+    status_code_ = 0;
+    content_length_ = -1;
+    body_left_ = 0;
+    chunked_ = false;
+    error_.clear();
+}
+
+int HttpResponseParser::Fail(const char* error) {
+    error_ = error;
+    state_ = HTTP_PARSE_ERROR;
+    return -1;
+}
+
+bool HttpResponseParser::OnEof() {
+    if (state_ == HTTP_PARSE_BODY_UNTIL_CLOSE) {
+        state_ = HTTP_PARSE_DONE;
+    }
+    return state_ == HTTP_PARSE_DONE;
+}
+
+int HttpResponseParser::NextLine(const char*& p, const char* end, std::string_view& line) {
+    const char* nl = (const char*)memchr(p, '\n', end - p);
+    if (!nl) {
+        if (!line_pending_) {
+            line_buf_.clear();
+        }
+        if (line_buf_.size() + (end - p) > HTTP_PARSER_MAX_LINE) {
+            return -1;
+        }
+        line_buf_.append(p, end - p);
+        line_pending_ = true;
+        p = end;
+        return 0;
+    }
+    if (line_pending_) {
+        if (line_buf_.size() + (nl - p) > HTTP_PARSER_MAX_LINE) {
+            return -1;
+        }
+        line_buf_.append(p, nl - p);
+        line = line_buf_;
+        line_pending_ = false;
+    } else {
+        line = std::string_view(p, nl - p);
+    }
+    p = nl + 1;
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    return 1;
+}
+
+int HttpResponseParser::Feed(const char* data, size_t len) {
+    const char* p = data;
+    const char* end = data + len;
+
+    while (p < end) {
+        switch (state_) {
+        case HTTP_PARSE_STATUS_LINE:
+        case HTTP_PARSE_HEADER_LINE:
+        case HTTP_PARSE_CHUNK_SIZE:
+        case HTTP_PARSE_CHUNK_DATA_END:
+        case HTTP_PARSE_TRAILER:
+        {
+            const char* line_start = p;
+            std::string_view line;
+            int ret = NextLine(p, end, line);
+            if (state_ != HTTP_PARSE_CHUNK_SIZE && state_ != HTTP_PARSE_CHUNK_DATA_END) {
+                header_bytes_ += p - line_start;
+                if (header_bytes_ > HTTP_PARSER_MAX_HEADER) {
+                    return Fail("http header too large");
+                }
+            }
+            if (ret < 0) {
+                return Fail("http line too long");
+            }
+            if (ret == 0) {
+                break;
+            }
+            bool in_header = state_ == HTTP_PARSE_HEADER_LINE;
+            if (!OnLine(line)) {
+                return -1;
+            }
+            if ((in_header && IsHeaderDone()) || state_ == HTTP_PARSE_DONE) {
+                return (int)(p - data);
+            }
+            break;
+        }
+        case HTTP_PARSE_BODY_LENGTH:
+        case HTTP_PARSE_CHUNK_DATA:
+        {
+            size_t n = (size_t)body_left_ < (size_t)(end - p) ? (size_t)body_left_ : (size_t)(end - p);
+            cb_->OnBody(p, n);
+            p += n;
+            body_left_ -= (int64_t)n;
+            if (body_left_ == 0) {
+                if (state_ == HTTP_PARSE_BODY_LENGTH) {
+                    state_ = HTTP_PARSE_DONE;
+                    return (int)(p - data);
+                }
+                state_ = HTTP_PARSE_CHUNK_DATA_END;
+            }
+            break;
+        }
+        case HTTP_PARSE_BODY_UNTIL_CLOSE:
+        {
+            cb_->OnBody(p, end - p);
+            p = end;
+            break;
+        }
+        case HTTP_PARSE_DONE:
+            return (int)(p - data);
+        case HTTP_PARSE_ERROR:
+        default:
+            return -1;
+        }
+    }
+    return (int)(p - data);
+}
+
+bool HttpResponseParser::OnLine(std::string_view line) {
+    switch (state_) {
+    case HTTP_PARSE_STATUS_LINE:
+        if (line.empty()) {
+            return true; // tolerated before the status line
+        }
+        return ParseStatusLine(line);
+    case HTTP_PARSE_HEADER_LINE:
+        if (line.empty()) {
+            OnHeaderBlockEnd();
+            return true;
+        }
+        return ParseHeaderLine(line);
+    case HTTP_PARSE_CHUNK_SIZE:
+        return ParseChunkSize(line);
+    case HTTP_PARSE_CHUNK_DATA_END:
+        if (!line.empty()) {
+            Fail("http chunk data is longer than its size");
+            return false;
+        }
+        state_ = HTTP_PARSE_CHUNK_SIZE;
+        return true;
+    case HTTP_PARSE_TRAILER:
+        if (line.empty()) {
+            state_ = HTTP_PARSE_DONE;
+            return true;
+        }
+        return ParseHeaderLine(line);
+    default:
+        return false;
+    }
+}
+
+bool HttpResponseParser::ParseStatusLine(std::string_view line) {
+    // HTTP/1.1 200 OK, the reason may be empty or contain spaces
+    size_t sp = line.find(' ');
+    size_t slash = line.find('/');
+    if (sp == std::string_view::npos || slash == std::string_view::npos || slash > sp) {
+        Fail("http status line error");
+        return false;
+    }
+    std::string_view rest = line.substr(sp + 1);
+    if (rest.size() < 3 || (rest.size() > 3 && rest[3] != ' ')) {
+        Fail("http status code error");
+        return false;
+    }
+    int status_code = 0;
+    for (size_t i = 0; i < 3; i++) {
+        if (rest[i] < '0' || rest[i] > '9') {
+            Fail("http status code error");
+            return false;
+        }
+        status_code = status_code * 10 + (rest[i] - '0');
+    }
+    status_code_ = status_code;
+    content_length_ = -1;
+    chunked_ = false;
+    state_ = HTTP_PARSE_HEADER_LINE;
+    cb_->OnStatusLine(line.substr(0, slash), line.substr(slash + 1, sp - slash - 1),
+        status_code_, rest.size() > 4 ? rest.substr(4) : std::string_view());
+    return true;
+}
+
+bool HttpResponseParser::ParseHeaderLine(std::string_view line) {
+    if (line.front() == ' ' || line.front() == '\t') {
+        return true; // obsolete line folding, the continuation is dropped
+    }
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos || colon == 0) {
+        Fail("http header line error");
+        return false;
+    }
+    std::string_view key = TrimView(line.substr(0, colon));
+    std::string_view value = TrimView(line.substr(colon + 1));
+
+    if (state_ == HTTP_PARSE_HEADER_LINE) {
+        if (EqualsNoCase(key, "content-length")) {
+            if (value.empty() || value.size() > 18) {
+                Fail("http content length error");
+                return false;
+            }
+            int64_t content_length = 0;
+            for (char c : value) {
+                if (c < '0' || c > '9') {
+                    Fail("http content length error");
+                    return false;
+                }
+                content_length = content_length * 10 + (c - '0');
+            }
+            content_length_ = content_length;
+        } else if (EqualsNoCase(key, "transfer-encoding") && EndsWithNoCase(value, "chunked")) {
+            chunked_ = true;
+        }
+    }
+    cb_->OnHeader(key, value);
+    return true;
+}
+
+bool HttpResponseParser::ParseChunkSize(std::string_view line) {
+    // hex size, optional ;extensions
+    int64_t chunk_size = 0;
+    size_t digits = 0;
+    for (char c : line) {
+        int v;
+        if (c >= '0' && c <= '9') {
+            v = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            v = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            v = c - 'A' + 10;
+        } else {
+            break;
+        }
+        if (++digits > 15) {
+            Fail("http chunk size too large");
+            return false;
+        }
+        chunk_size = chunk_size * 16 + v;
+    }
+    if (digits == 0) {
+        Fail("http chunk size error");
+        return false;
+    }
+    body_left_ = chunk_size;
+    state_ = chunk_size == 0 ? HTTP_PARSE_TRAILER : HTTP_PARSE_CHUNK_DATA;
+    return true;
+}
+
+void HttpResponseParser::OnHeaderBlockEnd() {
+    if (status_code_ >= 100 && status_code_ < 200 && status_code_ != 101) {
+        // interim response, the final one follows
+        state_ = HTTP_PARSE_STATUS_LINE;
+        header_bytes_ = 0;
+        return;
+    }
+    if (status_code_ == 101) {
+        state_ = HTTP_PARSE_BODY_UNTIL_CLOSE;
+    } else if (status_code_ == 204 || status_code_ == 304) {
+        state_ = HTTP_PARSE_DONE;
+    } else if (chunked_) {
+        state_ = HTTP_PARSE_CHUNK_SIZE;
+    } else if (content_length_ == 0) {
+        state_ = HTTP_PARSE_DONE;
+    } else if (content_length_ > 0) {
+        body_left_ = content_length_;
+        state_ = HTTP_PARSE_BODY_LENGTH;
+    } else {
+        state_ = HTTP_PARSE_BODY_UNTIL_CLOSE;
+    }
+    cb_->OnHeadersDone();
+}
+
+}
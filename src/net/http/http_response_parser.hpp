@@ -0,0 +1,94 @@
+#ifndef HTTP_RESPONSE_PARSER_HPP
+#define HTTP_RESPONSE_PARSER_HPP
+#include <string>
+#include <string_view>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace cpp_streamer
+{
+
+#define HTTP_PARSER_MAX_LINE    (16 * 1024)  // status line, one header line or one chunk size line
+#define HTTP_PARSER_MAX_HEADER  (64 * 1024)  // the whole header block
+
+typedef enum {
+    HTTP_PARSE_STATUS_LINE,
+    HTTP_PARSE_HEADER_LINE,
+    HTTP_PARSE_BODY_LENGTH,      // Content-Length bytes
+    HTTP_PARSE_CHUNK_SIZE,
+    HTTP_PARSE_CHUNK_DATA,
+    HTTP_PARSE_CHUNK_DATA_END,   // the CRLF after the chunk data
+    HTTP_PARSE_TRAILER,
+    HTTP_PARSE_BODY_UNTIL_CLOSE, // no length: upgraded connection or body ended by close
+    HTTP_PARSE_DONE,
+    HTTP_PARSE_ERROR
+} HTTP_PARSE_STATE;
+
+// The views are only valid during the call.
+class HttpResponseParserCallbackI
+{
+public:
+    virtual void OnStatusLine(std::string_view proto, std::string_view version,
+            int status_code, std::string_view status) = 0;
+    // headers and the trailers of a chunked body
+    virtual void OnHeader(std::string_view key, std::string_view value) = 0;
+    virtual void OnHeadersDone() = 0;
+    virtual void OnBody(const char* data, size_t len) = 0;
+};
+
+// Resumable HTTP/1.1 response parser.
+// Feed takes the bytes of each read as they come, a line or a chunk may be
+// split at any byte. Complete lines are parsed in place as string_view slices
+// of the read buffer, only a line cut by the end of a read is copied into
+// line_buf_, whose capacity is kept for the next line.
+class HttpResponseParser
+{
+public:
+    HttpResponseParser(HttpResponseParserCallbackI* cb);
+    ~HttpResponseParser() = default;
+
+public:
+    // return the bytes consumed, -1 on a malformed response.
+    // Feed returns early after the header block, so the caller may look at the
+    // headers before the body; bytes after the end of the response are not consumed.
+    int Feed(const char* data, size_t len);
+    // the peer closed the connection, true when that completes the response
+    bool OnEof();
+    void Reset();
+
+public:
+    HTTP_PARSE_STATE GetState() const { return state_; }
+    bool IsHeaderDone() const { return state_ > HTTP_PARSE_HEADER_LINE; }
+    bool IsDone() const { return state_ == HTTP_PARSE_DONE; }
+    bool IsBodyUntilClose() const { return state_ == HTTP_PARSE_BODY_UNTIL_CLOSE; }
+    bool IsChunked() const { return chunked_; }
+    int64_t GetContentLength() const { return content_length_; } // -1: no Content-Length
+    int GetStatusCode() const { return status_code_; }
+    const std::string& GetError() const { return error_; }
+
+private:
+    // set line to the next complete line without CRLF, return 1: line, 0: need more data, -1: too long
+    int NextLine(const char*& p, const char* end, std::string_view& line);
+    bool OnLine(std::string_view line);
+    bool ParseStatusLine(std::string_view line);
+    bool ParseHeaderLine(std::string_view line);
+    bool ParseChunkSize(std::string_view line);
+    void OnHeaderBlockEnd();
+    int Fail(const char* error);
+
+private:
+    HttpResponseParserCallbackI* cb_ = nullptr;
+    HTTP_PARSE_STATE state_ = HTTP_PARSE_STATUS_LINE;
+    std::string line_buf_;
+    bool line_pending_ = false;     // line_buf_ holds the start of a line
+    size_t header_bytes_ = 0;
+    int status_code_ = 0;
+    int64_t content_length_ = -1;
+    int64_t body_left_ = 0;         // of the Content-Length body or the current chunk
+    bool chunked_ = false;
+    std::string error_;
+};
+
+}
+
+#endif
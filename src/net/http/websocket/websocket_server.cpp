@@ -8,7 +8,7 @@ WebSocketServer::WebSocketServer(uint16_t port, uv_loop_t* loop, Logger* logger)
                                                                             , loop_(loop)
                                                                             , logger_(logger)
 {
-    server_ptr_.reset(new TcpServer(loop_, port_, this));
+    server_ptr_.reset(new TcpServer(loop_, "0.0.0.0", port_, this));
     StartTimer();
     LogInfof(logger_, "WebSocketServer construct, port:%d", port);
 }
@@ -24,7 +24,7 @@ WebSocketServer::WebSocketServer(uint16_t port,
                                         , key_file_(key_file)
                                         , cert_file_(cert_file)
 {
-    server_ptr_.reset(new TcpServer(loop_, port_, this));
+    server_ptr_.reset(new TcpServer(loop_, "0.0.0.0", port_, this));
     StartTimer();
     LogInfof(logger_, "WebSocketServer construct, port:%d, key file:%s, cert file:%s", port, key_file_.c_str(), cert_file_.c_str());
 }
@@ -56,6 +56,9 @@ void WebSocketServer::OnTimer() {
         if (now_ms - iter->second->GetLastPongMs() > 15 * 1000) {
             LogInfof(logger_, "ping/pong is timeout, remove ws session:%s", iter->second->GetRemoteAddress().c_str());
             iter = sessions_.erase(iter);
+        } else if (!iter->second->IsConnected()) {
+            LogInfof(logger_, "ws session is closed, remove ws session:%s", iter->first.c_str());
+            iter = sessions_.erase(iter);
         } else {
             iter++;
         }
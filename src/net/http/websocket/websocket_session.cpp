@@ -36,6 +36,8 @@ WebSocketSession::WebSocketSession(uv_loop_t* loop,
 
 WebSocketSession::~WebSocketSession()
 {
+    is_connected_ = false;
+    NotifyClose();
 }
 
 void WebSocketSession::Init() {
@@ -69,10 +71,24 @@ void WebSocketSession::SetSessionCallback(WebSocketSessionCallBackI* cb) {
     cb_ = cb;
 }
 
+size_t WebSocketSession::GetWriteQueueSize() {
+    return session_->GetWriteQueueSize();
+}
+
+// the callback gets code -1 once the connection is gone, and must not use the session after it
+void WebSocketSession::NotifyClose() {
+    if (close_notified_ || !cb_) {
+        return;
+    }
+    close_notified_ = true;
+    cb_->OnReadText(-1, "");
+}
+
 void WebSocketSession::OnWrite(int ret_code, size_t sent_size) {
     if (ret_code < 0) {
         is_connected_ = false;
         LogInfof(logger_, "tcp write return:%d", ret_code);
+        NotifyClose();
         return;
     }
 }
@@ -81,6 +97,7 @@ void WebSocketSession::OnRead(int ret_code, const char* data, size_t data_size)
     if (ret_code < 0) {
         is_connected_ = false;
         LogInfof(logger_, "tcp read return:%d", ret_code);
+        NotifyClose();
         return;
     }
 
@@ -293,34 +310,17 @@ void WebSocketSession::SendWsFrame(const uint8_t* data, size_t len, uint8_t op_c
         ws_header->payload_len = len;
         header_len = 2;
     }
-    ws_header->mask = 1;
-
-    uint8_t masking_key[4];
+    // frames from the server are not masked (rfc6455 5.1), header and payload go out in one write
+    ws_header->mask = 0;
 
-    masking_key[0] = ByteCrypto::GetRandomUint(1, 0xff);
-    masking_key[1] = ByteCrypto::GetRandomUint(1, 0xff);
-    masking_key[2] = ByteCrypto::GetRandomUint(1, 0xff);
-    masking_key[3] = ByteCrypto::GetRandomUint(1, 0xff);
-    
-    std::vector<uint8_t> data_vec(len);
+    std::vector<uint8_t> data_vec(header_len + len);
     uint8_t* p = &data_vec[0];
-    
-    memcpy(p, data, len);
-
-    size_t temp_len = len & ~3;
-    for (size_t i = 0; i < temp_len; i += 4) {
-        p[i + 0] ^= masking_key[0];
-        p[i + 1] ^= masking_key[1];
-        p[i + 2] ^= masking_key[2];
-        p[i + 3] ^= masking_key[3];
-    }
-    for (size_t i = temp_len; i < len; ++i) {
-        p[i] ^= masking_key[i % 4];
-    }
 
-    session_->AsyncWrite((char*)header_start, header_len);
-    session_->AsyncWrite((char*)masking_key, sizeof(masking_key));
-    session_->AsyncWrite((char*)p, len);
+    memcpy(p, header_start, header_len);
+    if (len > 0) {
+        memcpy(p + header_len, data, len);
+    }
+    session_->AsyncWrite((char*)p, data_vec.size());
 }
 
 void WebSocketSession::HandleWsClose(uint8_t* data, size_t len) {
@@ -354,7 +354,9 @@ void WebSocketSession::HandleWsClose(uint8_t* data, size_t len) {
     }
 
     close_ = true;
+    is_connected_ = false;
     session_->Close();
+    NotifyClose();
 }
 
 }
\ No newline at end of file
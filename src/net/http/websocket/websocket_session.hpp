@@ -30,6 +30,8 @@ public:
     std::string GetRemoteAddress();
     void SetSessionCallback(WebSocketSessionCallBackI* cb);
     int64_t GetLastPongMs();
+    bool IsConnected() { return is_connected_; }
+    size_t GetWriteQueueSize();
 
 protected:
     virtual void OnTimer() override;
@@ -49,6 +51,7 @@ private:
     void SendHttpResponse();
     void SendErrorResponse();
     void OnHandleFrame(const uint8_t* data, size_t data_size);
+    void NotifyClose();
     std::string GenHashcode();
 
 private:
@@ -78,6 +81,7 @@ private:
 
 private:
     WebSocketSessionCallBackI* cb_ = nullptr;
+    bool close_notified_ = false;
 };
 }
 
@@ -2,6 +2,7 @@
 #include "co_tcp_conn_send.hpp"
 #include "co_tcp_conn_recv.hpp"
 #include "utils/ipaddress.hpp"
+#include "net/tcp/dns_resolver.hpp"
 #ifdef _WIN64
 #define WIN32_LEAN_AND_MEAN  //  Windows ɰͷļ winsock.h
 #include <windows.h>  // Ҫ Windows 
@@ -95,48 +96,68 @@ CoTcpRecvPromise TcpCoConn::CoReceive(uint8_t* recv_data, size_t recv_size) {
 }
 
 int TcpCoConn::StartConnect() {
-    int r = 0;
-    char port_sz[80];
-    std::string dst_ip;
-    struct sockaddr_in dst_addr;
-
     if (!IsIPv4(host_)) {
-        snprintf(port_sz, sizeof(port_sz), "%d", port_);
-        addrinfo hints;
-        memset(&hints, 0, sizeof(hints));
-        hints.ai_family = AF_UNSPEC;
-        hints.ai_socktype = SOCK_STREAM;
-
-        addrinfo* ai  = NULL;
-        if(getaddrinfo(host_.c_str(), port_sz, (const addrinfo*)&hints, &ai)) {
-            LogErrorf(logger_, "getaddrinfo error for host:%s, port:%s", 
-                    host_.c_str(), port_sz);
+        // cached: connect now, otherwise resolve off the loop and connect in the callback
+        int status = 0;
+        std::vector<sockaddr_storage> addrs;
+        if (!DnsResolver::Instance().Lookup(host_, status, addrs)) {
+            std::weak_ptr<int> alive = alive_;
+            DnsResolver::Instance().Resolve(loop_, host_,
+                [this, alive](int status, const std::vector<sockaddr_storage>& addrs) {
+                if (alive.expired()) {
+                    return;
+                }
+                if (status != 0) {
+                    LogErrorf(logger_, "resolve host:%s error:%s", host_.c_str(), uv_strerror(status));
+                    OnConnect(nullptr, status);
+                    return;
+                }
+                ConnectAddresses(addrs);
+            });
+            return 0;
+        }
+        if (status != 0) {
+            LogErrorf(logger_, "resolve host:%s error:%s", host_.c_str(), uv_strerror(status));
             connect_ = nullptr;
             return -1;
         }
-        freeaddrinfo(ai);
-        assert(sizeof(dst_addr) == ai->ai_addrlen);
-
-        memcpy((void*)&dst_addr, ai->ai_addr, sizeof(dst_addr));
-        dst_ip = GetIpStr(ai->ai_addr, port_);
-    } else {
-        GetIpv4Sockaddr(host_, htons(port_), (struct sockaddr*)&dst_addr);
-        dst_ip = GetIpStr((sockaddr*)&dst_addr, port_);
+        return ConnectAddresses(addrs) == 0 ? 0 : -2;
     }
-    connect_ = (uv_connect_t*)malloc(sizeof(uv_connect_t));
-    connect_->data = this;
+    sockaddr_storage dst_addr;
+    memset(&dst_addr, 0, sizeof(dst_addr));
+    GetIpv4Sockaddr(host_, htons(port_), (struct sockaddr*)&dst_addr);
+    return ConnectAddresses({ dst_addr }) == 0 ? 0 : -2;
+}
 
-    if ((r = uv_tcp_connect(connect_, client_,
-                        (const struct sockaddr*)&dst_addr,
-                        OnUVClientConnected)) != 0) {
-        free(connect_);
-        connect_ = nullptr;
-        LogErrorf(logger_, "uv_tcp_connect error:%d", r);
-        connect_ = nullptr;
-        return -2;
+// RFC 8305 racing, the winner replaces client_; a failure before this
+// returns is returned instead of being reported to the awaiter
+int TcpCoConn::ConnectAddresses(const std::vector<sockaddr_storage>& addrs) {
+    std::vector<sockaddr_storage> candidates = addrs;
+    for (auto& addr : candidates) {
+        SetSockaddrPort(addr, port_);
     }
-
-    return 0;
+    connect_starting_ = true;
+    connect_sync_status_ = 0;
+    connector_.reset(new HappyEyeballsConnector(loop_, logger_));
+    connector_->Start(candidates, [this](int status, uv_tcp_t* tcp, uv_connect_t* req) {
+        if (status != 0) {
+            LogErrorf(logger_, "connect host:%s, port:%d error:%s", host_.c_str(), port_, uv_strerror(status));
+            if (connect_starting_) {
+                connect_sync_status_ = status;
+                return;
+            }
+            OnConnect(nullptr, status);
+            return;
+        }
+        uv_close((uv_handle_t*)client_, OnCoConnUVClose);
+        client_ = tcp;
+        connect_ = req;
+        client_->data = this;
+        connect_->data = this;
+        OnConnect(connect_, 0);
+    });
+    connect_starting_ = false;
+    return connect_sync_status_;
 }
 
 int TcpCoConn::StartSend() {
@@ -223,13 +244,6 @@ void TcpCoConn::SetRecvAwaiterCallback(CoTcpRecvAwaiterCallbackI* callback) {
     recv_awaiter_callback_ = callback;
 }
 
-void TcpCoConn::OnUVClientConnected(uv_connect_t* conn, int status) {
-    TcpCoConn* client = (TcpCoConn*)conn->data;
-    if (client) {
-        client->OnConnect(conn, status);
-    }
-}
-
 void TcpCoConn::OnUvWrite(uv_write_t* req, int status) {
     TcpCoConn* conn = static_cast<TcpCoConn*>(req->handle->data);
     if (conn) {
@@ -4,6 +4,7 @@
 #include "utils/logger.hpp"
 #include "co_tcp_pub.hpp"
 #include "net/tcp/tcp_pub.hpp"
+#include "net/tcp/happy_eyeballs.hpp"
 #include <memory>
 #include <string>
 #include <coroutine>
@@ -56,6 +57,7 @@ public:
 
 private:
     int StartConnect();
+    int ConnectAddresses(const std::vector<sockaddr_storage>& addrs);
     void OnConnect(uv_connect_t *connect, int status);
 
 private:
@@ -73,7 +75,6 @@ private:
     void SetRecvAwaiterCallback(CoTcpRecvAwaiterCallbackI* callback);
 
 private:
-    static void OnUVClientConnected(uv_connect_t* conn, int status);
     static void OnUvWrite(uv_write_t* req, int status);
     static void OnUVClientAlloc(uv_handle_t* handle,
         size_t suggested_size,
@@ -97,6 +98,10 @@ private:
     uv_connect_t* connect_ = nullptr;
     uv_tcp_t* client_ = nullptr;
     TCP_CONNECT_STATUS status_ = TCP_CONNECT_PENDING;
+    std::shared_ptr<int> alive_ = std::make_shared<int>(0); // guards the resolve callback
+    std::unique_ptr<HappyEyeballsConnector> connector_;
+    bool connect_starting_ = false; // inside connector_->Start, a failure is returned instead
+    int connect_sync_status_ = 0;
 
 private:
     std::vector<uint8_t> send_buffer_;
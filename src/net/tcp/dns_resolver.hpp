@@ -0,0 +1,183 @@
+#ifndef DNS_RESOLVER_HPP
+#define DNS_RESOLVER_HPP
+#include "logger.hpp"
+#include "timeex.hpp"
+#include "ipaddress.hpp"
+
+#include <uv.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <functional>
+#include <stdint.h>
+
+namespace cpp_streamer
+{
+
+#define DNS_CACHE_TTL_MS      (60 * 1000) // getaddrinfo does not expose the record ttl
+#define DNS_NEGATIVE_TTL_MS   (5 * 1000)  // a failed lookup is not retried before
+#define DNS_CACHE_MAX_HOSTS   256
+
+// status 0 and the addresses of the host with port 0, or a uv error
+typedef std::function<void(int status, const std::vector<sockaddr_storage>& addrs)> DnsResolveCallback;
+
+inline void SetSockaddrPort(sockaddr_storage& addr, uint16_t port) {
+    if (addr.ss_family == AF_INET6) {
+        ((sockaddr_in6*)&addr)->sin6_port = htons(port);
+    } else {
+        ((sockaddr_in*)&addr)->sin_port = htons(port);
+    }
+}
+
+// Process-wide resolver on uv_getaddrinfo, the lookup runs on the libuv
+// thread pool and never blocks a loop.
+// Results are cached for every loop, failures too for a shorter time.
+// Identical lookups started on the same loop while one is running wait for
+// it instead of starting another; the callbacks always run on the loop
+// thread of the caller.
+class DnsResolver
+{
+public:
+    static DnsResolver& Instance() {
+        static DnsResolver resolver;
+        return resolver;
+    }
+
+public:
+    void SetLogger(Logger* logger) { logger_ = logger; }
+
+    // call on the loop thread; a cached host calls back before Resolve returns
+    void Resolve(uv_loop_t* loop, const std::string& host, DnsResolveCallback cb) {
+        int status = 0;
+        std::vector<sockaddr_storage> addrs;
+        if (Lookup(host, status, addrs)) {
+            cb(status, addrs);
+            return;
+        }
+
+        PendingLookup* pending = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto key = std::make_pair(loop, host);
+            auto it = pending_.find(key);
+            if (it != pending_.end()) {
+                it->second->callbacks.push_back(std::move(cb));
+                return;
+            }
+            pending = new PendingLookup();
+            pending->resolver = this;
+            pending->loop = loop;
+            pending->host = host;
+            pending->start_ms = now_millisec();
+            pending->callbacks.push_back(std::move(cb));
+            pending->req.data = pending;
+            pending_[key] = pending;
+        }
+
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        int r = uv_getaddrinfo(loop, &pending->req, &DnsResolver::OnUVResolved, host.c_str(), nullptr, &hints);
+        if (r != 0) {
+            LogErrorf(logger_, "uv_getaddrinfo host:%s error:%s", host.c_str(), uv_strerror(r));
+            OnResolved(pending, r, nullptr);
+        }
+    }
+
+    // cache only, false when the host is not cached or expired
+    bool Lookup(const std::string& host, int& status, std::vector<sockaddr_storage>& addrs) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = cache_.find(host);
+        if (it == cache_.end() || it->second.expire_ms <= now_millisec()) {
+            return false;
+        }
+        status = it->second.status;
+        addrs = it->second.addrs;
+        return true;
+    }
+
+    void Clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cache_.clear();
+    }
+
+private:
+    DnsResolver() = default;
+    ~DnsResolver() = default;
+
+    typedef struct PendingLookup {
+        uv_getaddrinfo_t req;
+        DnsResolver* resolver = nullptr;
+        uv_loop_t* loop = nullptr;
+        std::string host;
+        int64_t start_ms = 0;
+        std::vector<DnsResolveCallback> callbacks;
+    } PendingLookup;
+
+    typedef struct {
+        int status = 0;
+        std::vector<sockaddr_storage> addrs;
+        int64_t expire_ms = 0;
+    } CacheEntry;
+
+    static void OnUVResolved(uv_getaddrinfo_t* req, int status, struct addrinfo* res) {
+        PendingLookup* pending = (PendingLookup*)req->data;
+        pending->resolver->OnResolved(pending, status, res);
+    }
+
+    void OnResolved(PendingLookup* pending, int status, struct addrinfo* res) {
+        CacheEntry entry;
+        for (struct addrinfo* ai = res; ai != nullptr; ai = ai->ai_next) {
+            if ((ai->ai_family != AF_INET && ai->ai_family != AF_INET6) || ai->ai_addrlen > sizeof(sockaddr_storage)) {
+                continue;
+            }
+            sockaddr_storage addr;
+            memset(&addr, 0, sizeof(addr));
+            memcpy(&addr, ai->ai_addr, ai->ai_addrlen);
+            entry.addrs.push_back(addr);
+        }
+        if (res) {
+            uv_freeaddrinfo(res);
+        }
+        if (status == 0 && entry.addrs.empty()) {
+            status = UV_EAI_NODATA;
+        }
+        entry.status = status;
+        int64_t now_ms = now_millisec();
+        entry.expire_ms = now_ms + (status == 0 ? DNS_CACHE_TTL_MS : DNS_NEGATIVE_TTL_MS);
+        LogInfof(logger_, "dns resolve host:%s, status:%d, addrs:%zu, elapsed:%lldms",
+            pending->host.c_str(), status, entry.addrs.size(), (long long)(now_ms - pending->start_ms));
+
+        std::vector<DnsResolveCallback> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (cache_.size() >= DNS_CACHE_MAX_HOSTS) {
+                for (auto it = cache_.begin(); it != cache_.end();) {
+                    it = it->second.expire_ms <= now_ms ? cache_.erase(it) : std::next(it);
+                }
+                if (cache_.size() >= DNS_CACHE_MAX_HOSTS) {
+                    cache_.erase(cache_.begin());
+                }
+            }
+            cache_[pending->host] = entry;
+            callbacks.swap(pending->callbacks);
+            pending_.erase(std::make_pair(pending->loop, pending->host));
+        }
+        for (auto& cb : callbacks) {
+            cb(entry.status, entry.addrs);
+        }
+        delete pending;
+    }
+
+private:
+    Logger* logger_ = nullptr;
+    std::mutex mutex_;
+    std::map<std::string, CacheEntry> cache_; // key: host
+    std::map<std::pair<uv_loop_t*, std::string>, PendingLookup*> pending_;
+};
+
+}
+
+#endif
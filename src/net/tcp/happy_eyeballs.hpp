@@ -0,0 +1,235 @@
+#ifndef HAPPY_EYEBALLS_HPP
+#define HAPPY_EYEBALLS_HPP
+#include "logger.hpp"
+#include "ipaddress.hpp"
+
+#include <uv.h>
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+namespace cpp_streamer
+{
+
+#define HAPPY_EYEBALLS_DELAY_MS 250 // RFC 8305 connection attempt delay
+
+// status 0: the connected handle and its connect request, the caller owns
+// both (uv_close the handle, free the request); otherwise the last error
+typedef std::function<void(int status, uv_tcp_t* tcp, uv_connect_t* req)> HappyEyeballsCallback;
+
+// RFC 8305 order: the family of the first address first, then alternating
+inline std::vector<sockaddr_storage> InterleaveAddressFamilies(const std::vector<sockaddr_storage>& addrs) {
+    std::vector<sockaddr_storage> result;
+    if (addrs.empty()) {
+        return result;
+    }
+    std::vector<sockaddr_storage> first;
+    std::vector<sockaddr_storage> second;
+    for (const auto& addr : addrs) {
+        (addr.ss_family == addrs[0].ss_family ? first : second).push_back(addr);
+    }
+    for (size_t i = 0; i < first.size() || i < second.size(); i++) {
+        if (i < first.size()) {
+            result.push_back(first[i]);
+        }
+        if (i < second.size()) {
+            result.push_back(second[i]);
+        }
+    }
+    return result;
+}
+
+// Races the connects to the candidates of a host: a new attempt starts every
+// HAPPY_EYEBALLS_DELAY_MS, or at once when one fails; the first connected
+// attempt wins and the others are closed.
+// The callback is called once, possibly before Start returns, and never after
+// Cancel or the destructor.
+class HappyEyeballsConnector
+{
+public:
+    HappyEyeballsConnector(uv_loop_t* loop, Logger* logger = nullptr) : loop_(loop)
+                                                                      , logger_(logger)
+    {
+    }
+    ~HappyEyeballsConnector() {
+        Cancel();
+    }
+
+public:
+    // addrs with the port set
+    void Start(const std::vector<sockaddr_storage>& addrs, HappyEyeballsCallback cb) {
+        addrs_ = InterleaveAddressFamilies(addrs);
+        cb_ = std::move(cb);
+        next_ = 0;
+        last_error_ = UV_EAI_NODATA;
+        finished_ = false;
+        if (addrs_.size() > 1) {
+            timer_ = (uv_timer_t*)malloc(sizeof(uv_timer_t));
+            uv_timer_init(loop_, timer_);
+            timer_->data = this;
+            uv_timer_start(timer_, &HappyEyeballsConnector::OnUVTimer, HAPPY_EYEBALLS_DELAY_MS, HAPPY_EYEBALLS_DELAY_MS);
+        }
+        StartNext();
+    }
+
+    void Cancel() {
+        finished_ = true;
+        StopTimer();
+        for (Attempt* attempt : attempts_) {
+            CloseAttempt(attempt);
+        }
+        attempts_.clear();
+    }
+
+private:
+    typedef struct {
+        uv_tcp_t* tcp = nullptr;
+        uv_connect_t* req = nullptr;
+        HappyEyeballsConnector* owner = nullptr; // nullptr once the attempt lost or was canceled
+        std::string ip;
+    } Attempt;
+
+    void StartNext() {
+        // a failure right at uv_tcp_connect moves on to the next candidate
+        while (!finished_ && next_ < addrs_.size()) {
+            const sockaddr_storage& addr = addrs_[next_++];
+            uint16_t port = 0;
+            Attempt* attempt = new Attempt();
+            attempt->owner = this;
+            attempt->ip = GetIpStr((const sockaddr*)&addr, port);
+            attempt->tcp = (uv_tcp_t*)malloc(sizeof(uv_tcp_t));
+            int r = uv_tcp_init_ex(loop_, attempt->tcp, addr.ss_family);
+            if (r != 0) {
+                free(attempt->tcp);
+                delete attempt;
+                OnAttemptFailed(nullptr, r);
+                continue;
+            }
+            attempt->tcp->data = attempt;
+            attempt->req = (uv_connect_t*)malloc(sizeof(uv_connect_t));
+            attempt->req->data = attempt;
+            LogInfof(logger_, "connect attempt %zu/%zu to %s:%d", next_, addrs_.size(), attempt->ip.c_str(), ntohs(port));
+            r = uv_tcp_connect(attempt->req, attempt->tcp, (const struct sockaddr*)&addr,
+                &HappyEyeballsConnector::OnUVConnected);
+            if (r != 0) {
+                free(attempt->req);
+                attempt->req = nullptr;
+                attempt->owner = nullptr;
+                uv_close((uv_handle_t*)attempt->tcp, &HappyEyeballsConnector::OnUVAttemptClose);
+                OnAttemptFailed(nullptr, r);
+                continue;
+            }
+            attempts_.push_back(attempt);
+            return;
+        }
+        if (!finished_ && attempts_.empty()) {
+            Finish(last_error_, nullptr, nullptr);
+        }
+    }
+
+    void OnAttemptFailed(Attempt* attempt, int status) {
+        last_error_ = status;
+        if (attempt) {
+            LogWarnf(logger_, "connect attempt to %s failed:%s", attempt->ip.c_str(), uv_strerror(status));
+            RemoveAttempt(attempt);
+            CloseAttempt(attempt);
+            StartNext();
+        }
+    }
+
+    void OnAttemptConnected(Attempt* attempt) {
+        LogInfof(logger_, "connected to %s, attempts started:%zu", attempt->ip.c_str(), next_);
+        RemoveAttempt(attempt);
+        uv_tcp_t* tcp = attempt->tcp;
+        uv_connect_t* req = attempt->req;
+        tcp->data = nullptr;
+        req->data = nullptr;
+        delete attempt;
+        Finish(0, tcp, req);
+    }
+
+    void Finish(int status, uv_tcp_t* tcp, uv_connect_t* req) {
+        Cancel();
+        HappyEyeballsCallback cb = std::move(cb_);
+        cb_ = nullptr;
+        if (cb) {
+            cb(status, tcp, req);
+        }
+    }
+
+    void RemoveAttempt(Attempt* attempt) {
+        for (auto it = attempts_.begin(); it != attempts_.end(); it++) {
+            if (*it == attempt) {
+                attempts_.erase(it);
+                return;
+            }
+        }
+    }
+
+    // a pending connect request is called back with UV_ECANCELED before the close
+    void CloseAttempt(Attempt* attempt) {
+        attempt->owner = nullptr;
+        uv_close((uv_handle_t*)attempt->tcp, &HappyEyeballsConnector::OnUVAttemptClose);
+    }
+
+    void StopTimer() {
+        if (timer_) {
+            uv_timer_stop(timer_);
+            uv_close((uv_handle_t*)timer_, &HappyEyeballsConnector::OnUVFree);
+            timer_ = nullptr;
+        }
+    }
+
+    static void OnUVTimer(uv_timer_t* timer) {
+        HappyEyeballsConnector* connector = (HappyEyeballsConnector*)timer->data;
+        if (connector->next_ >= connector->addrs_.size()) {
+            connector->StopTimer();
+            return;
+        }
+        connector->StartNext();
+    }
+
+    static void OnUVConnected(uv_connect_t* req, int status) {
+        Attempt* attempt = (Attempt*)req->data;
+        HappyEyeballsConnector* owner = attempt->owner;
+        if (!owner) {
+            // lost or canceled, its handle is closing
+            free(req);
+            attempt->req = nullptr;
+            return;
+        }
+        if (status == 0) {
+            owner->OnAttemptConnected(attempt);
+            return;
+        }
+        free(req);
+        attempt->req = nullptr;
+        owner->OnAttemptFailed(attempt, status);
+    }
+
+    static void OnUVAttemptClose(uv_handle_t* handle) {
+        Attempt* attempt = (Attempt*)handle->data;
+        free(handle);
+        delete attempt;
+    }
+
+    static void OnUVFree(uv_handle_t* handle) {
+        free(handle);
+    }
+
+private:
+    uv_loop_t* loop_ = nullptr;
+    Logger* logger_ = nullptr;
+    std::vector<sockaddr_storage> addrs_;
+    size_t next_ = 0;
+    int last_error_ = 0;
+    bool finished_ = false;
+    uv_timer_t* timer_ = nullptr;
+    std::vector<Attempt*> attempts_; // connecting
+    HappyEyeballsCallback cb_;
+};
+
+}
+
+#endif
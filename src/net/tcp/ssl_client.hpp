@@ -5,6 +5,7 @@
 #endif
 #include "ssl_pub.hpp"
 #include "logger.hpp"
+#include "trace.hpp"
 
 #include <openssl/ssl.h>
 #include <string>
@@ -48,15 +49,23 @@ public:
         return state_;
     }
 
+    void SetTraceParent(uint64_t parent_id) {
+        trace_parent_id_ = parent_id;
+    }
+
+    // one context for every client connection, built on first use or by the
+    // startup warm-up; an SSL_CTX can be shared by connections on any thread
+    static SSL_CTX* SharedContext(Logger* logger = nullptr) {
+        static SSL_CTX* ssl_ctx = CreateContext(logger);
+        return ssl_ctx;
+    }
+
     int ClientHello() {
-//#if (OPENSSL_VERSION_NUMBER < 0x10002000L) // v1.0.2
-        ssl_ctx_ = SSL_CTX_new(TLS_method());
-//#else
-//        ssl_ctx_ = SSL_CTX_new(TLSv1_2_method());
-//#endif
-        SSL_CTX_set_verify(ssl_ctx_, SSL_VERIFY_PEER, on_verify_callback);
-        if (SSL_CTX_set_cipher_list(ssl_ctx_, "HIGH:!aNULL:!MD5") != 1) {
-            LogErrorf(logger_, "SSL_CTX_set_cipher_list set all error");
+        handshake_span_.Begin("ssl", "ssl.handshake", trace_parent_id_);
+        TraceScope trace_scope("ssl", "ssl.client_hello", handshake_span_.Id());
+        ssl_ctx_ = SharedContext(logger_);
+        if (!ssl_ctx_) {
+            LogErrorf(logger_, "ssl client context error");
             return -1;
         }
 
@@ -110,10 +119,30 @@ public:
         return 0;
     }
 
+    static SSL_CTX* CreateContext(Logger* logger) {
+//#if (OPENSSL_VERSION_NUMBER < 0x10002000L) // v1.0.2
+        SSL_CTX* ssl_ctx = SSL_CTX_new(TLS_method());
+//#else
+//        ssl_ctx = SSL_CTX_new(TLSv1_2_method());
+//#endif
+        if (!ssl_ctx) {
+            LogErrorf(logger, "SSL_CTX_new error");
+            return nullptr;
+        }
+        SSL_CTX_set_verify(ssl_ctx, SSL_VERIFY_PEER, on_verify_callback);
+        if (SSL_CTX_set_cipher_list(ssl_ctx, "HIGH:!aNULL:!MD5") != 1) {
+            LogErrorf(logger, "SSL_CTX_set_cipher_list set all error");
+            SSL_CTX_free(ssl_ctx);
+            return nullptr;
+        }
+        return ssl_ctx;
+    }
+
     int RecvServerHello(char* buf, ssize_t nn) {
         int r0 = 0;
         int r1 = 0;
         bool ready = false;
+        TraceScope trace_scope("ssl", "ssl.server_hello", handshake_span_.Id());
 
         if ((r0 = BIO_write(bio_in_, buf, (int)nn)) <= 0) {
             LogErrorf(logger_, "BIO_write r0=%d, data=%p, size=%d", r0, buf, nn);
@@ -124,6 +153,7 @@ public:
 		if (r0 == 1 && r1 == SSL_ERROR_NONE) {
 			LogInfof(logger_, "Ssl client final done");
 			state_ = TLS_CLIENT_READY;
+			handshake_span_.End();
 			return 0;
 		}
         if (r0 != -1 || r1 != SSL_ERROR_WANT_READ) {
@@ -162,6 +192,7 @@ public:
     int HandleSessionTicket(char* buf, ssize_t nn) {
         int r0 = 0;
         int r1 = 0;
+        TraceScope trace_scope("ssl", "ssl.session_ticket", handshake_span_.Id());
 
         if ((r0 = BIO_write(bio_in_, buf, (int)nn)) <= 0) {
             LogErrorf(logger_, "BIO_write r0=%d, data=%p, size=%d", r0, buf, nn);
@@ -172,6 +203,7 @@ public:
         if (r0 == 1 && r1 == SSL_ERROR_NONE) {
             LogInfof(logger_, "Ssl client final done");
             state_ = TLS_CLIENT_READY;
+            handshake_span_.End();
             return 0;
         }
 
@@ -268,6 +300,10 @@ private:
     BIO* bio_out_     = nullptr;
     TLS_CLIENT_STATE state_ = TLS_SSL_CLIENT_ZERO;
 
+private:
+    uint64_t trace_parent_id_ = 0;
+    TraceSpan handshake_span_;
+
 private:
     uint8_t* plaintext_data_    = nullptr;
     ssize_t plaintext_data_len_ = SSL_DEF_RECV_BUFFER_SIZE;
@@ -7,6 +7,9 @@
 #include "tcp_pub.hpp"
 #include "ssl_client.hpp"
 #include "ipaddress.hpp"
+#include "dns_resolver.hpp"
+#include "happy_eyeballs.hpp"
+#include "trace.hpp"
 
 #include <uv.h>
 #include <memory>
@@ -26,8 +29,8 @@
 namespace cpp_streamer
 {
 
-inline void OnUVClientConnected(uv_connect_t *conn, int status);
 inline void OnUVClientWrite(uv_write_t* req, int status);
+inline void OnUVClientWriteBufs(uv_write_t* req, int status);
 inline void OnUVClientAlloc(uv_handle_t* handle,
                     size_t suggested_size,
                     uv_buf_t* buf);
@@ -40,8 +43,8 @@ inline void OnUVClose(uv_handle_t *handle) {
 
 class TcpClient : public SslCallbackI
 {
-friend void OnUVClientConnected(uv_connect_t *conn, int status);
 friend void OnUVClientWrite(uv_write_t* req, int status);
+friend void OnUVClientWriteBufs(uv_write_t* req, int status);
 friend void OnUVClientAlloc(uv_handle_t* handle,
                     size_t suggested_size,
                     uv_buf_t* buf);
@@ -77,12 +80,18 @@ public:
             ssl_client_ = nullptr;
         }
         if (connect_) {
-            uv_read_stop(connect_->handle);
+            if (tcp_init_) {
+                uv_read_stop(connect_->handle);
+            }
             free(connect_);
             connect_ = nullptr;
         }
         if (client_) {
-            uv_close((uv_handle_t*)client_, OnUVClose);
+            if (tcp_init_) {
+                uv_close((uv_handle_t*)client_, OnUVClose);
+            } else {
+                free(client_);
+            }
             client_ = nullptr;
         }
     }
@@ -111,67 +120,42 @@ public:
     }
 
 public:
-    void Connect(const std::string& host, uint16_t dst_port) {
-        int r = 0;
-        char port_sz[80];
-        std::string dst_ip;
-
-        if (!IsIPv4(host)) {
-            snprintf(port_sz, sizeof(port_sz), "%d", dst_port);
-            addrinfo hints;
-            memset(&hints, 0, sizeof(hints));
-            hints.ai_family = AF_UNSPEC;
-            hints.ai_socktype = SOCK_STREAM;
-
-            addrinfo* ai = NULL;
-            LogInfof(logger_, "getaddrinfo host:%s, port:%s, ssl:%s",
-                host.c_str(), port_sz, ssl_enable_ ? "true" : "false");
-            if (getaddrinfo(host.c_str(), port_sz, (const addrinfo*)&hints, &ai)) {
-                throw CppStreamException("get address info error");
-            }
-
-            if (ai != nullptr) {
-				af_family_ = ai->ai_family;
-                if (af_family_ == AF_INET) {
-                    memcpy((void*)&dst_addr_, ai->ai_addr, sizeof(sockaddr_in));
-                    dst_ip = GetIpStr(ai->ai_addr, dst_port);
-                    LogInfof(logger_, "getaddrinfo result:%s:%d, af_family:%d",
-                        dst_ip.c_str(), htons(dst_port), ai->ai_family);
-
-                    uv_tcp_init(loop_, client_);
-                } else if (af_family_ == AF_INET6) {
-					memcpy((void*)&dst_addr_, ai->ai_addr, sizeof(sockaddr_in6));
-                    int ret = uv_tcp_init_ex(loop_, client_, AF_INET6);
-                    if (ret != 0) {
-						LogErrorf(logger_, "uv_tcp_init_ex error:%s, %d", uv_strerror(ret), ret);
-                        freeaddrinfo(ai);
-                        throw CppStreamException("uv_tcp_init_ex error");
-					}
-                } else {
-                    freeaddrinfo(ai);
-                    throw CppStreamException("get address info family error");
-				}
-                freeaddrinfo(ai);
-            }
-            else {
-				throw CppStreamException("get address info null");
-            }
-
-        } else {
-            uv_tcp_init(loop_, client_);
-            GetIpv4Sockaddr(host, htons(dst_port), (struct sockaddr*)&dst_addr_);
-            dst_ip = GetIpStr((sockaddr*)&dst_addr_, dst_port);
-            LogInfof(logger_, "start connect host:%s:%d", dst_ip.c_str(), htons(dst_port));
+    void SetTraceParent(uint64_t parent_id) {
+        trace_parent_id_ = parent_id;
+        if (ssl_client_) {
+            ssl_client_->SetTraceParent(parent_id);
         }
+    }
 
-        connect_->data = this;
-
-        if ((r = uv_tcp_connect(connect_, client_,
-            (const struct sockaddr*)&dst_addr_,
-            OnUVClientConnected)) != 0) {
-            throw CppStreamException("connect address error");
+    // a host name is resolved by DnsResolver off the loop thread, a resolve or
+    // connect failure after that is reported by OnConnect
+    void Connect(const std::string& host, uint16_t dst_port) {
+        connect_span_.Begin("tcp", "tcp.connect", trace_parent_id_);
+        if (!IsIPv4(host)) {
+            LogInfof(logger_, "resolve host:%s, port:%d, ssl:%s",
+                host.c_str(), dst_port, ssl_enable_ ? "true" : "false");
+            dns_span_.Begin("tcp", "dns.resolve", connect_span_.Id());
+            std::weak_ptr<int> alive = alive_;
+            DnsResolver::Instance().Resolve(loop_, host,
+                [this, alive, host, dst_port](int status, const std::vector<sockaddr_storage>& addrs) {
+                if (alive.expired()) {
+                    return;
+                }
+                dns_span_.End();
+                if (status != 0) {
+                    LogErrorf(logger_, "resolve host:%s error:%s", host.c_str(), uv_strerror(status));
+                    OnConnectFailed(status);
+                    return;
+                }
+                StartConnect(addrs, dst_port);
+            });
+            return;
         }
 
+        sockaddr_storage addr;
+        memset(&addr, 0, sizeof(addr));
+        GetIpv4Sockaddr(host, htons(dst_port), (struct sockaddr*)&addr);
+        StartConnect({ addr }, dst_port);
         return;
     }
 
@@ -195,6 +179,31 @@ public:
         return;
     }
 
+    // header and body are moved in and go out in one writev, without copying
+    // them into a send buffer; over ssl they are encrypted one after the other
+    void SendBuffers(std::string&& header, std::string&& body) {
+        if (ssl_enable_) {
+            ssl_client_->SslWrite((uint8_t*)header.data(), header.size());
+            if (!body.empty()) {
+                ssl_client_->SslWrite((uint8_t*)body.data(), body.size());
+            }
+            return;
+        }
+        write_bufs_req_t* req = new write_bufs_req_t();
+        req->header = std::move(header);
+        req->body   = std::move(body);
+        req->bufs[0] = uv_buf_init(req->header.data(), (unsigned int)req->header.size());
+        req->bufs[1] = uv_buf_init(req->body.data(), (unsigned int)req->body.size());
+        req->req.data = req;
+
+        connect_->handle->data = this;
+        int ret = uv_write(&req->req, connect_->handle, req->bufs, req->body.empty() ? 1 : 2, OnUVClientWriteBufs);
+        if (ret != 0) {
+            delete req;
+            throw CppStreamException("uv_write error");
+        }
+    }
+
     void AsyncRead() {
         if (!is_connect_) {
             return;
@@ -215,6 +224,15 @@ public:
         }
     }
 
+    // backpressure: nothing is read until the next AsyncRead
+    void StopRead() {
+        if (!is_connect_ || !read_start_) {
+            return;
+        }
+        read_start_ = false;
+        uv_read_stop(connect_->handle);
+    }
+
     void Close() {
         if (!is_connect_) {
             return;
@@ -229,7 +247,44 @@ public:
     }
 
 private:
+    // RFC 8305 racing over the candidates, the winner becomes client_ and connect_
+    void StartConnect(const std::vector<sockaddr_storage>& addrs, uint16_t dst_port) {
+        std::vector<sockaddr_storage> candidates = addrs;
+        for (auto& addr : candidates) {
+            SetSockaddrPort(addr, dst_port);
+        }
+        connector_.reset(new HappyEyeballsConnector(loop_, logger_));
+        connector_->Start(candidates, [this](int status, uv_tcp_t* tcp, uv_connect_t* req) {
+            if (status != 0) {
+                LogErrorf(logger_, "tcp connect error:%s, %d", uv_strerror(status), status);
+                OnConnectFailed(status);
+                return;
+            }
+            if (tcp_init_) {
+                uv_close((uv_handle_t*)client_, OnUVClose);
+            } else {
+                free(client_);
+            }
+            free(connect_);
+            client_ = tcp;
+            connect_ = req;
+            tcp_init_ = true;
+            client_->data = this;
+            connect_->data = this;
+            OnConnect(0);
+        });
+    }
+
+    void OnConnectFailed(int status) {
+        connect_span_.End();
+        if (callback_) {
+            callback_->OnConnect(status);
+        }
+    }
+
     void OnConnect(int status) {
+        connect_span_.End();
+        TraceScope trace_scope("tcp", "tcp.on_connect", trace_parent_id_);
         if (status == 0) {
             is_connect_ = true;
         }
@@ -261,6 +316,7 @@ private:
 
     void OnWrite(write_req_t* req, int status) {
         write_req_t* wr;
+        TraceScope trace_scope("tcp", "tcp.on_write", trace_parent_id_);
       
         if (ssl_enable_) {
             if (ssl_client_->GetState() < TLS_CLIENT_READY) {
@@ -277,7 +333,17 @@ private:
         free(wr);
     }
 
+    void OnWriteBufs(write_bufs_req_t* req, int status) {
+        TraceScope trace_scope("tcp", "tcp.on_write", trace_parent_id_);
+        size_t sent_size = req->header.size() + req->body.size();
+        delete req;
+        if (callback_) {
+            callback_->OnWrite(status, sent_size);
+        }
+    }
+
     void OnRead(ssize_t nread, const uv_buf_t* buf) {
+        TraceScope trace_scope("tcp", "tcp.on_read", trace_parent_id_);
         if (nread < 0) {
             callback_->OnRead((int)nread, nullptr, 0);
             return;
@@ -331,7 +397,6 @@ private:
 
 private:
     uv_loop_t* loop_ = nullptr;
-    struct sockaddr_storage dst_addr_;
     uv_tcp_t* client_            = nullptr;
     uv_connect_t* connect_       = nullptr;
     TcpClientCallback* callback_ = nullptr;
@@ -340,34 +405,41 @@ private:
     size_t buffer_size_ = 10*1024;
     bool is_connect_    = false;
     bool read_start_    = false;
-	int af_family_ = AF_INET;
+    bool tcp_init_      = false;
+    std::shared_ptr<int> alive_ = std::make_shared<int>(0); // guards the resolve callback
+    std::unique_ptr<HappyEyeballsConnector> connector_;
 
 private:
     bool ssl_enable_ = false;
     SslClient* ssl_client_ = nullptr;
 
+private:
+    uint64_t trace_parent_id_ = 0;
+    TraceSpan connect_span_;
+    TraceSpan dns_span_;
+
 private:
     Logger* logger_ = nullptr;
 };
 
-inline void OnUVClientConnected(uv_connect_t *conn, int status) {
-    if (status != 0) {
-        printf("uv connect error:%s, %d.\r\n", uv_strerror(status), status);
-        return;
-    }
-    TcpClient* client = (TcpClient*)conn->data;
+inline void OnUVClientWrite(uv_write_t* req, int status) {
+    TcpClient* client = static_cast<TcpClient*>(req->handle->data);
+
     if (client) {
-        client->OnConnect(status);
+        client->OnWrite((write_req_t*)req, status);
     }
+    return;
 }
 
-inline void OnUVClientWrite(uv_write_t* req, int status) {
+inline void OnUVClientWriteBufs(uv_write_t* req, int status) {
     TcpClient* client = static_cast<TcpClient*>(req->handle->data);
+    write_bufs_req_t* bufs_req = (write_bufs_req_t*)req->data;
 
     if (client) {
-        client->OnWrite((write_req_t*)req, status);
+        client->OnWriteBufs(bufs_req, status);
+        return;
     }
-    return;
+    delete bufs_req;
 }
 
 inline void OnUVClientAlloc(uv_handle_t* handle,
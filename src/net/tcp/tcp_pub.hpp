@@ -19,6 +19,14 @@ typedef struct {
   uv_buf_t buf;
 } write_req_t;
 
+// header and body in one uv_write, the request owns both strings
+typedef struct {
+  uv_write_t req;
+  std::string header;
+  std::string body;
+  uv_buf_t bufs[2];
+} write_bufs_req_t;
+
 class TcpClientCallback
 {
 public:
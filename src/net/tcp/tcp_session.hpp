@@ -196,6 +196,14 @@ public:
         return ss.str();
     }
 
+    // bytes queued in libuv and not yet written to the socket
+    size_t GetWriteQueueSize() {
+        if (close_ || !uv_handle_) {
+            return 0;
+        }
+        return uv_stream_get_write_queue_size(reinterpret_cast<uv_stream_t*>(uv_handle_));
+    }
+
     virtual std::string GetLocalEndpoint() override {
         std::stringstream ss;
         uint16_t localport = 0;
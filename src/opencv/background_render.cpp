@@ -0,0 +1,134 @@
+#include "background_render.h"
+#include "utils/timeex.hpp"
+
+static thread_local RenderDoneFunc s_thread_listener;
+
+BackgroundRender& BackgroundRender::Instance() {
+    static BackgroundRender render;
+    return render;
+}
+
+BackgroundRender::~BackgroundRender() {
+    Stop();
+}
+
+void BackgroundRender::SetThreadListener(RenderDoneFunc func) {
+    s_thread_listener = std::move(func);
+}
+
+RenderDoneFunc BackgroundRender::GetThreadListener() {
+    return s_thread_listener;
+}
+
+cv::Mat BackgroundRender::MakePreview(const cv::Mat& src) {
+    if (src.total() <= (size_t)PREVIEW_MAX_PIXELS) {
+        return src;
+    }
+    double scale = std::sqrt((double)PREVIEW_MAX_PIXELS / src.total());
+    cv::Mat preview;
+    cv::resize(src, preview, cv::Size(), scale, scale, cv::INTER_AREA);
+    return preview;
+}
+
+std::string BackgroundRender::Submit(const cv::Mat& src, const std::string& path, const ImageEncodeParams& encode_params,
+    const std::string& desc, RenderFunc func) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (jobs_.size() >= BACKGROUND_RENDER_MAX_JOBS) {
+        LogWarnf(logger_, "background render queue is full, drop %s for %s", desc.c_str(), path.c_str());
+        return "";
+    }
+    if (!running_) {
+        running_ = true;
+        thread_ = std::thread(&BackgroundRender::OnWork, this);
+    }
+    RenderJob job;
+    job.job_id = "render_" + std::to_string(++job_seq_);
+    job.src = src;
+    job.path = path;
+    job.encode_params = encode_params;
+    job.desc = desc;
+    job.func = std::move(func);
+    job.on_done = s_thread_listener;
+    jobs_.push_back(std::move(job));
+    cond_.notify_one();
+    return jobs_.back().job_id;
+}
+
+bool BackgroundRender::GetCompleted(RenderResult& result) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (completed_.empty()) {
+        return false;
+    }
+    result = completed_.front();
+    completed_.pop();
+    return true;
+}
+
+void BackgroundRender::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+        jobs_.clear();
+        cond_.notify_all();
+    }
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void BackgroundRender::OnWork() {
+    while (true) {
+        RenderJob job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] { return !running_ || !jobs_.empty(); });
+            if (!running_) {
+                return;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+        Render(job.job_id, job.src, job.path, job.encode_params, job.desc, job.func, job.on_done);
+    }
+}
+
+void BackgroundRender::Render(const std::string& job_id, const cv::Mat& src, const std::string& path,
+    const ImageEncodeParams& encode_params, const std::string& desc, const RenderFunc& func,
+    const RenderDoneFunc& on_done) {
+    RenderResult result;
+    result.job_id = job_id;
+    result.path = path;
+    int64_t start_ms = now_millisec();
+
+    cv::Mat dst;
+    int ret = -1;
+    try {
+        ret = func(src, dst);
+    }
+    catch (const std::exception& e) {
+        LogErrorf(logger_, "background render %s exception: %s", job_id.c_str(), e.what());
+    }
+    if (ret < 0 || dst.empty()) {
+        result.code = -1;
+        result.desc = desc + " failed at full resolution, the preview is kept";
+    } else if (ImageWriter::WriteFile(path, dst, encode_params, logger_) < 0) {
+        result.code = -1;
+        result.desc = "Failed to replace the preview with the full resolution image";
+    } else {
+        result.desc = desc + " full resolution image is ready";
+    }
+    result.elapsed_ms = now_millisec() - start_ms;
+    LogInfof(logger_, "background render %s %s, code:%d, elapsed:%lldms",
+        job_id.c_str(), path.c_str(), result.code, (long long)result.elapsed_ms);
+
+    if (on_done) {
+        on_done(result);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (completed_.size() >= BACKGROUND_RENDER_MAX_COMPLETED) {
+        LogWarnf(logger_, "background render results are not collected, drop %s", completed_.front().job_id.c_str());
+        completed_.pop();
+    }
+    completed_.push(result);
+}
@@ -0,0 +1,91 @@
+#ifndef BACKGROUND_RENDER_H
+#define BACKGROUND_RENDER_H
+
+#include "utils/logger.hpp"
+#include "image_writer.h"
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <list>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+using namespace cpp_streamer;
+
+#define PREVIEW_MAX_PIXELS        (1024 * 1024) // preview renders are downscaled to about 1 MP
+#define BACKGROUND_RENDER_MAX_JOBS 16           // full renders waiting, Submit fails above it
+#define BACKGROUND_RENDER_MAX_COMPLETED 64      // results nobody collected, the oldest are dropped above it
+
+typedef std::function<int(const cv::Mat& src, cv::Mat& dst)> RenderFunc;
+
+typedef struct {
+    std::string job_id;
+    std::string path;     // the final file, it replaced the preview when code is 0
+    int code = 0;
+    std::string desc;
+    int64_t elapsed_ms = 0;
+} RenderResult;
+
+typedef std::function<void(const RenderResult& result)> RenderDoneFunc;
+
+// Full resolution renders behind the quick previews of the image tools.
+// Jobs run one after another on a background thread (the filters are
+// parallel inside), the result is written with ImageWriter::WriteFile, which
+// renames a temporary file over the preview, so the path never holds a half
+// written file.
+// A finished job goes to the listener of the thread that submitted it, or
+// else to the queue of GetCompleted.
+class BackgroundRender
+{
+public:
+    static BackgroundRender& Instance();
+
+public:
+    void SetLogger(Logger* logger) { logger_ = logger; }
+    // return the job id, empty when too many jobs are waiting
+    std::string Submit(const cv::Mat& src, const std::string& path, const ImageEncodeParams& encode_params,
+        const std::string& desc, RenderFunc func);
+    bool GetCompleted(RenderResult& result);
+    void Stop();
+    // jobs submitted afterwards on the calling thread report to func, on the
+    // render thread, instead of the GetCompleted queue; nullptr: the queue again
+    static void SetThreadListener(RenderDoneFunc func);
+    static RenderDoneFunc GetThreadListener();
+
+public:
+    // src downscaled to at most PREVIEW_MAX_PIXELS, src itself when it is small enough
+    static cv::Mat MakePreview(const cv::Mat& src);
+
+private:
+    BackgroundRender() = default;
+    ~BackgroundRender();
+    void OnWork();
+    void Render(const std::string& job_id, const cv::Mat& src, const std::string& path,
+        const ImageEncodeParams& encode_params, const std::string& desc, const RenderFunc& func,
+        const RenderDoneFunc& on_done);
+
+private:
+    typedef struct {
+        std::string job_id;
+        cv::Mat src;
+        std::string path;
+        ImageEncodeParams encode_params;
+        std::string desc;
+        RenderFunc func;
+        RenderDoneFunc on_done;
+    } RenderJob;
+
+    Logger* logger_ = nullptr;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::list<RenderJob> jobs_;
+    std::queue<RenderResult> completed_;
+    std::thread thread_;
+    bool running_ = false;
+    uint64_t job_seq_ = 0;
+};
+
+#endif
@@ -0,0 +1,194 @@
+#include "batch_processor.h"
+#include "utils/bounded_queue.hpp"
+#include "utils/timeex.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+typedef struct {
+    size_t index = 0;
+    cv::Mat img;
+} BatchItem;
+
+static bool IsImageFile(const std::filesystem::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)tolower(c); });
+    return ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".bmp"
+        || ext == ".webp" || ext == ".tif" || ext == ".tiff";
+}
+
+static bool WildcardMatch(const char* pattern, const char* name) {
+    if (*pattern == '\0') {
+        return *name == '\0';
+    }
+    if (*pattern == '*') {
+        return WildcardMatch(pattern + 1, name) || (*name != '\0' && WildcardMatch(pattern, name + 1));
+    }
+    if (*name != '\0' && (*pattern == '?' || *pattern == *name)) {
+        return WildcardMatch(pattern + 1, name + 1);
+    }
+    return false;
+}
+
+bool ListBatchFiles(const std::string& pattern, std::vector<std::string>& files, std::string& err_msg) {
+    std::filesystem::path path(pattern);
+    std::filesystem::path dir = path;
+    std::string name_pattern;
+    std::error_code ec;
+    if (!std::filesystem::is_directory(path, ec)) {
+        dir = path.has_parent_path() ? path.parent_path() : std::filesystem::path(".");
+        name_pattern = path.filename().string();
+    }
+    if (!std::filesystem::is_directory(dir, ec)) {
+        err_msg = "Directory not found: " + dir.string();
+        return false;
+    }
+
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        if (!entry.is_regular_file(ec)) {
+            continue;
+        }
+        std::string name = entry.path().filename().string();
+        bool match = name_pattern.empty() ? IsImageFile(entry.path())
+            : WildcardMatch(name_pattern.c_str(), name.c_str());
+        if (match) {
+            files.push_back(entry.path().string());
+        }
+    }
+    if (files.empty()) {
+        err_msg = "No image files match: " + pattern;
+        return false;
+    }
+    if (files.size() > BATCH_MAX_FILES) {
+        err_msg = "Too many files (" + std::to_string(files.size()) + "), the limit is " + std::to_string(BATCH_MAX_FILES);
+        files.clear();
+        return false;
+    }
+    std::sort(files.begin(), files.end());
+    return true;
+}
+
+static std::string BatchOutputPath(const std::string& file, const std::string& output_dir, const std::string& suffix) {
+    std::filesystem::path path(file);
+    std::filesystem::path dir = output_dir.empty() ? path.parent_path() : std::filesystem::path(output_dir);
+    std::string name = path.stem().string() + "_" + suffix + path.extension().string();
+    return (dir / name).string();
+}
+
+int RunBatch(const std::vector<std::string>& files, const std::string& output_dir, const std::string& suffix,
+    const BatchFilterFunc& filter, const BatchOptions& options, BatchSummary& summary, Logger* logger) {
+    summary = BatchSummary();
+    summary.total = files.size();
+    summary.outputs.resize(files.size());
+    if (files.empty()) {
+        return 0;
+    }
+    if (!output_dir.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(output_dir, ec);
+    }
+
+    int64_t start_ms = now_millisec();
+    int decode_threads = std::max(1, options.decode_threads);
+    int workers = options.workers > 0 ? options.workers : (int)std::max(1u, std::thread::hardware_concurrency());
+    int encode_threads = std::max(1, options.encode_threads);
+
+    BoundedQueue<BatchItem> decoded(options.queue_depth);
+    BoundedQueue<BatchItem> filtered(options.queue_depth);
+    std::atomic<size_t> next_file(0);
+    std::atomic<int> decoders_left(decode_threads);
+    std::atomic<int> workers_left(workers);
+    std::atomic<size_t> succeeded(0);
+    std::mutex error_mutex;
+    auto add_error = [&](const std::string& err) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        summary.errors.push_back(err);
+        LogErrorf(logger, "batch: %s", err.c_str());
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < decode_threads; i++) {
+        threads.emplace_back([&]() {
+            size_t index;
+            while ((index = next_file.fetch_add(1)) < files.size()) {
+                BatchItem item;
+                item.index = index;
+                try {
+                    item.img = cv::imread(files[index], cv::IMREAD_COLOR);
+                }
+                catch (const std::exception& e) {
+                    add_error("Failed to load image: " + files[index] + ": " + e.what());
+                    continue;
+                }
+                if (item.img.empty()) {
+                    add_error("Failed to load image: " + files[index]);
+                    continue;
+                }
+                decoded.Push(std::move(item));
+            }
+            // the last decoder lets the workers drain and stop
+            if (--decoders_left == 0) {
+                decoded.Close();
+            }
+        });
+    }
+    for (int i = 0; i < workers; i++) {
+        threads.emplace_back([&]() {
+            BatchItem item;
+            while (decoded.Pop(item)) {
+                BatchItem out;
+                out.index = item.index;
+                int ret = -1;
+                try {
+                    ret = filter(item.img, out.img);
+                }
+                catch (const std::exception& e) {
+                    add_error("Filter failed for " + files[item.index] + ": " + e.what());
+                    continue;
+                }
+                item.img.release();
+                if (ret < 0 || out.img.empty()) {
+                    add_error("Filter failed for " + files[item.index]);
+                    continue;
+                }
+                filtered.Push(std::move(out));
+            }
+            if (--workers_left == 0) {
+                filtered.Close();
+            }
+        });
+    }
+    for (int i = 0; i < encode_threads; i++) {
+        threads.emplace_back([&]() {
+            BatchItem item;
+            while (filtered.Pop(item)) {
+                std::string output_path = BatchOutputPath(files[item.index], output_dir, suffix);
+                // imwrite throws for an extension without a writer
+                try {
+                    if (!cv::imwrite(output_path, item.img)) {
+                        add_error("Failed to save output image: " + output_path);
+                        continue;
+                    }
+                }
+                catch (const std::exception& e) {
+                    add_error("Failed to save output image: " + output_path + ": " + e.what());
+                    continue;
+                }
+                summary.outputs[item.index] = output_path;
+                succeeded++;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    summary.succeeded = succeeded.load();
+    summary.elapsed_ms = now_millisec() - start_ms;
+    LogInfof(logger, "batch done, files:%zu, succeeded:%zu, elapsed:%lldms, decode:%d, workers:%d, encode:%d",
+        summary.total, summary.succeeded, (long long)summary.elapsed_ms, decode_threads, workers, encode_threads);
+    return summary.succeeded == summary.total ? 0 : -1;
+}
@@ -0,0 +1,45 @@
+#ifndef BATCH_PROCESSOR_H
+#define BATCH_PROCESSOR_H
+
+#include "utils/logger.hpp"
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace cpp_streamer;
+
+#define BATCH_MAX_FILES     1000
+#define BATCH_QUEUE_DEPTH   4     // decoded / filtered images waiting between two stages
+
+typedef std::function<int(const cv::Mat& src, cv::Mat& dst)> BatchFilterFunc;
+
+typedef struct {
+    int decode_threads = 2;
+    int workers        = 0;       // 0: hardware concurrency
+    int encode_threads = 2;
+    size_t queue_depth = BATCH_QUEUE_DEPTH;
+} BatchOptions;
+
+typedef struct {
+    size_t total     = 0;
+    size_t succeeded = 0;
+    int64_t elapsed_ms = 0;
+    std::vector<std::string> outputs;  // in input order, empty for failed files
+    std::vector<std::string> errors;
+} BatchSummary;
+
+// Files of a directory (image extensions only) or of a glob with * and ? in
+// the file name part, sorted, at most BATCH_MAX_FILES.
+bool ListBatchFiles(const std::string& pattern, std::vector<std::string>& files, std::string& err_msg);
+
+// Three stage pipeline over the files: decode threads -> filter workers ->
+// encode threads, with bounded queues between the stages so decoding and
+// encoding overlap with the filters and at most a few images per stage are
+// held in memory. Every output is written to output_dir (the file's own
+// directory when empty) as <stem>_<suffix><ext>.
+int RunBatch(const std::vector<std::string>& files, const std::string& output_dir, const std::string& suffix,
+    const BatchFilterFunc& filter, const BatchOptions& options, BatchSummary& summary, Logger* logger);
+
+#endif
@@ -0,0 +1,394 @@
+#include "color_lut.h"
+#include <opencv2/core/hal/intrin.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+cv::Mat ColorLut::MakeGrid(int size) {
+    cv::Mat grid(size * size, size, CV_8UC3);
+    for (int r = 0; r < size; r++) {
+        for (int g = 0; g < size; g++) {
+            cv::Vec3b* row = grid.ptr<cv::Vec3b>(r * size + g);
+            for (int b = 0; b < size; b++) {
+                row[b] = cv::Vec3b(
+                    cv::saturate_cast<uchar>(b * 255.0 / (size - 1)),
+                    cv::saturate_cast<uchar>(g * 255.0 / (size - 1)),
+                    cv::saturate_cast<uchar>(r * 255.0 / (size - 1)));
+            }
+        }
+    }
+    return grid;
+}
+
+bool ColorLut::Compile(int size, const std::function<void(cv::Mat&)>& transform) {
+    if (size < 2) {
+        return false;
+    }
+    cv::Mat grid = MakeGrid(size);
+    transform(grid);
+    if (grid.type() != CV_8UC3 || (int)grid.total() != size * size * size) {
+        return false;
+    }
+
+    std::vector<float> table(size * size * size * 3);
+    size_t pos = 0;
+    for (int row = 0; row < grid.rows; row++) {
+        const uchar* p = grid.ptr<uchar>(row);
+        for (int col = 0; col < grid.cols * 3; col++) {
+            table[pos++] = p[col];
+        }
+    }
+    return SetTable(size, table);
+}
+
+bool ColorLut::SetTable(int size, const std::vector<float>& table) {
+    if (size < 2 || table.size() != (size_t)size * size * size * 3) {
+        return false;
+    }
+    size_ = size;
+    table_ = table;
+    return true;
+}
+
+bool ColorLut::LoadCube(const std::string& path, std::string& err_msg) {
+    std::ifstream file(path);
+    if (!file) {
+        err_msg = "Failed to open LUT file: " + path;
+        return false;
+    }
+    int size = 0;
+    std::vector<float> cube;
+    std::string line;
+    int line_no = 0;
+    while (std::getline(file, line)) {
+        line_no++;
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') {
+            continue;
+        }
+        std::istringstream line_stream(line.substr(start));
+        if (isalpha((unsigned char)line[start])) {
+            std::string keyword;
+            line_stream >> keyword;
+            if (keyword == "LUT_3D_SIZE") {
+                line_stream >> size;
+                if (size < 2 || size > COLOR_LUT_MAX_SIZE) {
+                    err_msg = "Unsupported LUT_3D_SIZE in " + path;
+                    return false;
+                }
+                cube.reserve((size_t)size * size * size * 3);
+            } else if (keyword == "DOMAIN_MIN" || keyword == "DOMAIN_MAX") {
+                float expect = keyword == "DOMAIN_MIN" ? 0.0f : 1.0f;
+                float v[3] = { expect, expect, expect };
+                line_stream >> v[0] >> v[1] >> v[2];
+                if (v[0] != expect || v[1] != expect || v[2] != expect) {
+                    err_msg = "Only the 0..1 input domain is supported: " + path;
+                    return false;
+                }
+            } else if (keyword == "LUT_1D_SIZE") {
+                err_msg = "1D LUTs are not supported: " + path;
+                return false;
+            }
+            // TITLE and unknown keywords are ignored
+            continue;
+        }
+        float r = 0, g = 0, b = 0;
+        if (!(line_stream >> r >> g >> b)) {
+            err_msg = "Bad LUT row at line " + std::to_string(line_no) + " of " + path;
+            return false;
+        }
+        cube.push_back(r);
+        cube.push_back(g);
+        cube.push_back(b);
+    }
+    if (size == 0 || cube.size() != (size_t)size * size * size * 3) {
+        err_msg = "LUT_3D_SIZE and row count do not match in " + path;
+        return false;
+    }
+
+    // .cube rows: r fastest, then g, then b; the table: b fastest, BGR triples in [0, 255]
+    std::vector<float> table(cube.size());
+    size_t count = (size_t)size * size * size;
+    for (size_t i = 0; i < count; i++) {
+        size_t r = i % size;
+        size_t g = (i / size) % size;
+        size_t b = i / ((size_t)size * size);
+        float* node = &table[((r * size + g) * size + b) * 3];
+        node[0] = std::min(1.0f, std::max(0.0f, cube[i * 3 + 2])) * 255.0f;
+        node[1] = std::min(1.0f, std::max(0.0f, cube[i * 3 + 1])) * 255.0f;
+        node[2] = std::min(1.0f, std::max(0.0f, cube[i * 3 + 0])) * 255.0f;
+    }
+    return SetTable(size, table);
+}
+
+// pixels whose cells are looked up at once before the interpolation, a multiple of the vector width
+#define COLOR_LUT_CHUNK 256
+
+static inline void TrilinearPixel(const float* c000, int step_b, int step_g, int step_r,
+    float fb, float fg, float fr, uchar* d) {
+    const float* c001 = c000 + step_b;
+    const float* c010 = c000 + step_g;
+    const float* c011 = c010 + step_b;
+    const float* c100 = c000 + step_r;
+    const float* c101 = c100 + step_b;
+    const float* c110 = c100 + step_g;
+    const float* c111 = c110 + step_b;
+    for (int c = 0; c < 3; c++) {
+        float c00 = c000[c] + (c001[c] - c000[c]) * fb;
+        float c01 = c010[c] + (c011[c] - c010[c]) * fb;
+        float c10 = c100[c] + (c101[c] - c100[c]) * fb;
+        float c11 = c110[c] + (c111[c] - c110[c]) * fb;
+        float c0 = c00 + (c01 - c00) * fg;
+        float c1 = c10 + (c11 - c10) * fg;
+        d[c] = cv::saturate_cast<uchar>(c0 + (c1 - c0) * fr);
+    }
+}
+
+static inline void TetrahedralPixel(const float* c000, int step_b, int step_g, int step_r,
+    float fb, float fg, float fr, uchar* d) {
+    // the cell is split into 6 tetrahedra along the main diagonal,
+    // the order of the fractions picks the two inner corners
+    const float* c111 = c000 + step_r + step_g + step_b;
+    const float* c1;
+    const float* c2;
+    float w0, w1, w2, w3;
+    if (fr > fg) {
+        if (fg > fb) {
+            c1 = c000 + step_r; c2 = c000 + step_r + step_g;
+            w0 = 1 - fr; w1 = fr - fg; w2 = fg - fb; w3 = fb;
+        } else if (fr > fb) {
+            c1 = c000 + step_r; c2 = c000 + step_r + step_b;
+            w0 = 1 - fr; w1 = fr - fb; w2 = fb - fg; w3 = fg;
+        } else {
+            c1 = c000 + step_b; c2 = c000 + step_r + step_b;
+            w0 = 1 - fb; w1 = fb - fr; w2 = fr - fg; w3 = fg;
+        }
+    } else {
+        if (fb > fg) {
+            c1 = c000 + step_b; c2 = c000 + step_g + step_b;
+            w0 = 1 - fb; w1 = fb - fg; w2 = fg - fr; w3 = fr;
+        } else if (fb > fr) {
+            c1 = c000 + step_g; c2 = c000 + step_g + step_b;
+            w0 = 1 - fg; w1 = fg - fb; w2 = fb - fr; w3 = fr;
+        } else {
+            c1 = c000 + step_g; c2 = c000 + step_r + step_g;
+            w0 = 1 - fg; w1 = fg - fr; w2 = fr - fb; w3 = fb;
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        d[c] = cv::saturate_cast<uchar>(w0 * c000[c] + w1 * c1[c] + w2 * c2[c] + w3 * c111[c]);
+    }
+}
+
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+// the table offsets of the cell corners, steps are per axis and for the whole diagonal
+typedef struct {
+    int b;
+    int g;
+    int r;
+} LutSteps;
+
+static inline cv::v_float32 Lerp(const cv::v_float32& a, const cv::v_float32& b, const cv::v_float32& t) {
+    return cv::v_add(a, cv::v_mul(cv::v_sub(b, a), t));
+}
+
+// 4 float vectors of one channel, rounded and saturated into 8 bit lanes
+static inline cv::v_uint8 PackLanes(const cv::v_int32& a, const cv::v_int32& b,
+    const cv::v_int32& c, const cv::v_int32& d) {
+    return cv::v_pack_u(cv::v_pack(a, b), cv::v_pack(c, d));
+}
+
+// one channel of a float vector of pixels; the 8 corners are gathered from the table
+static inline cv::v_int32 TrilinearLanes(const float* table, const LutSteps& steps,
+    const int* offset, const float* fb, const float* fg, const float* fr) {
+    cv::v_int32 i000 = cv::vx_load(offset);
+    cv::v_int32 i010 = cv::v_add(i000, cv::vx_setall_s32(steps.g));
+    cv::v_int32 i100 = cv::v_add(i000, cv::vx_setall_s32(steps.r));
+    cv::v_int32 i110 = cv::v_add(i100, cv::vx_setall_s32(steps.g));
+    cv::v_int32 vb = cv::vx_setall_s32(steps.b);
+    cv::v_float32 wb = cv::vx_load(fb);
+    cv::v_float32 wg = cv::vx_load(fg);
+    cv::v_float32 c00 = Lerp(cv::v_lut(table, i000), cv::v_lut(table, cv::v_add(i000, vb)), wb);
+    cv::v_float32 c01 = Lerp(cv::v_lut(table, i010), cv::v_lut(table, cv::v_add(i010, vb)), wb);
+    cv::v_float32 c10 = Lerp(cv::v_lut(table, i100), cv::v_lut(table, cv::v_add(i100, vb)), wb);
+    cv::v_float32 c11 = Lerp(cv::v_lut(table, i110), cv::v_lut(table, cv::v_add(i110, vb)), wb);
+    cv::v_float32 c0 = Lerp(c00, c01, wg);
+    cv::v_float32 c1 = Lerp(c10, c11, wg);
+    return cv::v_round(Lerp(c0, c1, cv::vx_load(fr)));
+}
+
+// one channel of a float vector of pixels. The tetrahedron is picked without branches:
+// the inner corners step along the axis of the largest fraction, then along the
+// middle one, which is the whole diagonal minus the axis of the smallest fraction.
+// Ties give a zero weight to the corner that differs from the scalar choice.
+static inline cv::v_int32 TetrahedralLanes(const float* table, const LutSteps& steps,
+    const int* offset, const float* fb, const float* fg, const float* fr) {
+    cv::v_float32 vfb = cv::vx_load(fb);
+    cv::v_float32 vfg = cv::vx_load(fg);
+    cv::v_float32 vfr = cv::vx_load(fr);
+    cv::v_float32 fmax = cv::v_max(vfr, cv::v_max(vfg, vfb));
+    cv::v_float32 fmin = cv::v_min(vfr, cv::v_min(vfg, vfb));
+    cv::v_float32 fmid = cv::v_max(cv::v_min(vfr, vfg), cv::v_min(cv::v_max(vfr, vfg), vfb));
+
+    cv::v_int32 vb = cv::vx_setall_s32(steps.b);
+    cv::v_int32 vg = cv::vx_setall_s32(steps.g);
+    cv::v_int32 vr = cv::vx_setall_s32(steps.r);
+    cv::v_int32 vdiag = cv::vx_setall_s32(steps.b + steps.g + steps.r);
+    cv::v_int32 r_max = cv::v_reinterpret_as_s32(cv::v_and(cv::v_ge(vfr, vfg), cv::v_ge(vfr, vfb)));
+    cv::v_int32 g_max = cv::v_reinterpret_as_s32(cv::v_ge(vfg, vfb));
+    cv::v_int32 b_min = cv::v_reinterpret_as_s32(cv::v_and(cv::v_le(vfb, vfg), cv::v_le(vfb, vfr)));
+    cv::v_int32 g_min = cv::v_reinterpret_as_s32(cv::v_le(vfg, vfr));
+    cv::v_int32 step_max = cv::v_select(r_max, vr, cv::v_select(g_max, vg, vb));
+    cv::v_int32 step_min = cv::v_select(b_min, vb, cv::v_select(g_min, vg, vr));
+
+    cv::v_int32 i000 = cv::vx_load(offset);
+    cv::v_int32 i1 = cv::v_add(i000, step_max);
+    cv::v_int32 i2 = cv::v_add(i000, cv::v_sub(vdiag, step_min));
+    cv::v_int32 i111 = cv::v_add(i000, vdiag);
+    cv::v_float32 w0 = cv::v_sub(cv::vx_setall_f32(1.0f), fmax);
+    cv::v_float32 w1 = cv::v_sub(fmax, fmid);
+    cv::v_float32 w2 = cv::v_sub(fmid, fmin);
+    cv::v_float32 sum = cv::v_add(cv::v_mul(w0, cv::v_lut(table, i000)), cv::v_mul(w1, cv::v_lut(table, i1)));
+    sum = cv::v_add(sum, cv::v_mul(w2, cv::v_lut(table, i2)));
+    sum = cv::v_add(sum, cv::v_mul(fmin, cv::v_lut(table, i111)));
+    return cv::v_round(sum);
+}
+
+typedef cv::v_int32 (*LutLanesFunc)(const float*, const LutSteps&, const int*, const float*, const float*, const float*);
+
+// interpolates n looked up pixels into d, a full 8 bit vector of pixels per step;
+// returns the number of pixels done, the rest is left to the scalar tail
+template <LutLanesFunc lanes_func>
+static int ApplyLanes(const float* table, const LutSteps& steps, const int* offset,
+    const float* fb, const float* fg, const float* fr, uchar* d, int n) {
+    const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+    const int pixels = cv::VTraits<cv::v_uint8>::vlanes();
+    int x = 0;
+    for (; x <= n - pixels; x += pixels) {
+        const int i0 = x, i1 = x + lanes, i2 = x + lanes * 2, i3 = x + lanes * 3;
+        cv::v_uint8 ob = PackLanes(
+            lanes_func(table, steps, offset + i0, fb + i0, fg + i0, fr + i0),
+            lanes_func(table, steps, offset + i1, fb + i1, fg + i1, fr + i1),
+            lanes_func(table, steps, offset + i2, fb + i2, fg + i2, fr + i2),
+            lanes_func(table, steps, offset + i3, fb + i3, fg + i3, fr + i3));
+        cv::v_uint8 og = PackLanes(
+            lanes_func(table + 1, steps, offset + i0, fb + i0, fg + i0, fr + i0),
+            lanes_func(table + 1, steps, offset + i1, fb + i1, fg + i1, fr + i1),
+            lanes_func(table + 1, steps, offset + i2, fb + i2, fg + i2, fr + i2),
+            lanes_func(table + 1, steps, offset + i3, fb + i3, fg + i3, fr + i3));
+        cv::v_uint8 orr = PackLanes(
+            lanes_func(table + 2, steps, offset + i0, fb + i0, fg + i0, fr + i0),
+            lanes_func(table + 2, steps, offset + i1, fb + i1, fg + i1, fr + i1),
+            lanes_func(table + 2, steps, offset + i2, fb + i2, fg + i2, fr + i2),
+            lanes_func(table + 2, steps, offset + i3, fb + i3, fg + i3, fr + i3));
+        cv::v_store_interleave(d + x * 3, ob, og, orr);
+    }
+    return x;
+}
+#endif
+
+void ColorLut::Apply(const cv::Mat& src, cv::Mat& dst, ColorLutInterp interp) const {
+    CV_Assert(src.type() == CV_8UC3 && size_ >= 2);
+
+    // grid cell and position inside it for every 8-bit value
+    int index[256];
+    float frac[256];
+    for (int v = 0; v < 256; v++) {
+        float pos = v * (size_ - 1) / 255.0f;
+        index[v] = std::min((int)pos, size_ - 2);
+        frac[v] = pos - index[v];
+    }
+
+    const int size = size_;
+    const float* table = table_.data();
+    const int step_b = 3;
+    const int step_g = size * 3;
+    const int step_r = size * size * 3;
+
+    dst.create(src.size(), CV_8UC3);
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& range) {
+        // each chunk is looked up first, then interpolated a vector of pixels at a time
+        int offset[COLOR_LUT_CHUNK];
+        float fb[COLOR_LUT_CHUNK];
+        float fg[COLOR_LUT_CHUNK];
+        float fr[COLOR_LUT_CHUNK];
+        for (int y = range.start; y < range.end; y++) {
+            const uchar* s = src.ptr<uchar>(y);
+            uchar* d = dst.ptr<uchar>(y);
+            for (int x0 = 0; x0 < src.cols; x0 += COLOR_LUT_CHUNK, s += COLOR_LUT_CHUNK * 3, d += COLOR_LUT_CHUNK * 3) {
+                const int n = std::min(COLOR_LUT_CHUNK, src.cols - x0);
+                for (int i = 0; i < n; i++) {
+                    const uchar* p = s + i * 3;
+                    offset[i] = index[p[2]] * step_r + index[p[1]] * step_g + index[p[0]] * step_b;
+                    fb[i] = frac[p[0]];
+                    fg[i] = frac[p[1]];
+                    fr[i] = frac[p[2]];
+                }
+
+                int i = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+                const LutSteps steps = { step_b, step_g, step_r };
+                if (interp == COLOR_LUT_TETRAHEDRAL) {
+                    i = ApplyLanes<TetrahedralLanes>(table, steps, offset, fb, fg, fr, d, n);
+                } else {
+                    i = ApplyLanes<TrilinearLanes>(table, steps, offset, fb, fg, fr, d, n);
+                }
+#endif
+                for (; i < n; i++) {
+                    if (interp == COLOR_LUT_TETRAHEDRAL) {
+                        TetrahedralPixel(table + offset[i], step_b, step_g, step_r, fb[i], fg[i], fr[i], d + i * 3);
+                    } else {
+                        TrilinearPixel(table + offset[i], step_b, step_g, step_r, fb[i], fg[i], fr[i], d + i * 3);
+                    }
+                }
+            }
+        }
+    });
+}
+
+ColorLutCache& ColorLutCache::Instance() {
+    static ColorLutCache cache;
+    return cache;
+}
+
+std::shared_ptr<const ColorLut> ColorLutCache::Get(const std::string& path, std::string& err_msg) {
+    std::error_code ec;
+    auto write_time = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        err_msg = "LUT file not found: " + path;
+        return nullptr;
+    }
+    int64_t mtime = (int64_t)write_time.time_since_epoch().count();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(path);
+        if (it != entries_.end() && it->second.mtime == mtime) {
+            it->second.last_use = ++use_count_;
+            return it->second.lut;
+        }
+    }
+
+    // parsed outside the lock, two threads may parse the same file once each
+    std::shared_ptr<ColorLut> lut = std::make_shared<ColorLut>();
+    if (!lut->LoadCube(path, err_msg)) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    CacheEntry& entry = entries_[path];
+    entry.lut = lut;
+    entry.mtime = mtime;
+    entry.last_use = ++use_count_;
+    while (entries_.size() > COLOR_LUT_CACHE_MAX) {
+        auto oldest = entries_.begin();
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->second.last_use < oldest->second.last_use) {
+                oldest = it;
+            }
+        }
+        entries_.erase(oldest);
+    }
+    return lut;
+}
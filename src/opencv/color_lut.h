@@ -0,0 +1,78 @@
+#ifndef COLOR_LUT_H
+#define COLOR_LUT_H
+
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+#include <functional>
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#define COLOR_LUT_DEF_SIZE   33      // grid nodes per axis
+#define COLOR_LUT_MAX_SIZE   129     // largest LUT_3D_SIZE accepted from a .cube file
+#define COLOR_LUT_DIR        "luts"  // catalog of .cube looks, the tool also takes a file path
+#define COLOR_LUT_CACHE_MAX  32      // parsed .cube files kept in memory
+
+enum ColorLutInterp {
+    COLOR_LUT_TRILINEAR,  // 8 nodes
+    COLOR_LUT_TETRAHEDRAL // 4 nodes, fewer loads and the usual choice for grading LUTs
+};
+
+// 3D color lookup table over BGR.
+// A chain of per-pixel color operations is compiled once by running it on the
+// size^3 grid colors (or loaded from a .cube file), then applied to an image
+// in one pass with trilinear or tetrahedral interpolation between grid nodes.
+class ColorLut
+{
+public:
+    ColorLut() = default;
+    ~ColorLut() = default;
+
+public:
+    // transform: any per-pixel BGR 8UC3 -> BGR 8UC3 chain, it is called on the grid image
+    bool Compile(int size, const std::function<void(cv::Mat&)>& transform);
+    // table: size^3 BGR triples in [0, 255], b varies fastest then g then r
+    bool SetTable(int size, const std::vector<float>& table);
+    // Adobe/Resolve .cube text: LUT_3D_SIZE, optional DOMAIN_MIN/MAX of 0 1, r g b rows with r fastest
+    bool LoadCube(const std::string& path, std::string& err_msg);
+    void Apply(const cv::Mat& src, cv::Mat& dst, ColorLutInterp interp = COLOR_LUT_TRILINEAR) const;
+    bool Empty() const { return size_ == 0; }
+    int Size() const { return size_; }
+
+public:
+    // the grid colors in table order, size*size rows of size pixels
+    static cv::Mat MakeGrid(int size);
+
+private:
+    int size_ = 0;
+    std::vector<float> table_;
+};
+
+// Parsed .cube files by path, reloaded when the file changes.
+class ColorLutCache
+{
+public:
+    static ColorLutCache& Instance();
+
+public:
+    std::shared_ptr<const ColorLut> Get(const std::string& path, std::string& err_msg);
+
+private:
+    ColorLutCache() = default;
+    ~ColorLutCache() = default;
+
+private:
+    typedef struct {
+        std::shared_ptr<const ColorLut> lut;
+        int64_t mtime = 0;
+        uint64_t last_use = 0;
+    } CacheEntry;
+
+    std::mutex mutex_;
+    std::map<std::string, CacheEntry> entries_; // key: path
+    uint64_t use_count_ = 0;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#include "face_detector.h"
+
+#include <fstream>
+#include <sstream>
+
+using namespace cpp_streamer;
+
+FaceDetector& FaceDetector::Instance() {
+    static FaceDetector detector;
+    return detector;
+}
+
+bool FaceDetector::Init(const std::string& cascade_path, Logger* logger) {
+    std::ifstream file(cascade_path, std::ios::binary);
+    if (!file) {
+        LogErrorf(logger, "Failed to open face cascade: %s", cascade_path.c_str());
+        return false;
+    }
+    std::stringstream xml_stream;
+    xml_stream << file.rdbuf();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    cascade_path_ = cascade_path;
+    cascade_xml_ = xml_stream.str();
+    generation_++;
+    LogInfof(logger, "Face cascade loaded: %s, bytes:%zu", cascade_path.c_str(), cascade_xml_.length());
+    return true;
+}
+
+void FaceDetector::SetParams(const FaceDetectParams& params) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    params_ = params;
+}
+
+FaceDetectParams FaceDetector::GetParams() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return params_;
+}
+
+cv::CascadeClassifier* FaceDetector::GetThreadClassifier(Logger* logger) {
+    thread_local cv::CascadeClassifier classifier;
+    thread_local uint64_t classifier_generation = 0;
+
+    std::string cascade_xml;
+    uint64_t generation = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (generation_ == classifier_generation && !classifier.empty()) {
+            return &classifier;
+        }
+        generation = generation_;
+        cascade_xml = cascade_xml_;
+    }
+    if (generation == 0) {
+        // not initialized at startup
+        if (!Init(FACE_CASCADE_FILE, logger)) {
+            return nullptr;
+        }
+        return GetThreadClassifier(logger);
+    }
+
+    cv::FileStorage fs(cascade_xml, cv::FileStorage::READ | cv::FileStorage::MEMORY);
+    if (!fs.isOpened() || !classifier.read(fs.getFirstTopLevelNode())) {
+        LogErrorf(logger, "Failed to parse face cascade in memory");
+        return nullptr;
+    }
+    classifier_generation = generation;
+    return &classifier;
+}
+
+int FaceDetector::Detect(const cv::Mat& bgr, std::vector<cv::Rect>& faces, Logger* logger) {
+    faces.clear();
+    cv::CascadeClassifier* classifier = GetThreadClassifier(logger);
+    if (!classifier) {
+        return -1;
+    }
+    FaceDetectParams params = GetParams();
+
+    // scan a downscaled copy, the cascade cost grows with the pixel count
+    cv::Mat gray;
+    cv::cvtColor(bgr, gray, cv::COLOR_BGR2GRAY);
+    double scale = 1.0;
+    int max_dim = std::max(gray.cols, gray.rows);
+    if (params.max_detect_dim > 0 && max_dim > params.max_detect_dim) {
+        scale = (double)params.max_detect_dim / max_dim;
+        cv::resize(gray, gray, cv::Size(), scale, scale, cv::INTER_AREA);
+    }
+    int min_size = std::max(1, cvRound(params.min_face_size * scale));
+
+    std::vector<cv::Rect> small_faces;
+    classifier->detectMultiScale(gray, small_faces, params.scale_factor, params.min_neighbors, 0, cv::Size(min_size, min_size));
+
+    cv::Rect bounds(0, 0, bgr.cols, bgr.rows);
+    for (const auto& face : small_faces) {
+        cv::Rect full_face(cvRound(face.x / scale), cvRound(face.y / scale),
+            cvRound(face.width / scale), cvRound(face.height / scale));
+        full_face &= bounds;
+        if (!full_face.empty()) {
+            faces.push_back(full_face);
+        }
+    }
+    return 0;
+}
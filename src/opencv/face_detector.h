@@ -0,0 +1,54 @@
+#ifndef FACE_DETECTOR_H
+#define FACE_DETECTOR_H
+
+#include "utils/logger.hpp"
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+
+using namespace cpp_streamer;
+
+#define FACE_CASCADE_FILE "haarcascade_frontalface_default.xml"
+
+typedef struct {
+    double scale_factor = 1.1;
+    int min_neighbors   = 3;
+    int min_face_size   = 100; // pixels of the full resolution image
+    int max_detect_dim  = 640; // longest side of the grayscale copy the cascade scans, 0: full resolution
+} FaceDetectParams;
+
+// Process-wide frontal face detector.
+// The cascade xml is read from disk once, every thread parses its own
+// CascadeClassifier from the in-memory copy (detectMultiScale is not
+// safe to call concurrently on one instance).
+class FaceDetector
+{
+public:
+    static FaceDetector& Instance();
+
+public:
+    // load at startup, otherwise FACE_CASCADE_FILE is loaded on first Detect
+    bool Init(const std::string& cascade_path, Logger* logger);
+    void SetParams(const FaceDetectParams& params);
+    FaceDetectParams GetParams();
+
+public:
+    // faces in full resolution coordinates of the BGR image
+    int Detect(const cv::Mat& bgr, std::vector<cv::Rect>& faces, Logger* logger);
+
+private:
+    FaceDetector() = default;
+    ~FaceDetector() = default;
+    cv::CascadeClassifier* GetThreadClassifier(Logger* logger);
+
+private:
+    std::mutex mutex_;
+    std::string cascade_path_;
+    std::string cascade_xml_;
+    uint64_t generation_ = 0; // bumped by Init, thread classifiers of an older generation are reloaded
+    FaceDetectParams params_;
+};
+
+#endif
@@ -1,9 +1,13 @@
 #include "image_process.h"
+#include "face_detector.h"
+#include "overlay.h"
+#include "color_lut.h"
+#include "tile_executor.h"
 #include "utils/logger.hpp"
 
 using namespace cpp_streamer;
 
-cv::Mat cartoonifyImage(cv::Mat src, int edgeThreshold = 90);
+cv::Mat cartoonifyImage(cv::Mat src, int edgeThreshold = 90, SmoothQuality quality = SMOOTH_BEST);
 
 int ConvertColorImg2GrayImg(const char* inputPath, const char* outputPath, Logger* logger) {
     // 1. Read color image
@@ -13,15 +17,11 @@ int ConvertColorImg2GrayImg(const char* inputPath, const char* outputPath, Logge
         return -1;
     }
 
-    // 2. Convert to grayscale image
-    cv::Mat gray;
-    cv::cvtColor(src, gray, cv::COLOR_BGR2GRAY);
-
-    // 3. Gaussian blur for noise reduction
+    // 2. Convert and blur
     cv::Mat blurred;
-    cv::GaussianBlur(gray, blurred, cv::Size(3, 3), 0);
+    ConvertColorImg2GrayImg(src, blurred, logger);
 
-    // 4. Save processing result
+    // 3. Save processing result
     bool saved = cv::imwrite(outputPath, blurred);
     if (!saved) {
         LogErrorf(logger, "write output file error, output:%s", outputPath);
@@ -30,6 +30,69 @@ int ConvertColorImg2GrayImg(const char* inputPath, const char* outputPath, Logge
 	return 0;
 }
 
+static int GrayFilterTile(const cv::Mat& src, cv::Mat& dst) {
+    // 1. Convert to grayscale image
+    cv::Mat gray;
+    cv::cvtColor(src, gray, cv::COLOR_BGR2GRAY);
+
+    // 2. Gaussian blur for noise reduction
+    cv::GaussianBlur(gray, dst, cv::Size(3, 3), 0);
+    return 0;
+}
+
+int ConvertColorImg2GrayImg(const cv::Mat& src, cv::Mat& dst, Logger* logger) {
+    if (TileExecutor::ShouldTile(src)) {
+        return TileExecutor().Run(src, dst, CV_8UC1, 1, GrayFilterTile, logger);
+    }
+    return GrayFilterTile(src, dst);
+}
+
+// Fixed-point weights of the fused beauty blend.
+// The HSV saturation/value scaling is done in BGR: with V = max(B,G,R), scaling
+// S by sat_scale and V by val_scale (V clipped at 255) keeps the hue and gives
+//   c' = min(val_scale, 255 / V) * ((1 - sat_scale) * V + sat_scale * c)
+typedef struct {
+    int sat_q8;              // sat_scale, Q8
+    int scale_q12[256];      // min(val_scale, 255 / V), Q12, indexed by V
+} BeautyBlendParams;
+
+static BeautyBlendParams MakeBeautyBlendParams(float smoothStrength) {
+    BeautyBlendParams params;
+    double sat_scale = 0.95 - 0.2 * smoothStrength; // Lower saturation for whiter skin
+    double val_scale = 1.08 + 0.2 * smoothStrength; // Increase brightness
+    params.sat_q8 = cvRound(std::min(1.0, std::max(0.0, sat_scale)) * 256);
+    params.scale_q12[0] = 0;
+    for (int v = 1; v < 256; v++) {
+        params.scale_q12[v] = cvRound(std::min(val_scale, 255.0 / v) * 4096);
+    }
+    return params;
+}
+
+// One row of the beauty blend: skin pixels (mask > 128) get
+// 0.7 * bilateral + 0.3 * (1.5 * src - 0.5 * gaussian), then every pixel gets the whitening.
+static void BeautyBlendRow(const BeautyBlendParams& params, const uchar* src, const uchar* bilateral,
+    const uchar* gaussian, const uchar* mask, uchar* dst, int cols) {
+    const int sat_q8 = params.sat_q8;
+    for (int x = 0; x < cols; x++, src += 3, bilateral += 3, gaussian += 3, dst += 3) {
+        int c[3] = { src[0], src[1], src[2] };
+        if (mask[x] > 128) {
+            for (int i = 0; i < 3; i++) {
+                int highpass = (3 * src[i] - gaussian[i] + 1) >> 1;
+                highpass = highpass < 0 ? 0 : (highpass > 255 ? 255 : highpass);
+                // 0.7 weight for smoothing, 0.3 for details
+                c[i] = (179 * bilateral[i] + 77 * highpass + 128) >> 8;
+            }
+        }
+        int v = std::max(c[0], std::max(c[1], c[2]));
+        int scale_q12 = params.scale_q12[v];
+        for (int i = 0; i < 3; i++) {
+            int t = (256 - sat_q8) * v + sat_q8 * c[i];
+            int out = (t * scale_q12 + (1 << 19)) >> 20;
+            dst[i] = (uchar)(out > 255 ? 255 : out);
+        }
+    }
+}
+
 // Beauty filter function: Implements skin smoothing and wrinkle reduction
 int ApplyBeautyFilter(const std::string& inputPath, const std::string& outputPath, float smoothStrength, Logger* logger) {
     // 1. Read the input image
@@ -39,63 +102,62 @@ int ApplyBeautyFilter(const std::string& inputPath, const std::string& outputPat
         return -1;
     }
 
+    cv::Mat beauty;
+    ApplyBeautyFilter(src, beauty, smoothStrength, logger);
+
+    // 7. Save the result
+    if (!cv::imwrite(outputPath, beauty)) {
+        LogErrorf(logger, "Failed to save output image: %s", outputPath.c_str());
+        return -2;
+    }
+    LogInfof(logger, "Beauty filter applied successfully, output saved to: %s", outputPath.c_str());
+    return 0;
+}
+
+static int BeautyFilterTile(const cv::Mat& src, cv::Mat& dst, float smoothStrength, SmoothQuality quality) {
     // 2. Skin region detection (simple skin color mask, more advanced methods can be used in practice)
     cv::Mat ycrcb, skinMask;
     cv::cvtColor(src, ycrcb, cv::COLOR_BGR2YCrCb);
     cv::inRange(ycrcb, cv::Scalar(0, 133, 77), cv::Scalar(255, 173, 127), skinMask);
     cv::GaussianBlur(skinMask, skinMask, cv::Size(5, 5), 0);
 
-    // 3. Bilateral filtering (skin smoothing, preserves edges)
+    // 3. Bilateral filtering or its guided filter approximation (skin smoothing, preserves edges)
     int d = cvRound(8 + smoothStrength * 10);
     double sigmaColor = 50 + smoothStrength * 50;
     double sigmaSpace = 20 + smoothStrength * 20;
     cv::Mat bilateral;
-    cv::bilateralFilter(src, bilateral, d, sigmaColor, sigmaSpace);
+    EdgePreservingSmooth(src, bilateral, d, sigmaColor, sigmaSpace, quality);
 
-    // 4. High-pass filtering (enhance details, prevent loss of facial features)
-    cv::Mat gaussian, highpass;
+    // 4. Low-pass image for the high-pass detail term (enhance details, prevent loss of facial features)
+    cv::Mat gaussian;
     int ksize = cvRound(3 + smoothStrength * 4) | 1;
     cv::GaussianBlur(src, gaussian, cv::Size(ksize, ksize), 0);
-    cv::addWeighted(src, 1.5, gaussian, -0.5, 0, highpass);
-
-    // 5. Blending: apply smoothing + high-pass only to skin regions, keep original for non-skin regions
-    cv::Mat beauty = src.clone();
-    for (int y = 0; y < src.rows; ++y) {
-        for (int x = 0; x < src.cols; ++x) {
-            if (skinMask.at<uchar>(y, x) > 128) {
-                // Blend smoothing and high-pass
-                cv::Vec3b b = bilateral.at<cv::Vec3b>(y, x);
-                cv::Vec3b h = highpass.at<cv::Vec3b>(y, x);
-                // 0.7 weight for smoothing, 0.3 for details
-                beauty.at<cv::Vec3b>(y, x) = cv::Vec3b(
-                    cv::saturate_cast<uchar>(b[0] * 0.7 + h[0] * 0.3),
-                    cv::saturate_cast<uchar>(b[1] * 0.7 + h[1] * 0.3),
-                    cv::saturate_cast<uchar>(b[2] * 0.7 + h[2] * 0.3)
-                );
-            }
-        }
-    }
 
-    // 6. Whitening and brightening (increase brightness and slight whitening)
-    cv::Mat hsv;
-    cv::cvtColor(beauty, hsv, cv::COLOR_BGR2HSV);
-    std::vector<cv::Mat> hsvChannels;
-    cv::split(hsv, hsvChannels);
-    hsvChannels[1] = hsvChannels[1] * (0.95 - 0.2 * smoothStrength); // Lower saturation for whiter skin
-    hsvChannels[2] = hsvChannels[2] * (1.08 + 0.2 * smoothStrength); // Increase brightness
-    cv::merge(hsvChannels, hsv);
-    cv::cvtColor(hsv, beauty, cv::COLOR_HSV2BGR);
+    // 5. + 6. Skin blend and whitening/brightening in one pass
+    dst.create(src.size(), CV_8UC3);
+    BeautyBlendParams params = MakeBeautyBlendParams(smoothStrength);
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            BeautyBlendRow(params, src.ptr<uchar>(y), bilateral.ptr<uchar>(y), gaussian.ptr<uchar>(y),
+                skinMask.ptr<uchar>(y), dst.ptr<uchar>(y), src.cols);
+        }
+    });
+    return 0;
+}
 
-    // 7. Save the result
-    if (!cv::imwrite(outputPath, beauty)) {
-        LogErrorf(logger, "Failed to save output image: %s", outputPath.c_str());
-        return -2;
+int ApplyBeautyFilter(const cv::Mat& src, cv::Mat& dst, float smoothStrength, Logger* logger, SmoothQuality quality) {
+    if (TileExecutor::ShouldTile(src)) {
+        // widest kernel is the smoothing: bilateral radius d/2, the guided filter's
+        // two box passes reach d, plus the resize support of the fast mode
+        int halo = cvRound(8 + smoothStrength * 10) + 8;
+        return TileExecutor().Run(src, dst, CV_8UC3, halo, [&](const cv::Mat& tile, cv::Mat& tile_dst) {
+            return BeautyFilterTile(tile, tile_dst, smoothStrength, quality);
+        }, logger);
     }
-    LogInfof(logger, "Beauty filter applied successfully, output saved to: %s", outputPath.c_str());
-    return 0;
+    return BeautyFilterTile(src, dst, smoothStrength, quality);
 }
 
-cv::Mat cartoonifyImage(cv::Mat src, int edgeThreshold)
+cv::Mat cartoonifyImage(cv::Mat src, int edgeThreshold, SmoothQuality quality)
 {
     // 1. Edge detection (extract outlines)
     cv::Mat gray, edges;
@@ -107,7 +169,7 @@ cv::Mat cartoonifyImage(cv::Mat src, int edgeThreshold)
 
     // 2. Color simplification (smoothing + quantization)
     cv::Mat smooth;
-    cv::bilateralFilter(src, smooth, 15, 80, 80);       // Edge-preserving smoothing
+    EdgePreservingSmooth(src, smooth, 15, 80, 80, quality); // Edge-preserving smoothing
     cv::Mat cartoon;
     cv::bitwise_and(smooth, edges, cartoon);            // Combine smoothed image with edges
 
@@ -115,20 +177,14 @@ cv::Mat cartoonifyImage(cv::Mat src, int edgeThreshold)
 }
 
 // Add sun glasses for a person
-int addSunGlasses(cv::Mat& src, cv::Mat& sunglasses)
+int addSunGlasses(cv::Mat& src, cv::Mat& sunglasses, Logger* logger)
 {
-    // Load the frontal-face Haar cascade
-    cv::CascadeClassifier faceCascade;
-    if (!faceCascade.load("haarcascade_frontalface_default.xml")) {
+    // Detect faces with the shared frontal-face Haar cascade
+    std::vector<cv::Rect> faces;
+    if (FaceDetector::Instance().Detect(src, faces, logger) < 0) {
         return -1;
     }
 
-    // Detect faces
-    std::vector<cv::Rect> faces;
-    cv::Mat gray;
-    cv::cvtColor(src, gray, cv::COLOR_BGR2GRAY);
-    faceCascade.detectMultiScale(gray, faces, 1.1, 3, 0, cv::Size(100, 100));
-
     for (auto& face : faces)
     {
         // Estimate eye region: upper third of the face
@@ -140,31 +196,39 @@ int addSunGlasses(cv::Mat& src, cv::Mat& sunglasses)
             eyeWidth,
             eyeHeight);
 
-        // Resize sunglasses to fit the estimated eye region
-        cv::Mat resizedSunglasses;
-        cv::resize(sunglasses, resizedSunglasses, eyeROI.size());
-
-        // Overlay using alpha channel (assume sunglasses is 4-channel BGRA)
-        cv::Mat roi = src(eyeROI);
-        for (int c = 0; c < 3; ++c)
-        {
-            for (int i = 0; i < eyeROI.height; ++i)
-            {
-                for (int j = 0; j < eyeROI.width; ++j)
-                {
-                    uchar alpha = resizedSunglasses.data[i * resizedSunglasses.step + j * 4 + 3];
-                    if (alpha > 10) // non-transparent area
-                    {
-                        roi.data[i * roi.step + j * 3 + c] =
-                            resizedSunglasses.data[i * resizedSunglasses.step + j * 4 + c];
-                    }
-                }
-            }
-        }
+        // Resize sunglasses to fit the estimated eye region and blend with its alpha channel,
+        // the part outside the image is clipped
+        OverlayRGBA(src, sunglasses, eyeROI, OVERLAY_PREMULTIPLIED);
     }
     return 0;
 }
 
+// BGRA sunglasses: SUNGLASSES_FILE when it is present, otherwise two tinted
+// lenses with a bridge are drawn once. The cached image is premultiplied by its alpha.
+static const cv::Mat& GetSunGlassesImage(Logger* logger)
+{
+    static const cv::Mat sunglasses = [logger]() {
+        cv::Mat img = cv::imread(SUNGLASSES_FILE, cv::IMREAD_UNCHANGED);
+        if (!img.empty() && img.type() == CV_8UC4) {
+            LogInfof(logger, "Sunglasses image loaded: %s", SUNGLASSES_FILE);
+            PremultiplyRGBA(img, img);
+            return img;
+        }
+        LogInfof(logger, "No BGRA %s, draw the sunglasses", SUNGLASSES_FILE);
+        img = cv::Mat(100, 300, CV_8UC4, cv::Scalar(0, 0, 0, 0));
+        cv::Scalar frame(20, 20, 20, 255);
+        cv::Scalar lens(40, 30, 30, 220);
+        cv::ellipse(img, cv::Point(75, 50), cv::Size(62, 40), 0, 0, 360, lens, cv::FILLED, cv::LINE_AA);
+        cv::ellipse(img, cv::Point(225, 50), cv::Size(62, 40), 0, 0, 360, lens, cv::FILLED, cv::LINE_AA);
+        cv::ellipse(img, cv::Point(75, 50), cv::Size(62, 40), 0, 0, 360, frame, 6, cv::LINE_AA);
+        cv::ellipse(img, cv::Point(225, 50), cv::Size(62, 40), 0, 0, 360, frame, 6, cv::LINE_AA);
+        cv::line(img, cv::Point(137, 42), cv::Point(163, 42), frame, 8, cv::LINE_AA);
+        PremultiplyRGBA(img, img);
+        return img;
+    }();
+    return sunglasses;
+}
+
 
 // make picture cartoon style
 int ApplyCartoonFilter(const std::string& inputPath, const std::string& outputPath, Logger* logger) {
@@ -175,7 +239,8 @@ int ApplyCartoonFilter(const std::string& inputPath, const std::string& outputPa
 		return -1;
 	}
 	// 2. Apply cartoon effect
-	cv::Mat cartoon = cartoonifyImage(src, 10);
+	cv::Mat cartoon;
+	ApplyCartoonFilter(src, cartoon, logger);
 	// 3. Save result
 	if (!cv::imwrite(outputPath, cartoon)) {
 		LogErrorf(logger, "Failed to save output image: %s", outputPath.c_str());
@@ -185,6 +250,19 @@ int ApplyCartoonFilter(const std::string& inputPath, const std::string& outputPa
 	return 0;
 }
 
+int ApplyCartoonFilter(const cv::Mat& src, cv::Mat& dst, Logger* logger, SmoothQuality quality) {
+	if (TileExecutor::ShouldTile(src)) {
+		// smoothing d = 15 (guided filter reach 14), median 7 and the Canny sobel,
+		// Canny's hysteresis may differ slightly at the seams
+		return TileExecutor().Run(src, dst, CV_8UC3, 24, [quality](const cv::Mat& tile, cv::Mat& tile_dst) {
+			tile_dst = cartoonifyImage(tile, 10, quality);
+			return 0;
+		}, logger);
+	}
+	dst = cartoonifyImage(src, 10, quality);
+	return 0;
+}
+
 // add sun glasses for a person
 int ApplySunGlasses(const std::string& inputPath, const std::string& outputPath, Logger* logger) {
 	// 1. Load input image
@@ -193,11 +271,29 @@ int ApplySunGlasses(const std::string& inputPath, const std::string& outputPath,
 		LogErrorf(logger, "Failed to load image: %s", inputPath.c_str());
 		return -1;
 	}
+	cv::Mat dst;
+	int ret = ApplySunGlasses(src, dst, logger);
+	if (ret < 0) {
+		return ret;
+	}
+
+	// 3. Save result
+	if (!cv::imwrite(outputPath, dst)) {
+		LogErrorf(logger, "Failed to save output image: %s", outputPath.c_str());
+		return -2;
+	}
+	return 0;
+}
+
+int ApplySunGlasses(const cv::Mat& src, cv::Mat& dst, Logger* logger) {
+	// the glasses are drawn into a copy, src may be shared with the image store
+	dst = src.clone();
+
 	// 2. Load sunglasses image (with alpha channel)
-    cv::Mat sunglasses;
+    cv::Mat sunglasses = GetSunGlassesImage(logger);
 
 	try {
-        int ret = addSunGlasses(src, sunglasses);
+        int ret = addSunGlasses(dst, sunglasses, logger);
         if (ret < 0) {
             LogErrorf(logger, "Failed to add sunglasses, err:%d", ret);
             return ret;
@@ -207,72 +303,119 @@ int ApplySunGlasses(const std::string& inputPath, const std::string& outputPath,
 		LogErrorf(logger, "Exception loading sunglasses image: %s", e.what());
 		return -1;
 	}
-
-	// 3. Save result
-	if (!cv::imwrite(outputPath, sunglasses)) {
-		LogErrorf(logger, "Failed to save output image: %s", outputPath.c_str());
-		return -2;
-	}
 	return 0;
 }
 
-int ConvertImage2CyberPunkStyle(const std::string& inputPath, const std::string& outputPath, Logger* logger) {
-    try {
-        // Read the input image
-        cv::Mat img = cv::imread(inputPath);
-        if (img.empty()) {
-            LogErrorf(logger, "Unable to read image: %s:", inputPath.c_str());
-        }
+// min/max of the four normalize steps of the cyberpunk color stages
+typedef struct {
+    double min_value[4] = { 0, 0, 0, 0 };
+    double max_value[4] = { 0, 0, 0, 0 };
+} CyberPunkRanges;
 
-        // Resize image for consistent processing while maintaining aspect ratio
-        int maxDim = 1000;
-        int height = img.rows;
-        int width = img.cols;
+// normalize(NORM_MINMAX) to [0, 255] with a measured or a given input range
+static void NormalizeRange(cv::Mat& channel, CyberPunkRanges& ranges, int index, bool measure) {
+    if (measure) {
+        cv::minMaxLoc(channel, &ranges.min_value[index], &ranges.max_value[index]);
+    }
+    double range = ranges.max_value[index] - ranges.min_value[index];
+    double scale = range > DBL_EPSILON ? 255.0 / range : 0;
+    channel.convertTo(channel, -1, scale, -ranges.min_value[index] * scale);
+}
 
-        if (std::max(height, width) > maxDim) {
-            double scale = static_cast<double>(maxDim) / std::max(height, width);
-            cv::resize(img, img, cv::Size(static_cast<int>(width * scale), static_cast<int>(height * scale)));
-        }
+// Per-pixel color stages of the cyberpunk style, img: BGR in and out
+static void CyberPunkColorStages(cv::Mat& img, CyberPunkRanges& ranges, bool measure) {
+    // Convert to HSV color space for easier color manipulation
+    cv::Mat hsv;
+    cv::cvtColor(img, hsv, cv::COLOR_BGR2HSV);
 
-        // Convert to HSV color space for easier color manipulation
-        cv::Mat hsv;
-        cv::cvtColor(img, hsv, cv::COLOR_BGR2HSV);
+    // Split HSV channels and adjust saturation
+    std::vector<cv::Mat> hsvChannels;
+    cv::split(hsv, hsvChannels);
 
-        // Split HSV channels and adjust saturation
-        std::vector<cv::Mat> hsvChannels;
-        cv::split(hsv, hsvChannels);
+    // Increase saturation for more vibrant colors
+    hsvChannels[1] += 50;
+    NormalizeRange(hsvChannels[1], ranges, 0, measure);
 
-        // Increase saturation for more vibrant colors
-        hsvChannels[1] += 50;
-        cv::normalize(hsvChannels[1], hsvChannels[1], 0, 255, cv::NORM_MINMAX);
+    // Merge HSV channels and convert back to BGR
+    cv::merge(hsvChannels, hsv);
+    cv::cvtColor(hsv, img, cv::COLOR_HSV2BGR);
 
-        // Merge HSV channels and convert back to BGR
-        cv::merge(hsvChannels, hsv);
-        cv::cvtColor(hsv, img, cv::COLOR_HSV2BGR);
+    // Split BGR channels to create cyberpunk color profile
+    std::vector<cv::Mat> bgrChannels;
+    cv::split(img, bgrChannels);
 
-        // Split BGR channels to create cyberpunk color profile
-        std::vector<cv::Mat> bgrChannels;
-        cv::split(img, bgrChannels);
+    // Enhance blue channel (signature cyberpunk blue tone)
+    bgrChannels[0] += 30;
+    NormalizeRange(bgrChannels[0], ranges, 1, measure);
 
-        // Enhance blue channel (signature cyberpunk blue tone)
-        bgrChannels[0] += 30;
-        cv::normalize(bgrChannels[0], bgrChannels[0], 0, 255, cv::NORM_MINMAX);
+    // Reduce green channel to increase contrast
+    bgrChannels[1] -= 20;
+    NormalizeRange(bgrChannels[1], ranges, 2, measure);
 
-        // Reduce green channel to increase contrast
-        bgrChannels[1] -= 20;
-        cv::normalize(bgrChannels[1], bgrChannels[1], 0, 255, cv::NORM_MINMAX);
+    // Enhance red channel (neon effect)
+    bgrChannels[2] += 10;
+    NormalizeRange(bgrChannels[2], ranges, 3, measure);
 
-        // Enhance red channel (neon effect)
-        bgrChannels[2] += 10;
-        cv::normalize(bgrChannels[2], bgrChannels[2], 0, 255, cv::NORM_MINMAX);
+    // Merge BGR channels back
+    cv::merge(bgrChannels, img);
 
-        // Merge BGR channels back
-        cv::merge(bgrChannels, img);
+    // Increase contrast and adjust brightness
+    double alpha = 1.4;  // Contrast gain
+    int beta = -50;      // Brightness offset
+    img.convertTo(img, -1, alpha, beta);
+}
 
-        // Increase contrast and adjust brightness
-        double alpha = 1.4;  // Contrast gain
-        int beta = -50;      // Brightness offset
-        img.convertTo(img, -1, alpha, beta);
+int ConvertImage2CyberPunkStyle(const std::string& inputPath, const std::string& outputPath, Logger* logger) {
+    // Read the input image
+    cv::Mat src = cv::imread(inputPath);
+    if (src.empty()) {
+        LogErrorf(logger, "Unable to read image: %s:", inputPath.c_str());
+        return -1;
+    }
+    cv::Mat img;
+    int ret = ConvertImage2CyberPunkStyle(src, img, logger);
+    if (ret < 0) {
+        return ret;
+    }
+
+    // Save image if output path is provided
+    if (!outputPath.empty()) {
+        cv::imwrite(outputPath, img);
+        LogInfof(logger, "Cyberpunk style image saved to: %s", outputPath.c_str());
+    }
+    return 0;
+}
+
+int ConvertImage2CyberPunkStyle(const cv::Mat& src, cv::Mat& img, Logger* logger) {
+    try {
+        // Resize image for consistent processing while maintaining aspect ratio
+        int maxDim = 1000;
+        int height = src.rows;
+        int width = src.cols;
+
+        cv::Mat resized = src;
+        if (std::max(height, width) > maxDim) {
+            double scale = static_cast<double>(maxDim) / std::max(height, width);
+            cv::resize(src, resized, cv::Size(static_cast<int>(width * scale), static_cast<int>(height * scale)));
+        }
+
+        // The color stages are a fixed function of the pixel color once the
+        // normalize ranges are known: measure the ranges on a subsample, compile
+        // the stages into a 3D LUT and map the image in one pass
+        // (img is written from here on, src may be shared with the image store)
+        cv::Mat sample = resized;
+        if (resized.rows >= 64 && resized.cols >= 64) {
+            cv::resize(resized, sample, cv::Size(), 0.25, 0.25, cv::INTER_NEAREST);
+        }
+        CyberPunkRanges ranges;
+        cv::Mat sample_out = sample.clone();
+        CyberPunkColorStages(sample_out, ranges, true);
+
+        ColorLut lut;
+        lut.Compile(COLOR_LUT_DEF_SIZE, [&ranges](cv::Mat& grid) {
+            CyberPunkColorStages(grid, ranges, false);
+        });
+        lut.Apply(resized, img);
 
         // Add glow effect
         cv::Mat glow;
@@ -284,12 +427,6 @@ int ConvertImage2CyberPunkStyle(const std::string& inputPath, const std::string&
             -1, 9, -1,
             -1, -1, -1);
         cv::filter2D(img, img, -1, kernel);
-
-        // Save image if output path is provided
-        if (!outputPath.empty()) {
-            cv::imwrite(outputPath, img);
-            LogInfof(logger, "Cyberpunk style image saved to: %s", outputPath.c_str());
-        }
     }
     catch (const std::exception& e) {
         LogErrorf(logger, "Error processing image: %s", e.what());
@@ -2,12 +2,15 @@
 #define IMAGE_PROCESS_H
 
 #include "utils/logger.hpp"
+#include "smooth.h"
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui_c.h>
 #include <string>
 
 using namespace cpp_streamer;
 
+#define SUNGLASSES_FILE "sunglasses.png" // BGRA, drawn in code when missing
+
 //Image Processing Function: Converts a color image to a grayscale image and performs edge detection
 int ConvertColorImg2GrayImg(const char* inputPath, const char* outputPath, Logger* logger);
 
@@ -23,4 +26,13 @@ int ApplySunGlasses(const std::string& inputPath, const std::string& outputPath,
 // Converts an image to cyberpunk style 
 int ConvertImage2CyberPunkStyle(const std::string& inputPath, const std::string& outputPath, Logger* logger);
 
+// In-memory versions of the filters above, used with ImageStore handles.
+// src is never written, it may be shared with the image store.
+// quality picks the edge preserving smoothing used by the beauty and cartoon filters.
+int ConvertColorImg2GrayImg(const cv::Mat& src, cv::Mat& dst, Logger* logger);
+int ApplyBeautyFilter(const cv::Mat& src, cv::Mat& dst, float smoothStrength, Logger* logger, SmoothQuality quality = SMOOTH_BEST);
+int ApplyCartoonFilter(const cv::Mat& src, cv::Mat& dst, Logger* logger, SmoothQuality quality = SMOOTH_BEST);
+int ApplySunGlasses(const cv::Mat& src, cv::Mat& dst, Logger* logger);
+int ConvertImage2CyberPunkStyle(const cv::Mat& src, cv::Mat& dst, Logger* logger);
+
 #endif
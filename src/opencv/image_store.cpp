@@ -0,0 +1,294 @@
+#include "image_store.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+using namespace cpp_streamer;
+
+ImageStore& ImageStore::Instance() {
+    static ImageStore store;
+    return store;
+}
+
+ImageStore::ImageStore() {
+    // one directory per process: the handle numbers restart in every process
+    char token[17];
+    snprintf(token, sizeof(token), "%08x%08x", std::random_device()(), std::random_device()());
+    std::string name = std::to_string((int)getpid()) + "_" + token;
+
+    std::error_code ec;
+    std::filesystem::path tmp_dir = std::filesystem::temp_directory_path(ec);
+    spill_dir_ = ec ? ("cpp_aiagent_images_" + name) : (tmp_dir / "cpp_aiagent_images" / name).string();
+}
+
+ImageStore::~ImageStore() {
+    RemoveSpillDir();
+}
+
+void ImageStore::RemoveSpillDir() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        ImageEntry& entry = it->second;
+        if (entry.spill_path.empty()) {
+            it++;
+            continue;
+        }
+        std::error_code ec;
+        std::filesystem::remove(entry.spill_path, ec);
+        entry.spill_path.clear();
+        if (entry.img.empty()) {
+            // only on disk, it is gone now
+            lru_.erase(entry.lru_it);
+            it = entries_.erase(it);
+            continue;
+        }
+        it++;
+    }
+    // only when empty, a directory given to SetSpillDir may hold other files
+    std::error_code ec;
+    std::filesystem::remove(spill_dir_, ec);
+}
+
+std::string ImageStore::GetSpillDir() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return spill_dir_;
+}
+
+void ImageStore::SetBudget(size_t budget_bytes) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    budget_bytes_ = budget_bytes;
+    Evict("", lock);
+}
+
+void ImageStore::SetSpillDir(const std::string& spill_dir) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    spill_dir_ = spill_dir;
+}
+
+bool ImageStore::IsHandle(const std::string& name) {
+    return name.compare(0, strlen(IMAGE_HANDLE_PREFIX), IMAGE_HANDLE_PREFIX) == 0;
+}
+
+std::string ImageStore::Put(const cv::Mat& img, const std::string& origin) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    std::string handle = IMAGE_HANDLE_PREFIX + std::to_string(++next_id_);
+    lru_.push_front(handle);
+
+    ImageEntry& entry = entries_[handle];
+    entry.img = img;
+    entry.origin = origin;
+    entry.bytes = img.total() * img.elemSize();
+    entry.lru_it = lru_.begin();
+    memory_bytes_ += entry.bytes;
+
+    while (entries_.size() > IMAGE_STORE_MAX_IMAGES) {
+        Drop(entries_.find(lru_.back()));
+    }
+    Evict(handle, lock);
+    return handle;
+}
+
+bool ImageStore::Get(const std::string& handle, cv::Mat& img, std::string* origin) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        auto it = entries_.find(handle);
+        if (it == entries_.end()) {
+            return false;
+        }
+        ImageEntry& entry = it->second;
+        if (!entry.img.empty()) {
+            Touch(entry);
+            img = entry.img;
+            if (origin) {
+                *origin = entry.origin;
+            }
+            break;
+        }
+        if (entry.reloading) {
+            reload_cond_.wait(lock);
+            continue;
+        }
+
+        // read without the lock, the entry is looked up again afterwards: it may have been dropped
+        entry.reloading = true;
+        std::string spill_path = entry.spill_path;
+        size_t bytes = entry.bytes;
+        lock.unlock();
+        cv::Mat loaded;
+        bool ok = Reload(handle, spill_path, bytes, loaded);
+        lock.lock();
+
+        reload_cond_.notify_all();
+        it = entries_.find(handle);
+        if (it == entries_.end()) {
+            return false;
+        }
+        it->second.reloading = false;
+        if (!ok) {
+            return false;
+        }
+        // the spill file is kept, evicting the image again costs no write
+        it->second.img = loaded;
+        memory_bytes_ += bytes;
+    }
+    Evict(handle, lock);
+    return true;
+}
+
+void ImageStore::Remove(const std::string& handle) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(handle);
+    if (it != entries_.end()) {
+        Drop(it);
+    }
+}
+
+size_t ImageStore::MemoryBytes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return memory_bytes_;
+}
+
+void ImageStore::Touch(ImageEntry& entry) {
+    lru_.splice(lru_.begin(), lru_, entry.lru_it);
+}
+
+void ImageStore::Evict(const std::string& keep_handle, std::unique_lock<std::mutex>& lock) {
+    // walk from the least recently used, the image just put or got stays in memory.
+    // Images with a spill file are released at once, the others are written first
+    std::vector<SpillJob> jobs;
+    for (auto lru_it = lru_.rbegin(); lru_it != lru_.rend() && memory_bytes_ - spilling_bytes_ > budget_bytes_; ++lru_it) {
+        if (*lru_it == keep_handle) {
+            continue;
+        }
+        ImageEntry& entry = entries_[*lru_it];
+        if (entry.img.empty() || entry.spilling) {
+            continue;
+        }
+        if (!entry.spill_path.empty()) {
+            entry.img.release();
+            memory_bytes_ -= entry.bytes;
+            continue;
+        }
+        SpillJob job;
+        job.handle = *lru_it;
+        job.img = entry.img;
+        job.spill_path = spill_dir_ + "/" + lru_it->substr(strlen(IMAGE_HANDLE_PREFIX)) + ".mat";
+        job.bytes = entry.bytes;
+        jobs.push_back(job);
+        entry.spilling = true;
+        spilling_bytes_ += entry.bytes;
+    }
+    if (jobs.empty()) {
+        return;
+    }
+
+    std::vector<bool> written(jobs.size());
+    lock.unlock();
+    for (size_t index = 0; index < jobs.size(); index++) {
+        written[index] = Spill(jobs[index]);
+    }
+    lock.lock();
+
+    for (size_t index = 0; index < jobs.size(); index++) {
+        const SpillJob& job = jobs[index];
+        auto it = entries_.find(job.handle);
+        if (it == entries_.end()) {
+            // dropped while it was written, Drop took it out of spilling_bytes_
+            std::error_code ec;
+            std::filesystem::remove(job.spill_path, ec);
+            continue;
+        }
+        ImageEntry& entry = it->second;
+        entry.spilling = false;
+        spilling_bytes_ -= job.bytes;
+        if (!written[index]) {
+            continue;
+        }
+        entry.spill_path = job.spill_path;
+        // a Get may have used it meanwhile, it is still released while over the budget
+        if (memory_bytes_ > budget_bytes_ && !entry.img.empty()) {
+            entry.img.release();
+            memory_bytes_ -= entry.bytes;
+        }
+        LogInfof(logger_, "ImageStore spilled %s, bytes:%zu, memory:%zu, budget:%zu",
+            job.handle.c_str(), job.bytes, memory_bytes_, budget_bytes_);
+    }
+}
+
+bool ImageStore::Spill(const SpillJob& job) {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(job.spill_path).parent_path(), ec);
+
+    // raw pixels: no codec cost and no quality loss
+    std::ofstream file(job.spill_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        LogErrorf(logger_, "ImageStore open spill file error, path:%s", job.spill_path.c_str());
+        return false;
+    }
+    int32_t header[3] = { job.img.rows, job.img.cols, job.img.type() };
+    file.write((const char*)header, sizeof(header));
+    size_t row_bytes = job.img.cols * job.img.elemSize();
+    for (int row = 0; row < job.img.rows; row++) {
+        file.write((const char*)job.img.ptr(row), row_bytes);
+    }
+    if (!file) {
+        LogErrorf(logger_, "ImageStore write spill file error, path:%s", job.spill_path.c_str());
+        file.close();
+        std::filesystem::remove(job.spill_path, ec);
+        return false;
+    }
+    return true;
+}
+
+bool ImageStore::Reload(const std::string& handle, const std::string& spill_path, size_t bytes, cv::Mat& img) {
+    std::ifstream file(spill_path, std::ios::binary);
+    if (!file) {
+        LogErrorf(logger_, "ImageStore open spill file error, path:%s", spill_path.c_str());
+        return false;
+    }
+    int32_t header[3] = { 0, 0, 0 };
+    file.read((char*)header, sizeof(header));
+    // a valid Mat type whose size matches the image that was spilled, before allocating
+    int type = header[2];
+    if (!file || header[0] <= 0 || header[1] <= 0 || type < 0 || type != CV_MAT_TYPE(type)
+        || (uint64_t)header[0] * (uint64_t)header[1] * CV_ELEM_SIZE(type) != (uint64_t)bytes) {
+        LogErrorf(logger_, "ImageStore bad spill file, path:%s", spill_path.c_str());
+        return false;
+    }
+    img.create(header[0], header[1], type);
+    file.read((char*)img.data, bytes);
+    if (!file) {
+        LogErrorf(logger_, "ImageStore read spill file error, path:%s", spill_path.c_str());
+        img.release();
+        return false;
+    }
+    LogInfof(logger_, "ImageStore reloaded %s, bytes:%zu", handle.c_str(), bytes);
+    return true;
+}
+
+void ImageStore::Drop(std::map<std::string, ImageEntry>::iterator it) {
+    ImageEntry& entry = it->second;
+    if (!entry.img.empty()) {
+        memory_bytes_ -= entry.bytes;
+    }
+    if (entry.spilling) {
+        spilling_bytes_ -= entry.bytes;
+    }
+    if (!entry.spill_path.empty()) {
+        std::error_code ec;
+        std::filesystem::remove(entry.spill_path, ec);
+    }
+    lru_.erase(entry.lru_it);
+    entries_.erase(it);
+}
@@ -0,0 +1,91 @@
+#ifndef IMAGE_STORE_H
+#define IMAGE_STORE_H
+
+#include "utils/logger.hpp"
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <list>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+
+using namespace cpp_streamer;
+
+#define IMAGE_HANDLE_PREFIX        "img://"
+#define IMAGE_STORE_DEF_BUDGET     ((size_t)1024*1024*1024) // decoded pixels kept in memory, the rest is spilled
+#define IMAGE_STORE_MAX_IMAGES     1024                     // handles kept in memory and on disk together
+
+// Decoded images shared between tools under "img://<id>" handles, so a chain
+// of tools does not decode and re-encode a JPEG at every step.
+// The least recently used images are spilled to disk as raw pixels when the
+// byte budget is exceeded and loaded back on the next Get. The file I/O runs
+// outside the store lock, other handles stay usable meanwhile.
+// Images are immutable: Get returns a shared cv::Mat, tools write a new Mat.
+class ImageStore
+{
+public:
+    static ImageStore& Instance();
+
+public:
+    void SetBudget(size_t budget_bytes);
+    void SetSpillDir(const std::string& spill_dir);
+    std::string GetSpillDir();
+    // delete the spill files and the spill directory, images only on disk are dropped;
+    // called by the destructor, a process leaving with _exit calls it itself
+    void RemoveSpillDir();
+    void SetLogger(Logger* logger) { logger_ = logger; }
+
+public:
+    // origin: file the image was first read from, used to place saved files
+    std::string Put(const cv::Mat& img, const std::string& origin);
+    bool Get(const std::string& handle, cv::Mat& img, std::string* origin = nullptr);
+    void Remove(const std::string& handle);
+    size_t MemoryBytes();
+    static bool IsHandle(const std::string& name);
+
+private:
+    ImageStore();
+    ~ImageStore();
+
+private:
+    typedef struct {
+        cv::Mat img;            // empty when spilled
+        std::string origin;
+        std::string spill_path; // set once written to disk
+        size_t bytes = 0;
+        bool spilling = false;  // the file is being written, img stays until it is done
+        bool reloading = false; // the file is being read, other Gets wait for it
+        std::list<std::string>::iterator lru_it;
+    } ImageEntry;
+
+    typedef struct {
+        std::string handle;
+        cv::Mat img;
+        std::string spill_path;
+        size_t bytes = 0;
+    } SpillJob;
+
+    void Touch(ImageEntry& entry);
+    // called and returns with the lock held, it is released while spill files are written
+    void Evict(const std::string& keep_handle, std::unique_lock<std::mutex>& lock);
+    // without the lock
+    bool Spill(const SpillJob& job);
+    bool Reload(const std::string& handle, const std::string& spill_path, size_t bytes, cv::Mat& img);
+    void Drop(std::map<std::string, ImageEntry>::iterator it);
+
+private:
+    std::mutex mutex_;
+    std::condition_variable reload_cond_;
+    std::map<std::string, ImageEntry> entries_; // key: handle
+    std::list<std::string> lru_;                // front: most recently used
+    size_t memory_bytes_ = 0;
+    size_t spilling_bytes_ = 0;                 // part of memory_bytes_ being written out
+    size_t budget_bytes_ = IMAGE_STORE_DEF_BUDGET;
+    std::string spill_dir_;
+    uint64_t next_id_ = 0;
+    Logger* logger_ = nullptr;
+};
+
+#endif
@@ -0,0 +1,188 @@
+#include "image_writer.h"
+#include "utils/timeex.hpp"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+
+std::string ApplyImageFormat(const std::string& path, const ImageEncodeParams& params) {
+    if (params.format.empty()) {
+        return path;
+    }
+    std::string format = params.format[0] == '.' ? params.format : "." + params.format;
+    return std::filesystem::path(path).replace_extension(format).string();
+}
+
+std::vector<int> ImageEncodeFlags(const std::string& ext, const ImageEncodeParams& params) {
+    std::string lower = ext;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return (char)tolower(c); });
+    std::vector<int> flags;
+    if (lower == ".jpg" || lower == ".jpeg") {
+        if (params.quality > 0) {
+            flags.insert(flags.end(), { cv::IMWRITE_JPEG_QUALITY, std::min(100, params.quality) });
+        }
+        if (params.progressive) {
+            flags.insert(flags.end(), { cv::IMWRITE_JPEG_PROGRESSIVE, 1 });
+        }
+        if (params.chroma_subsampling == 444) {
+            flags.insert(flags.end(), { cv::IMWRITE_JPEG_SAMPLING_FACTOR, cv::IMWRITE_JPEG_SAMPLING_FACTOR_444 });
+        } else if (params.chroma_subsampling == 422) {
+            flags.insert(flags.end(), { cv::IMWRITE_JPEG_SAMPLING_FACTOR, cv::IMWRITE_JPEG_SAMPLING_FACTOR_422 });
+        } else if (params.chroma_subsampling == 420) {
+            flags.insert(flags.end(), { cv::IMWRITE_JPEG_SAMPLING_FACTOR, cv::IMWRITE_JPEG_SAMPLING_FACTOR_420 });
+        }
+    } else if (lower == ".png") {
+        int level = params.png_compression;
+        if (level < 0 && params.quality > 0) {
+            // lossless either way: high quality asks for speed, low quality for size
+            level = 9 - std::min(100, params.quality) * 9 / 100;
+        }
+        if (level >= 0) {
+            flags.insert(flags.end(), { cv::IMWRITE_PNG_COMPRESSION, std::min(9, level) });
+        }
+    } else if (lower == ".webp") {
+        if (params.quality > 0) {
+            flags.insert(flags.end(), { cv::IMWRITE_WEBP_QUALITY, std::min(100, params.quality) });
+        }
+    }
+    return flags;
+}
+
+ImageWriter& ImageWriter::Instance() {
+    static ImageWriter writer;
+    return writer;
+}
+
+ImageWriter::~ImageWriter() {
+    Stop();
+}
+
+int ImageWriter::WriteFile(const std::string& path, const cv::Mat& img, const ImageEncodeParams& params, Logger* logger) {
+    std::filesystem::path final_path(path);
+    std::string ext = final_path.extension().string();
+    std::vector<uchar> encoded;
+    try {
+        if (!cv::imencode(ext, img, encoded, ImageEncodeFlags(ext, params))) {
+            LogErrorf(logger, "encode %s failed", path.c_str());
+            return -1;
+        }
+    }
+    catch (const std::exception& e) {
+        LogErrorf(logger, "encode %s exception: %s", path.c_str(), e.what());
+        return -1;
+    }
+
+    // unique per write, two writes of the same path may run at once
+    static std::atomic<uint32_t> write_seq(0);
+    std::filesystem::path tmp_path = final_path;
+    tmp_path += ".writing" + std::to_string(write_seq++);
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!file.write((const char*)encoded.data(), encoded.size())) {
+            LogErrorf(logger, "write %s failed", tmp_path.string().c_str());
+            return -1;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, final_path, ec);
+    if (ec) {
+        std::filesystem::remove(tmp_path, ec);
+        LogErrorf(logger, "rename to %s failed", path.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+std::shared_future<int> ImageWriter::Write(const std::string& path, const cv::Mat& img, const ImageEncodeParams& params) {
+    WriteJob job;
+    job.path = path;
+    job.img = img;
+    job.params = params;
+    job.promise = std::make_shared<std::promise<int>>();
+    std::shared_future<int> future = job.promise->get_future().share();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) {
+        running_ = true;
+        for (int i = 0; i < IMAGE_WRITER_THREADS; i++) {
+            threads_.emplace_back(&ImageWriter::OnWork, this);
+        }
+    }
+    pending_[path] = future;
+    jobs_.push_back(std::move(job));
+    cond_.notify_one();
+    return future;
+}
+
+int ImageWriter::WaitPending(const std::string& path) {
+    std::shared_future<int> future;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = pending_.find(path);
+        if (it == pending_.end()) {
+            return 0;
+        }
+        future = it->second;
+    }
+    return future.get();
+}
+
+void ImageWriter::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+        cond_.notify_all();
+    }
+    // queued writes are finished before the threads exit
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    threads_.clear();
+}
+
+void ImageWriter::OnWork() {
+    while (true) {
+        WriteJob job;
+        {
+            // the oldest job whose path no other thread is writing
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto job_it = jobs_.end();
+            cond_.wait(lock, [this, &job_it] {
+                job_it = std::find_if(jobs_.begin(), jobs_.end(), [this](const WriteJob& queued) {
+                    return writing_.find(queued.path) == writing_.end();
+                });
+                return job_it != jobs_.end() || (!running_ && jobs_.empty());
+            });
+            if (job_it == jobs_.end()) {
+                return;
+            }
+            job = std::move(*job_it);
+            jobs_.erase(job_it);
+            writing_.insert(job.path);
+        }
+        int64_t start_ms = now_millisec();
+        int ret = WriteFile(job.path, job.img, job.params, logger_);
+        if (ret < 0) {
+            // the tool already returned the path, the next reader of it gets the error from WaitPending
+            LogErrorf(logger_, "image %s write failed, elapsed:%lldms", job.path.c_str(),
+                (long long)(now_millisec() - start_ms));
+        } else {
+            LogInfof(logger_, "image %s written, elapsed:%lldms", job.path.c_str(),
+                (long long)(now_millisec() - start_ms));
+        }
+        job.promise->set_value(ret);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        writing_.erase(job.path);
+        // the next write of the path may be waiting for this one
+        cond_.notify_all();
+        // a later write of the same path keeps its own entry, a failed one stays for WaitPending to report
+        auto it = pending_.find(job.path);
+        if (it != pending_.end() && it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready
+            && it->second.get() == 0) {
+            pending_.erase(it);
+        }
+    }
+}
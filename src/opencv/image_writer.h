@@ -0,0 +1,81 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include "utils/logger.hpp"
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <set>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+using namespace cpp_streamer;
+
+#define IMAGE_WRITER_THREADS 2
+
+typedef struct {
+    std::string format;            // "jpg", "png" or "webp", empty: from the path extension
+    int quality = -1;              // JPEG / WebP 1..100, PNG: mapped to the compression level, -1: codec default
+    bool progressive = false;      // JPEG
+    int chroma_subsampling = 0;    // JPEG 420, 422 or 444, 0: codec default (420)
+    int png_compression = -1;      // PNG 0..9, -1: from quality or the codec default
+} ImageEncodeParams;
+
+// path with its extension replaced by params.format, unchanged without a format
+std::string ApplyImageFormat(const std::string& path, const ImageEncodeParams& params);
+// cv::imwrite flags for the extension (".jpg", ".png", ...)
+std::vector<int> ImageEncodeFlags(const std::string& ext, const ImageEncodeParams& params);
+
+// Encodes images on background threads so a tool returns as soon as its
+// pixels are ready. The file is written to a temporary name and renamed, so
+// the path never holds a partial file; readers inside the process call
+// WaitPending before opening a path that may still be encoding.
+// Writes of one path run one after another in the order of Write, so an
+// older image never replaces a newer one.
+class ImageWriter
+{
+public:
+    static ImageWriter& Instance();
+
+public:
+    void SetLogger(Logger* logger) { logger_ = logger; }
+    // img is shared with the writer, the caller must not modify it afterwards.
+    // the future gives 0 when the file is written, -1 on failure
+    std::shared_future<int> Write(const std::string& path, const cv::Mat& img, const ImageEncodeParams& params);
+    // result of the pending write of path, 0 when nothing is pending;
+    // -1 also after it ended, until the path is written again
+    int WaitPending(const std::string& path);
+    void Stop();
+
+public:
+    // synchronous encode with the same flags and rename, used by the writer threads
+    static int WriteFile(const std::string& path, const cv::Mat& img, const ImageEncodeParams& params, Logger* logger);
+
+private:
+    ImageWriter() = default;
+    ~ImageWriter();
+    void OnWork();
+
+private:
+    typedef struct {
+        std::string path;
+        cv::Mat img;
+        ImageEncodeParams params;
+        std::shared_ptr<std::promise<int>> promise;
+    } WriteJob;
+
+    Logger* logger_ = nullptr;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::list<WriteJob> jobs_;
+    std::map<std::string, std::shared_future<int>> pending_; // key: path, its newest write
+    std::set<std::string> writing_;                           // paths a thread is writing
+    std::vector<std::thread> threads_;
+    bool running_ = false;
+};
+
+#endif
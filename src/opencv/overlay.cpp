@@ -0,0 +1,169 @@
+#include "overlay.h"
+#include <opencv2/core/hal/intrin.hpp>
+
+// (x + 127) / 255 for x in [0, 255*255], without a division
+static inline int Div255(int x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+static inline cv::v_uint16 Div255(const cv::v_uint16& x, const cv::v_uint16& v128) {
+    cv::v_uint16 t = cv::v_add(x, v128);
+    return cv::v_shr<8>(cv::v_add(t, cv::v_shr<8>(t)));
+}
+
+// s * a + d * (255 - a), rounded and divided by 255, 16 bit lanes
+static inline cv::v_uint8 BlendChannel(const cv::v_uint8& s, const cv::v_uint8& d,
+    const cv::v_uint16& a_lo, const cv::v_uint16& a_hi,
+    const cv::v_uint16& ia_lo, const cv::v_uint16& ia_hi, const cv::v_uint16& v128) {
+    cv::v_uint16 s_lo, s_hi, d_lo, d_hi;
+    cv::v_expand(s, s_lo, s_hi);
+    cv::v_expand(d, d_lo, d_hi);
+    cv::v_uint16 lo = cv::v_add(cv::v_mul_wrap(s_lo, a_lo), cv::v_mul_wrap(d_lo, ia_lo));
+    cv::v_uint16 hi = cv::v_add(cv::v_mul_wrap(s_hi, a_hi), cv::v_mul_wrap(d_hi, ia_hi));
+    return cv::v_pack(Div255(lo, v128), Div255(hi, v128));
+}
+
+// s + d * (255 - a) / 255 for a premultiplied s, the u8 add saturates
+static inline cv::v_uint8 BlendPremultipliedChannel(const cv::v_uint8& s, const cv::v_uint8& d,
+    const cv::v_uint16& ia_lo, const cv::v_uint16& ia_hi, const cv::v_uint16& v128) {
+    cv::v_uint16 d_lo, d_hi;
+    cv::v_expand(d, d_lo, d_hi);
+    cv::v_uint8 rest = cv::v_pack(Div255(cv::v_mul_wrap(d_lo, ia_lo), v128), Div255(cv::v_mul_wrap(d_hi, ia_hi), v128));
+    return cv::v_add(s, rest);
+}
+#endif
+
+static void BlendRow(uchar* d, const uchar* s, int width) {
+    int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+    const cv::v_uint16 v255 = cv::vx_setall_u16(255);
+    const cv::v_uint16 v128 = cv::vx_setall_u16(128);
+    for (; x <= width - lanes; x += lanes) {
+        cv::v_uint8 sb, sg, sr, sa, db, dg, dr;
+        cv::v_load_deinterleave(s + x * 4, sb, sg, sr, sa);
+        cv::v_load_deinterleave(d + x * 3, db, dg, dr);
+        cv::v_uint16 a_lo, a_hi;
+        cv::v_expand(sa, a_lo, a_hi);
+        cv::v_uint16 ia_lo = cv::v_sub(v255, a_lo);
+        cv::v_uint16 ia_hi = cv::v_sub(v255, a_hi);
+        db = BlendChannel(sb, db, a_lo, a_hi, ia_lo, ia_hi, v128);
+        dg = BlendChannel(sg, dg, a_lo, a_hi, ia_lo, ia_hi, v128);
+        dr = BlendChannel(sr, dr, a_lo, a_hi, ia_lo, ia_hi, v128);
+        cv::v_store_interleave(d + x * 3, db, dg, dr);
+    }
+#endif
+    for (; x < width; x++) {
+        const uchar* sp = s + x * 4;
+        uchar* dp = d + x * 3;
+        int a = sp[3];
+        dp[0] = (uchar)Div255(sp[0] * a + dp[0] * (255 - a));
+        dp[1] = (uchar)Div255(sp[1] * a + dp[1] * (255 - a));
+        dp[2] = (uchar)Div255(sp[2] * a + dp[2] * (255 - a));
+    }
+}
+
+static void BlendPremultipliedRow(uchar* d, const uchar* s, int width) {
+    int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+    const cv::v_uint8 v255 = cv::vx_setall_u8(255);
+    const cv::v_uint16 v128 = cv::vx_setall_u16(128);
+    for (; x <= width - lanes; x += lanes) {
+        cv::v_uint8 sb, sg, sr, sa, db, dg, dr;
+        cv::v_load_deinterleave(s + x * 4, sb, sg, sr, sa);
+        cv::v_load_deinterleave(d + x * 3, db, dg, dr);
+        cv::v_uint16 ia_lo, ia_hi;
+        cv::v_expand(cv::v_sub(v255, sa), ia_lo, ia_hi);
+        db = BlendPremultipliedChannel(sb, db, ia_lo, ia_hi, v128);
+        dg = BlendPremultipliedChannel(sg, dg, ia_lo, ia_hi, v128);
+        dr = BlendPremultipliedChannel(sr, dr, ia_lo, ia_hi, v128);
+        cv::v_store_interleave(d + x * 3, db, dg, dr);
+    }
+#endif
+    for (; x < width; x++) {
+        const uchar* sp = s + x * 4;
+        uchar* dp = d + x * 3;
+        int ia = 255 - sp[3];
+        dp[0] = cv::saturate_cast<uchar>(sp[0] + Div255(dp[0] * ia));
+        dp[1] = cv::saturate_cast<uchar>(sp[1] + Div255(dp[1] * ia));
+        dp[2] = cv::saturate_cast<uchar>(sp[2] + Div255(dp[2] * ia));
+    }
+}
+
+static void ThresholdRow(uchar* d, const uchar* s, int width, int alpha_threshold) {
+    int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+    const cv::v_uint8 vthreshold = cv::vx_setall_u8((uchar)alpha_threshold);
+    for (; x <= width - lanes; x += lanes) {
+        cv::v_uint8 sb, sg, sr, sa, db, dg, dr;
+        cv::v_load_deinterleave(s + x * 4, sb, sg, sr, sa);
+        cv::v_load_deinterleave(d + x * 3, db, dg, dr);
+        cv::v_uint8 mask = cv::v_gt(sa, vthreshold);
+        cv::v_store_interleave(d + x * 3, cv::v_select(mask, sb, db),
+            cv::v_select(mask, sg, dg), cv::v_select(mask, sr, dr));
+    }
+#endif
+    for (; x < width; x++) {
+        const uchar* sp = s + x * 4;
+        if (sp[3] > alpha_threshold) {
+            uchar* dp = d + x * 3;
+            dp[0] = sp[0];
+            dp[1] = sp[1];
+            dp[2] = sp[2];
+        }
+    }
+}
+
+int OverlayRGBA(cv::Mat& dst, const cv::Mat& src, const cv::Rect& roi, OverlayMode mode, int alpha_threshold) {
+    if (dst.type() != CV_8UC3 || src.type() != CV_8UC4 || roi.empty()) {
+        return -1;
+    }
+    cv::Mat overlay = src;
+    if (src.size() != roi.size()) {
+        cv::resize(src, overlay, roi.size(), 0, 0, cv::INTER_LINEAR);
+    }
+
+    cv::Rect dst_roi = roi & cv::Rect(0, 0, dst.cols, dst.rows);
+    if (dst_roi.empty()) {
+        return 0;
+    }
+    cv::Mat dst_part = dst(dst_roi);
+    cv::Mat src_part = overlay(cv::Rect(dst_roi.x - roi.x, dst_roi.y - roi.y, dst_roi.width, dst_roi.height));
+    alpha_threshold = std::min(255, std::max(0, alpha_threshold));
+
+    cv::parallel_for_(cv::Range(0, dst_part.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; y++) {
+            if (mode == OVERLAY_ALPHA_BLEND) {
+                BlendRow(dst_part.ptr<uchar>(y), src_part.ptr<uchar>(y), dst_part.cols);
+            } else if (mode == OVERLAY_PREMULTIPLIED) {
+                BlendPremultipliedRow(dst_part.ptr<uchar>(y), src_part.ptr<uchar>(y), dst_part.cols);
+            } else {
+                ThresholdRow(dst_part.ptr<uchar>(y), src_part.ptr<uchar>(y), dst_part.cols, alpha_threshold);
+            }
+        }
+    });
+    return 0;
+}
+
+int PremultiplyRGBA(const cv::Mat& src, cv::Mat& dst) {
+    if (src.type() != CV_8UC4) {
+        return -1;
+    }
+    dst.create(src.size(), CV_8UC4);
+    for (int y = 0; y < src.rows; y++) {
+        const uchar* sp = src.ptr<uchar>(y);
+        uchar* dp = dst.ptr<uchar>(y);
+        for (int x = 0; x < src.cols; x++, sp += 4, dp += 4) {
+            int a = sp[3];
+            dp[0] = (uchar)Div255(sp[0] * a);
+            dp[1] = (uchar)Div255(sp[1] * a);
+            dp[2] = (uchar)Div255(sp[2] * a);
+            dp[3] = (uchar)a;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <opencv2/opencv.hpp>
+
+enum OverlayMode {
+    OVERLAY_THRESHOLD,   // copy the overlay pixels whose alpha is above the threshold
+    OVERLAY_ALPHA_BLEND, // dst = src * a + dst * (1 - a)
+    OVERLAY_PREMULTIPLIED // src already multiplied by its alpha: dst = src + dst * (1 - a)
+};
+
+// Composites a BGRA overlay onto a BGR image at roi. The overlay is resized to
+// the roi when the sizes differ; parts of the roi outside dst are skipped.
+// Rows run in parallel, each row is blended with OpenCV universal intrinsics.
+// return 0 on success, -1 on bad input types
+int OverlayRGBA(cv::Mat& dst, const cv::Mat& src, const cv::Rect& roi, OverlayMode mode, int alpha_threshold = 10);
+
+// BGRA -> BGRA with the color channels multiplied by alpha, for overlays that are
+// cached and blended many times with OVERLAY_PREMULTIPLIED
+// return 0 on success, -1 on bad input type
+int PremultiplyRGBA(const cv::Mat& src, cv::Mat& dst);
+
+#endif
@@ -0,0 +1,69 @@
+#include "smooth.h"
+
+SmoothQuality ParseSmoothQuality(const std::string& name, SmoothQuality def_quality) {
+    if (name == "fast") {
+        return SMOOTH_FAST;
+    }
+    if (name == "balanced") {
+        return SMOOTH_BALANCED;
+    }
+    if (name == "best") {
+        return SMOOTH_BEST;
+    }
+    return def_quality;
+}
+
+const char* SmoothQualityName(SmoothQuality quality) {
+    switch (quality) {
+    case SMOOTH_FAST:
+        return "fast";
+    case SMOOTH_BALANCED:
+        return "balanced";
+    default:
+        return "best";
+    }
+}
+
+// Self guided filter (He et al.), every channel guides itself:
+//   a = var / (var + eps), b = mean - a * mean, q = box(a) * I + box(b)
+// The coefficients are computed on a copy downscaled by subsample and
+// upsampled before the final per-pixel step.
+static void GuidedSmooth(const cv::Mat& src, cv::Mat& dst, int radius, double eps, int subsample) {
+    cv::Mat guide;
+    src.convertTo(guide, CV_32F, 1.0 / 255);
+
+    cv::Mat small = guide;
+    if (subsample > 1) {
+        cv::resize(guide, small, cv::Size(), 1.0 / subsample, 1.0 / subsample, cv::INTER_AREA);
+        radius = std::max(1, radius / subsample);
+    }
+    cv::Size ksize(2 * radius + 1, 2 * radius + 1);
+
+    cv::Mat mean, mean_sq, var;
+    cv::boxFilter(small, mean, CV_32F, ksize);
+    cv::boxFilter(small.mul(small), mean_sq, CV_32F, ksize);
+    var = mean_sq - mean.mul(mean);
+
+    cv::Mat a, b;
+    cv::divide(var, var + cv::Scalar::all(eps), a);
+    b = mean - a.mul(mean);
+    cv::boxFilter(a, a, CV_32F, ksize);
+    cv::boxFilter(b, b, CV_32F, ksize);
+
+    if (subsample > 1) {
+        cv::resize(a, a, guide.size(), 0, 0, cv::INTER_LINEAR);
+        cv::resize(b, b, guide.size(), 0, 0, cv::INTER_LINEAR);
+    }
+    cv::Mat q = a.mul(guide) + b;
+    q.convertTo(dst, CV_8U, 255.0);
+}
+
+void EdgePreservingSmooth(const cv::Mat& src, cv::Mat& dst, int d, double sigmaColor, double sigmaSpace, SmoothQuality quality) {
+    if (quality == SMOOTH_BEST) {
+        cv::bilateralFilter(src, dst, d, sigmaColor, sigmaSpace);
+        return;
+    }
+    int radius = std::max(1, d / 2);
+    double eps = (sigmaColor / 255.0) * (sigmaColor / 255.0);
+    GuidedSmooth(src, dst, radius, eps, quality == SMOOTH_FAST ? 4 : 1);
+}
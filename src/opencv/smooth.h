@@ -0,0 +1,22 @@
+#ifndef SMOOTH_H
+#define SMOOTH_H
+
+#include <opencv2/opencv.hpp>
+#include <string>
+
+enum SmoothQuality {
+    SMOOTH_FAST,     // guided filter computed at 1/4 resolution, coefficients upsampled
+    SMOOTH_BALANCED, // guided filter at full resolution, cost independent of the radius
+    SMOOTH_BEST      // cv::bilateralFilter
+};
+
+// "fast" / "balanced" / "best", anything else gives def_quality
+SmoothQuality ParseSmoothQuality(const std::string& name, SmoothQuality def_quality);
+const char* SmoothQualityName(SmoothQuality quality);
+
+// Edge preserving smoothing of a BGR image with bilateralFilter parameters.
+// The guided filter modes map d to the box radius and sigmaColor to the
+// regularisation, so the look stays close to the bilateral result.
+void EdgePreservingSmooth(const cv::Mat& src, cv::Mat& dst, int d, double sigmaColor, double sigmaSpace, SmoothQuality quality);
+
+#endif
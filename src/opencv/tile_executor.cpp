@@ -0,0 +1,58 @@
+#include "tile_executor.h"
+#include <atomic>
+#include <vector>
+
+TileExecutor::TileExecutor(int tile_size, int max_inflight)
+    : tile_size_(std::max(64, tile_size))
+    , max_inflight_(max_inflight > 0 ? max_inflight : std::max(1, cv::getNumThreads())) {
+}
+
+int TileExecutor::Run(const cv::Mat& src, cv::Mat& dst, int dst_type, int halo, const TileFunc& func, Logger* logger) {
+    if (src.empty()) {
+        return -1;
+    }
+    halo = std::max(0, halo);
+
+    std::vector<cv::Rect> tiles;
+    for (int y = 0; y < src.rows; y += tile_size_) {
+        for (int x = 0; x < src.cols; x += tile_size_) {
+            tiles.push_back(cv::Rect(x, y, std::min(tile_size_, src.cols - x), std::min(tile_size_, src.rows - y)));
+        }
+    }
+    dst.create(src.size(), dst_type);
+
+    int workers = std::min(max_inflight_, (int)tiles.size());
+    std::atomic<size_t> next_tile(0);
+    std::atomic<int> ret(0);
+    const cv::Rect bounds(0, 0, src.cols, src.rows);
+
+    LogInfof(logger, "tile run %dx%d, tiles:%d, tile size:%d, halo:%d, workers:%d",
+        src.cols, src.rows, (int)tiles.size(), tile_size_, halo, workers);
+
+    // one stripe per worker, the workers pull tiles until none are left
+    cv::parallel_for_(cv::Range(0, workers), [&](const cv::Range& range) {
+        for (int worker = range.start; worker < range.end; worker++) {
+            cv::Mat tile_out;
+            size_t index;
+            while (ret.load() >= 0 && (index = next_tile.fetch_add(1)) < tiles.size()) {
+                const cv::Rect& inner = tiles[index];
+                // clipped to the image, the image border itself gets the filter's border mode
+                cv::Rect outer = cv::Rect(inner.x - halo, inner.y - halo,
+                    inner.width + 2 * halo, inner.height + 2 * halo) & bounds;
+
+                // a copy, so the filter cannot read past the halo through the parent Mat
+                cv::Mat tile_in = src(outer).clone();
+                int tile_ret = func(tile_in, tile_out);
+                if (tile_ret < 0 || tile_out.size() != tile_in.size() || tile_out.type() != dst_type) {
+                    LogErrorf(logger, "tile %d,%d %dx%d failed, ret:%d",
+                        inner.x, inner.y, inner.width, inner.height, tile_ret);
+                    ret = tile_ret < 0 ? tile_ret : -1;
+                    break;
+                }
+                cv::Rect part(inner.x - outer.x, inner.y - outer.y, inner.width, inner.height);
+                tile_out(part).copyTo(dst(inner));
+            }
+        }
+    }, workers);
+    return ret.load();
+}
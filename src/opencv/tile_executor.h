@@ -0,0 +1,40 @@
+#ifndef TILE_EXECUTOR_H
+#define TILE_EXECUTOR_H
+
+#include "utils/logger.hpp"
+#include <opencv2/opencv.hpp>
+#include <functional>
+
+using namespace cpp_streamer;
+
+#define TILE_DEF_SIZE    1024                // tile edge, without the halo
+#define TILE_MIN_PIXELS  (4096 * 4096)       // smaller images are filtered in one piece
+
+// filter of one tile: src is the tile plus its halo, dst gets the same size
+typedef std::function<int(const cv::Mat& src, cv::Mat& dst)> TileFunc;
+
+// Runs a local filter tile by tile so the filter temporaries are tile sized.
+// Every tile is extended by a halo of at least the filter's kernel radius, only
+// the inner part of the result is copied to dst, so the seams match the whole
+// image result. At most max_inflight tiles are in work at a time, each worker
+// reuses its tile buffers.
+class TileExecutor
+{
+public:
+    // max_inflight 0: cv::getNumThreads()
+    TileExecutor(int tile_size = TILE_DEF_SIZE, int max_inflight = 0);
+    ~TileExecutor() = default;
+
+public:
+    // dst is allocated as src.size() x dst_type, return the first negative func result
+    int Run(const cv::Mat& src, cv::Mat& dst, int dst_type, int halo, const TileFunc& func, Logger* logger);
+
+public:
+    static bool ShouldTile(const cv::Mat& src) { return src.total() >= (size_t)TILE_MIN_PIXELS; }
+
+private:
+    int tile_size_;
+    int max_inflight_;
+};
+
+#endif
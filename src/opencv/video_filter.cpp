@@ -0,0 +1,162 @@
+#include "video_filter.h"
+#include "utils/bounded_queue.hpp"
+#include "utils/timeex.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef struct {
+    int64_t index = 0;
+    cv::Mat frame;   // decoded frame, reused by VideoCapture::read
+    cv::Mat result;  // filter output, reused by the filter when the size matches
+    bool filtered = false;
+} FrameSlot;
+
+static int VideoFourcc(const std::string& path) {
+    std::string ext = std::filesystem::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)tolower(c); });
+    if (ext == ".mp4" || ext == ".m4v" || ext == ".mov") {
+        return cv::VideoWriter::fourcc('m', 'p', '4', 'v');
+    }
+    return cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+}
+
+int FilterVideo(const std::string& src_path, const std::string& dst_path, const FrameFilterFunc& filter,
+    const VideoFilterOptions& options, VideoFilterSummary& summary, std::string& err_msg, Logger* logger) {
+    summary = VideoFilterSummary();
+    cv::VideoCapture capture(src_path);
+    if (!capture.isOpened()) {
+        err_msg = "Failed to open video: " + src_path;
+        return -1;
+    }
+    summary.source_fps = capture.get(cv::CAP_PROP_FPS);
+    if (summary.source_fps <= 0) {
+        summary.source_fps = 25;
+    }
+
+    int workers = options.workers > 0 ? options.workers : (int)std::max(1u, std::thread::hardware_concurrency());
+    int slot_count = options.frames_in_flight > 0 ? options.frames_in_flight : workers * 2;
+    slot_count = std::max(slot_count, workers + 1);
+
+    std::vector<FrameSlot> slots(slot_count);
+    BoundedQueue<FrameSlot*> free_slots(slot_count);
+    BoundedQueue<FrameSlot*> work_slots(slot_count);
+    for (auto& slot : slots) {
+        free_slots.Push(&slot);
+    }
+
+    // filtered frames wait here until every earlier frame is written
+    std::mutex done_mutex;
+    std::condition_variable done_cond;
+    std::map<int64_t, FrameSlot*> done_slots;
+    std::atomic<int> workers_left(workers);
+    std::atomic<int64_t> failed_frames(0);
+    bool workers_done = false;
+
+    int64_t start_ms = now_millisec();
+    std::vector<std::thread> threads;
+    threads.emplace_back([&]() {
+        int64_t index = 0;
+        FrameSlot* slot;
+        while (free_slots.Pop(slot)) {
+            if (!capture.read(slot->frame) || slot->frame.empty()) {
+                break;
+            }
+            slot->index = index++;
+            work_slots.Push(slot);
+        }
+        work_slots.Close();
+    });
+    for (int i = 0; i < workers; i++) {
+        threads.emplace_back([&]() {
+            FrameSlot* slot;
+            while (work_slots.Pop(slot)) {
+                int ret = -1;
+                try {
+                    ret = filter(slot->frame, slot->result);
+                }
+                catch (const std::exception& e) {
+                    LogErrorf(logger, "video frame %lld filter exception: %s", (long long)slot->index, e.what());
+                }
+                slot->filtered = ret >= 0 && !slot->result.empty();
+                if (!slot->filtered) {
+                    failed_frames++;
+                }
+                std::lock_guard<std::mutex> lock(done_mutex);
+                done_slots[slot->index] = slot;
+                done_cond.notify_one();
+            }
+            if (--workers_left == 0) {
+                std::lock_guard<std::mutex> lock(done_mutex);
+                workers_done = true;
+                done_cond.notify_one();
+            }
+        });
+    }
+
+    // writer, on this thread: frames in decode order
+    cv::VideoWriter writer;
+    int64_t next_index = 0;
+    int ret = 0;
+    while (true) {
+        FrameSlot* slot = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(done_mutex);
+            done_cond.wait(lock, [&] { return workers_done || done_slots.count(next_index) > 0; });
+            auto it = done_slots.find(next_index);
+            if (it == done_slots.end()) {
+                break;
+            }
+            slot = it->second;
+            done_slots.erase(it);
+        }
+        const cv::Mat& out = slot->filtered ? slot->result : slot->frame;
+        if (!writer.isOpened() && ret == 0) {
+            summary.width = out.cols;
+            summary.height = out.rows;
+            if (!writer.open(dst_path, VideoFourcc(dst_path), summary.source_fps, out.size(), out.channels() == 3)) {
+                err_msg = "Failed to open video writer: " + dst_path;
+                ret = -1;
+            }
+        }
+        if (ret == 0) {
+            if (out.size() == cv::Size(summary.width, summary.height)) {
+                writer.write(out);
+            } else {
+                cv::Mat resized;
+                cv::resize(out, resized, cv::Size(summary.width, summary.height));
+                writer.write(resized);
+            }
+        }
+        next_index++;
+        free_slots.Push(slot);
+        if (ret < 0) {
+            // let the reader stop, the workers drain what is left
+            free_slots.Close();
+        }
+    }
+    free_slots.Close();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    writer.release();
+
+    summary.frames = next_index;
+    summary.failed_frames = failed_frames.load();
+    summary.elapsed_ms = now_millisec() - start_ms;
+    summary.achieved_fps = summary.elapsed_ms > 0 ? summary.frames * 1000.0 / summary.elapsed_ms : 0;
+    LogInfof(logger, "video %s -> %s, frames:%lld, failed:%lld, %dx%d, source fps:%.2f, achieved fps:%.2f, workers:%d, slots:%d",
+        src_path.c_str(), dst_path.c_str(), (long long)summary.frames, (long long)summary.failed_frames,
+        summary.width, summary.height, summary.source_fps, summary.achieved_fps, workers, slot_count);
+    if (ret == 0 && summary.frames == 0) {
+        err_msg = "No frames decoded from: " + src_path;
+        ret = -1;
+    }
+    return ret;
+}
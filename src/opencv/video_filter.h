@@ -0,0 +1,37 @@
+#ifndef VIDEO_FILTER_H
+#define VIDEO_FILTER_H
+
+#include "utils/logger.hpp"
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+#include <functional>
+#include <string>
+
+using namespace cpp_streamer;
+
+typedef std::function<int(const cv::Mat& src, cv::Mat& dst)> FrameFilterFunc;
+
+typedef struct {
+    int workers = 0;          // 0: hardware concurrency
+    int frames_in_flight = 0; // frame buffers shared by the stages, 0: 2 per worker
+} VideoFilterOptions;
+
+typedef struct {
+    int64_t frames = 0;
+    int64_t failed_frames = 0; // written unfiltered
+    double source_fps = 0;
+    double achieved_fps = 0;   // frames / wall time, decode and encode included
+    int width = 0;
+    int height = 0;
+    int64_t elapsed_ms = 0;
+} VideoFilterSummary;
+
+// Decodes src_path with cv::VideoCapture, filters the frames on a pool of
+// workers and writes them in order with cv::VideoWriter to dst_path (mp4v for
+// .mp4, MJPG otherwise). A fixed set of frame buffers circulates between the
+// reader, the workers and the writer, so memory is bounded and the frame and
+// result Mats are reused instead of allocated per frame.
+int FilterVideo(const std::string& src_path, const std::string& dst_path, const FrameFilterFunc& filter,
+    const VideoFilterOptions& options, VideoFilterSummary& summary, std::string& err_msg, Logger* logger);
+
+#endif
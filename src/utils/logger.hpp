@@ -12,6 +12,7 @@
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <mutex>
 
 namespace cpp_streamer
 {
@@ -57,6 +58,7 @@ public:
         return level_;
     }
     void AllocBuffer(size_t len) {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
         if (buffer_) {
             delete[] buffer_;
         }
@@ -69,7 +71,12 @@ public:
     size_t BufferSize() {
         return buffer_len_;
     }
+    // guards the shared format buffer and the file, the loggers are used from several loop threads
+    std::recursive_mutex& GetMutex() {
+        return mutex_;
+    }
     void Logf(const char* level, const char* buffer) {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
         std::stringstream ss;
 
 
@@ -105,6 +112,7 @@ private:
     char* buffer_ = nullptr;
     size_t buffer_len_ = LOGGER_BUFFER_SIZE;
     bool console_enable_ = false;
+    std::recursive_mutex mutex_;
 };
 
 inline void LogError(Logger* logger, const char* data) {
@@ -118,6 +126,7 @@ inline void LogErrorf(Logger* logger, const char* fmt, ...) {
     if (logger == nullptr || logger->GetLevel() > LOGGER_ERROR_LEVEL) {
         return;
     }
+    std::lock_guard<std::recursive_mutex> lock(logger->GetMutex());
     char* buffer = logger->GetBuffer();
     size_t bsize = logger->BufferSize();
     va_list ap;
@@ -141,6 +150,7 @@ inline void LogWarnf(Logger* logger, const char* fmt, ...) {
     if (logger == nullptr || logger->GetLevel() > LOGGER_WARN_LEVEL) {
         return;
     }
+    std::lock_guard<std::recursive_mutex> lock(logger->GetMutex());
     char* buffer = logger->GetBuffer();
     size_t bsize = logger->BufferSize();
     va_list ap;
@@ -163,6 +173,7 @@ inline void LogInfof(Logger* logger, const char* fmt, ...) {
     if (logger == nullptr || logger->GetLevel() > LOGGER_INFO_LEVEL) {
         return;
     }
+    std::lock_guard<std::recursive_mutex> lock(logger->GetMutex());
     char* buffer = logger->GetBuffer();
     size_t bsize = logger->BufferSize();
     va_list ap;
@@ -188,6 +199,7 @@ inline void LogDebugf(Logger* logger, const char* fmt, ...) {
     if (logger == nullptr || logger->GetLevel() > LOGGER_DEBUG_LEVEL) {
         return;
     }
+    std::lock_guard<std::recursive_mutex> lock(logger->GetMutex());
     char* buffer = logger->GetBuffer();
     size_t bsize = logger->BufferSize();
     va_list ap;
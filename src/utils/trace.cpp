@@ -0,0 +1,228 @@
+#include "trace.hpp"
+#include "timeex.hpp"
+#include "json.hpp"
+
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+
+namespace cpp_streamer
+{
+class TraceRing
+{
+public:
+    TraceRing(uint32_t tid) : tid_(tid) {}
+
+public:
+    TraceEvent events_[TRACE_RING_SIZE];
+    std::atomic<uint64_t> head_{0};
+    uint32_t tid_ = 0;
+};
+
+std::atomic<bool> Tracer::enabled_{false};
+
+static std::atomic<uint64_t> s_span_id{0};
+static std::mutex s_rings_mutex;
+// rings outlive their threads so that a dump on shutdown still sees them
+static std::vector<std::unique_ptr<TraceRing>> s_rings;
+// rings of exited threads, reused by new threads: the count stays at the most
+// threads tracing at once, a reused ring keeps its events until overwritten
+static std::vector<TraceRing*> s_free_rings;
+static thread_local uint64_t s_current_span = 0;
+
+class ThreadRingOwner
+{
+public:
+    ~ThreadRingOwner() {
+        if (ring_) {
+            std::lock_guard<std::mutex> lock(s_rings_mutex);
+            s_free_rings.push_back(ring_);
+        }
+    }
+
+public:
+    TraceRing* ring_ = nullptr;
+};
+
+static thread_local ThreadRingOwner s_thread_ring;
+
+static TraceRing* GetThreadRing() {
+    if (s_thread_ring.ring_) {
+        return s_thread_ring.ring_;
+    }
+    std::lock_guard<std::mutex> lock(s_rings_mutex);
+    if (!s_free_rings.empty()) {
+        s_thread_ring.ring_ = s_free_rings.back();
+        s_free_rings.pop_back();
+    } else {
+        s_rings.emplace_back(new TraceRing((uint32_t)s_rings.size() + 1));
+        s_thread_ring.ring_ = s_rings.back().get();
+    }
+    return s_thread_ring.ring_;
+}
+
+static void CopyName(char* dst, const char* src) {
+    if (!src) {
+        dst[0] = 0;
+        return;
+    }
+    size_t len = strlen(src);
+    if (len >= TRACE_NAME_LEN) {
+        len = TRACE_NAME_LEN - 1;
+    }
+    memcpy(dst, src, len);
+    dst[len] = 0;
+}
+
+void Tracer::Enable(bool enable) {
+    enabled_.store(enable, std::memory_order_relaxed);
+}
+
+uint64_t Tracer::NewSpanId() {
+    return s_span_id.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+uint64_t Tracer::CurrentSpanId() {
+    return s_current_span;
+}
+
+void Tracer::Record(const char* category, const char* name,
+                uint64_t id, uint64_t parent_id,
+                int64_t start_us, int64_t end_us) {
+    if (!IsEnabled()) {
+        return;
+    }
+    TraceRing* ring = GetThreadRing();
+    uint64_t pos = ring->head_.load(std::memory_order_relaxed);
+    TraceEvent& ev = ring->events_[pos % TRACE_RING_SIZE];
+
+    // odd sequence: slot is being written
+    uint32_t seq = ev.seq_.load(std::memory_order_relaxed);
+    ev.seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    CopyName(ev.name_, name);
+    ev.category_  = category;
+    ev.id_        = id;
+    ev.parent_id_ = parent_id;
+    ev.start_us_  = start_us;
+    ev.dur_us_    = end_us - start_us;
+
+    ev.seq_.store(seq + 2, std::memory_order_release);
+    ring->head_.store(pos + 1, std::memory_order_release);
+}
+
+int Tracer::DumpChromeTrace(const std::string& filename) {
+    std::vector<TraceRing*> rings;
+    {
+        std::lock_guard<std::mutex> lock(s_rings_mutex);
+        for (auto& ring : s_rings) {
+            rings.push_back(ring.get());
+        }
+    }
+
+    nlohmann::json trace_events = nlohmann::json::array();
+    for (TraceRing* ring : rings) {
+        uint64_t head  = ring->head_.load(std::memory_order_acquire);
+        uint64_t count = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+
+        for (uint64_t pos = head - count; pos < head; pos++) {
+            TraceEvent& ev = ring->events_[pos % TRACE_RING_SIZE];
+            uint32_t seq1 = ev.seq_.load(std::memory_order_acquire);
+            if (seq1 & 1) {
+                continue;
+            }
+            char name[TRACE_NAME_LEN];
+            memcpy(name, ev.name_, sizeof(name));
+            name[TRACE_NAME_LEN - 1] = 0;
+            const char* category = ev.category_;
+            uint64_t id        = ev.id_;
+            uint64_t parent_id = ev.parent_id_;
+            int64_t start_us   = ev.start_us_;
+            int64_t dur_us     = ev.dur_us_;
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (ev.seq_.load(std::memory_order_relaxed) != seq1) {
+                continue;//overwritten while reading
+            }
+            nlohmann::json item;
+            item["name"] = name;
+            item["cat"]  = category ? category : "";
+            item["ph"]   = "X";
+            item["ts"]   = start_us;
+            item["dur"]  = dur_us;
+            item["pid"]  = 1;
+            item["tid"]  = ring->tid_;
+            item["args"]["id"]     = id;
+            item["args"]["parent"] = parent_id;
+            trace_events.push_back(item);
+        }
+    }
+
+    nlohmann::json root;
+    root["traceEvents"] = trace_events;
+    root["displayTimeUnit"] = "ms";
+    std::string content = root.dump();
+
+    FILE* fp = nullptr;
+#ifdef _WIN64
+    if (fopen_s(&fp, filename.c_str(), "wb") != 0) {
+        fp = nullptr;
+    }
+#else
+    fp = fopen(filename.c_str(), "wb");
+#endif
+    if (fp == nullptr) {
+        return -1;
+    }
+    fwrite(content.c_str(), content.length(), 1, fp);
+    fclose(fp);
+
+    return (int)trace_events.size();
+}
+
+TraceScope::TraceScope(const char* category, const char* name, uint64_t parent_id) {
+    if (!Tracer::IsEnabled()) {
+        return;
+    }
+    category_  = category;
+    CopyName(name_, name);
+    id_        = Tracer::NewSpanId();
+    parent_id_ = parent_id ? parent_id : s_current_span;
+    prev_id_   = s_current_span;
+    start_us_  = now_microsec();
+    s_current_span = id_;
+}
+
+TraceScope::~TraceScope() {
+    if (id_ == 0) {
+        return;
+    }
+    s_current_span = prev_id_;
+    Tracer::Record(category_, name_, id_, parent_id_, start_us_, now_microsec());
+}
+
+void TraceSpan::Begin(const char* category, const char* name, uint64_t parent_id) {
+    if (!Tracer::IsEnabled()) {
+        return;
+    }
+    End();
+    category_  = category;
+    CopyName(name_, name);
+    id_        = Tracer::NewSpanId();
+    parent_id_ = parent_id ? parent_id : Tracer::CurrentSpanId();
+    start_us_  = now_microsec();
+    active_    = true;
+}
+
+void TraceSpan::End() {
+    if (!active_) {
+        return;
+    }
+    active_ = false;
+    Tracer::Record(category_, name_, id_, parent_id_, start_us_, now_microsec());
+}
+
+}
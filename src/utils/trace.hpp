@@ -0,0 +1,92 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <atomic>
+
+namespace cpp_streamer
+{
+
+#define TRACE_RING_SIZE (16*1024) // events kept per thread, the oldest are overwritten
+#define TRACE_NAME_LEN  48
+
+// One finished span. Each slot carries a sequence number so the dump thread
+// can read the ring without locking the writer (seqlock).
+class TraceEvent
+{
+public:
+    std::atomic<uint32_t> seq_{0};
+    char name_[TRACE_NAME_LEN];
+    const char* category_ = "";
+    uint64_t id_          = 0;
+    uint64_t parent_id_   = 0;
+    int64_t start_us_     = 0;
+    int64_t dur_us_       = 0;
+};
+
+// Opt-in span recorder. Spans are written into a per-thread lock-free ring
+// buffer and exported as Chrome trace_event JSON (chrome://tracing, Perfetto).
+class Tracer
+{
+public:
+    static void Enable(bool enable);
+    static bool IsEnabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    static uint64_t NewSpanId();
+    static uint64_t CurrentSpanId();//innermost TraceScope of the calling thread
+    static void Record(const char* category, const char* name,
+                    uint64_t id, uint64_t parent_id,
+                    int64_t start_us, int64_t end_us);
+
+    // return the number of events written, or -1 on file error
+    static int DumpChromeTrace(const std::string& filename);
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+// Synchronous span, recorded when the scope exits.
+// parent_id == 0 means: nest under the current scope of this thread.
+class TraceScope
+{
+public:
+    TraceScope(const char* category, const char* name, uint64_t parent_id = 0);
+    ~TraceScope();
+
+public:
+    uint64_t Id() const { return id_; }
+
+private:
+    const char* category_ = "";
+    char name_[TRACE_NAME_LEN];
+    uint64_t id_        = 0;
+    uint64_t parent_id_ = 0;
+    uint64_t prev_id_   = 0;
+    int64_t start_us_   = 0;
+};
+
+// Asynchronous span: Begin() and End() may happen in different libuv callbacks.
+class TraceSpan
+{
+public:
+    TraceSpan() = default;
+    ~TraceSpan() { End(); }
+
+public:
+    void Begin(const char* category, const char* name, uint64_t parent_id = 0);
+    void End();
+    bool IsActive() const { return active_; }
+    uint64_t Id() const { return id_; }
+
+private:
+    const char* category_ = "";
+    char name_[TRACE_NAME_LEN];
+    uint64_t id_        = 0;
+    uint64_t parent_id_ = 0;
+    int64_t start_us_   = 0;
+    bool active_        = false;
+};
+
+}
+#endif //TRACE_HPP